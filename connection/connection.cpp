@@ -157,6 +157,9 @@ IO::Status ConnectionPrivate::handleIoReady(IO::RW rw)
             uint32 failedSerial = msg.serial();
             Error error = msg.error();
             m_sendQueue.pop_front();
+            if (m_sendQueue.empty()) {
+                m_transport->setWriteListener(nullptr);
+            }
             // If the following fails, there is no "spontaneously failed to send" notification mechanism.
             // It is not a mistake in this case that it fails silently.
             maybeDispatchToPendingReply(failedSerial, error);
@@ -413,6 +416,11 @@ void ConnectionPrivate::handleHelloReply()
         }
     }
 
+    // messages sent by the API client while we were waiting for the unique name
+    if (!m_sendQueue.empty()) {
+        m_transport->setWriteListener(this);
+    }
+
     ConnectionStateChanger stateChanger(this, Connected);
 }
 
@@ -493,10 +501,94 @@ void ConnectionPrivate::sendPreparedMessage(Message msg)
     m_sendQueue.push_back(std::move(msg));
     if (m_state == ConnectionPrivate::Connected && m_sendQueue.size() == 1) {
         // first in queue, don't wait for some other event to trigger sending
-        mpriv->send(m_transport);
+        m_transport->setWriteListener(this);
     }
 }
 
+enum {
+    // Limits for the amount of data to send in one go. Much more than fits into the socket's send buffer
+    // doesn't help, and the chunk array shouldn't get too large.
+    MaxBatchedChunks = 1024,
+    MaxBatchedLength = 256 * 1024
+};
+
+IO::Status ConnectionPrivate::handleTransportCanWrite()
+{
+    while (!m_sendQueue.empty()) {
+        // Gather data from as many messages as possible. Messages with file descriptors are sent on their
+        // own, because the receiver can only tell to which message the file descriptors belong if the data
+        // that they come with does not continue into another message - see ITransport::readBuffered().
+        m_sendChunks.clear();
+        uint32 batchLength = 0;
+        const std::vector<int> *fileDescriptors = nullptr;
+        for (Message &msg : m_sendQueue) {
+            MessagePrivate *const mpriv = MessagePrivate::get(&msg);
+            if (mpriv->m_state != MessagePrivate::Sending) {
+                if (!mpriv->serialize()) {
+                    // Should have been caught before queueing in prepareSend()
+                    if (!m_sendChunks.empty()) {
+                        break;
+                    }
+                    return IO::Status::PayloadError;
+                }
+                mpriv->m_state = MessagePrivate::Sending;
+            }
+            const std::vector<int> &fds = mpriv->m_mainArguments.fileDescriptors();
+            if (mpriv->m_bufferPos == 0 && !fds.empty()) {
+                if (!m_sendChunks.empty()) {
+                    break;
+                }
+                if (fds.size() > m_transport->supportedPassingUnixFdsCount()) {
+                    mpriv->m_error.setCode(Error::SendingTooManyUnixFds);
+                    mpriv->m_state = MessagePrivate::Serialized;
+                    return IO::Status::PayloadError; // the connection is fine, only this message has a problem
+                }
+                fileDescriptors = &fds;
+            }
+            chunk data[2];
+            const uint32 chunkCount = mpriv->unsentData(data);
+            for (uint32 i = 0; i < chunkCount; i++) {
+                m_sendChunks.push_back(data[i]);
+                batchLength += data[i].length;
+            }
+            if (fileDescriptors || m_sendChunks.size() >= MaxBatchedChunks ||
+                batchLength >= MaxBatchedLength) {
+                break;
+            }
+        }
+
+        const IO::Result ioRes = fileDescriptors ?
+            m_transport->writeChunksWithFileDescriptors(m_sendChunks.data(), m_sendChunks.size(),
+                                                        *fileDescriptors) :
+            m_transport->writeChunks(m_sendChunks.data(), m_sendChunks.size());
+        if (ioRes.status != IO::Status::OK) {
+            // handleIoReady() closes the connection, which also takes care of the send queue
+            return IO::Status::RemoteClosed;
+        }
+
+        // Distribute the written length over the messages in order and complete the ones that are done
+        for (uint32 written = ioRes.length; written > 0; ) {
+            assert(!m_sendQueue.empty());
+            MessagePrivate *const mpriv = MessagePrivate::get(&m_sendQueue.front());
+            const uint32 messageLeft = mpriv->serializedLength() - mpriv->m_bufferPos;
+            if (written < messageLeft) {
+                mpriv->m_bufferPos += written;
+                break;
+            }
+            written -= messageLeft;
+            mpriv->m_bufferPos += messageLeft;
+            mpriv->m_state = MessagePrivate::Serialized;
+            mpriv->notifyCompletionListener(); // removes the message from the queue
+        }
+
+        if (ioRes.length < batchLength) {
+            return IO::Status::OK; // the socket can't take more right now
+        }
+    }
+    m_transport->setWriteListener(nullptr);
+    return IO::Status::OK;
+}
+
 PendingReply Connection::send(Message m, int timeoutMsecs)
 {
     if (timeoutMsecs == DefaultTimeout) {
@@ -591,13 +683,18 @@ void Connection::waitForConnectionEstablished()
     }
     // Send the hello message
     assert(!d->m_sendQueue.empty()); // the hello message should be in the queue
-    MessagePrivate *helloPriv = MessagePrivate::get(&d->m_sendQueue.front());
-    helloPriv->handleTransportCanWrite();
+    d->handleTransportCanWrite();
 
     // Receive the hello reply
     while (d->m_state == ConnectionPrivate::AwaitingUniqueName) {
         MessagePrivate::get(d->m_receivingMessage)->handleTransportCanRead();
     }
+    // More messages may have arrived together with the hello reply. They are in the receive buffer now, so
+    // there will be no I/O readiness notification for them - have them processed from the event loop.
+    if (d->m_transport && d->m_transport->bufferedReadLength()) {
+        EventDispatcherPrivate::get(d->m_eventDispatcher)
+            ->queueEvent(std::unique_ptr<Event>(new BufferedDataReceivedEvent));
+    }
 }
 
 ConnectAddress Connection::connectAddress() const
@@ -663,20 +760,19 @@ void ConnectionPrivate::handleCompletion(void *task)
         hello.setSerial(1);
         hello.setExpectsReply(false);
         hello.setDestination(std::string("org.freedesktop.DBus"));
-        MessagePrivate *const helloPriv = MessagePrivate::get(&hello);
 
         m_helloReceiver = new HelloReceiver;
         m_helloReceiver->m_helloReply = m_connection->send(std::move(hello));
-        // Small hack: Connection::send() refuses to really start sending if the connection isn't in
-        // Connected state. So force the sending here to actually get to Connected state.
-        helloPriv->send(m_transport);
-        // Also ensure that the hello message is sent before any other messages that may have been
+        // Ensure that the hello message is sent before any other messages that may have been
         // already enqueued by an API client
         if (m_sendQueue.size() > 1) {
             hello = std::move(m_sendQueue.back());
             m_sendQueue.pop_back();
             m_sendQueue.push_front(std::move(hello));
         }
+        // Small hack: Connection::send() refuses to really start sending if the connection isn't in
+        // Connected state. So force the sending here to actually get to Connected state.
+        m_transport->setWriteListener(this);
         m_helloReceiver->m_helloReply.setReceiver(m_helloReceiver);
         // get ready to receive the first message, the hello reply
         receiveNextMessage();
@@ -694,10 +790,7 @@ void ConnectionPrivate::handleCompletion(void *task)
                 }
                 // TODO else also close the connection? (maybe depending on which error it is)
             }
-            m_sendQueue.pop_front();
-            if (!m_sendQueue.empty()) {
-                MessagePrivate::get(&m_sendQueue.front())->send(m_transport);
-            }
+            m_sendQueue.pop_front(); // handleTransportCanWrite() continues with the next message, if any
         } else {
             assert(task == m_receivingMessage);
             Message *const receivedMessage = m_receivingMessage;
@@ -802,12 +895,24 @@ bool ConnectionPrivate::maybeDispatchToPendingReply(uint32 serial, Error error)
 
 void ConnectionPrivate::receiveNextMessage()
 {
-    m_receivingMessage = new Message;
+    m_receivingMessage = m_messagePool ? MessagePrivate::createPooled(m_messagePool) : new Message;
     MessagePrivate *const mpriv = MessagePrivate::get(m_receivingMessage);
     mpriv->setCompletionListener(this);
+    mpriv->m_validationLevel = m_validationLevel;
+    if (m_streamingBodyThreshold) {
+        mpriv->setReceiveProgressListener(&m_receiveProgressListener, m_streamingBodyThreshold);
+    }
     mpriv->receive(m_transport);
 }
 
+void ConnectionPrivate::handleReceiveProgress(Message *message)
+{
+    assert(message == m_receivingMessage);
+    if (m_client && m_state == Connected) {
+        m_client->handleMessageDataReceived(*message, m_connection);
+    }
+}
+
 void ConnectionPrivate::unregisterPendingReply(PendingReplyPrivate *p)
 {
     if (m_mainThreadConnection) {
@@ -952,6 +1057,11 @@ void ConnectionPrivate::processEvent(Event *evt)
             ConnectionStateChanger stateChanger(this, Connected);
         }
         break;
+    case Event::BufferedDataReceived:
+        if (m_receivingMessage && m_transport && m_transport->bufferedReadLength()) {
+            handleIoReady(IO::RW::Read);
+        }
+        break;
     }
 }
 
@@ -974,3 +1084,56 @@ uint32 Connection::supportedFileDescriptorsPerMessage() const
     return (d->m_transport && d->m_unixFdPassingEnabled) ?
                 d->m_transport->supportedPassingUnixFdsCount() : 0;
 }
+
+void Connection::setMessagePoolSize(uint32 maxCachedBytes)
+{
+    if (!maxCachedBytes) {
+        // messages still using the pool keep it alive as long as necessary
+        d->m_messagePool.reset();
+    } else if (d->m_messagePool) {
+        d->m_messagePool->setMaxCachedBytes(maxCachedBytes);
+    } else {
+        d->m_messagePool = std::make_shared<MessagePool>(maxCachedBytes);
+    }
+}
+
+uint32 Connection::messagePoolSize() const
+{
+    return d->m_messagePool ? d->m_messagePool->maxCachedBytes() : 0;
+}
+
+void Connection::setStreamingBodyThreshold(uint32 minBodyLength)
+{
+    // takes effect with the next message because the current one may already be partially processed
+    d->m_streamingBodyThreshold = minBodyLength;
+}
+
+uint32 Connection::streamingBodyThreshold() const
+{
+    return d->m_streamingBodyThreshold;
+}
+
+void Connection::setValidationLevel(Arguments::ValidationLevel level)
+{
+    // like setStreamingBodyThreshold(), takes effect with the next message
+    d->m_validationLevel = level;
+}
+
+Arguments::ValidationLevel Connection::validationLevel() const
+{
+    return d->m_validationLevel;
+}
+
+Connection::MessagePoolStatistics Connection::messagePoolStatistics() const
+{
+    MessagePoolStatistics ret = { 0, 0, 0, 0, 0 };
+    if (d->m_messagePool) {
+        const MessagePool::Statistics stats = d->m_messagePool->statistics();
+        ret.messageHits = stats.messageHits;
+        ret.messageMisses = stats.messageMisses;
+        ret.bufferHits = stats.bufferHits;
+        ret.bufferMisses = stats.bufferMisses;
+        ret.cachedBytes = stats.cachedBytes;
+    }
+    return ret;
+}
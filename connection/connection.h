@@ -24,6 +24,7 @@
 #ifndef CONNECTION_H
 #define CONNECTION_H
 
+#include "arguments.h"
 #include "commutex.h"
 #include "types.h"
 
@@ -85,6 +86,34 @@ public:
 
     uint32 supportedFileDescriptorsPerMessage() const;
 
+    // Received messages and their buffers are recycled through a pool to avoid memory allocator churn.
+    // Memory is returned to the pool when the messages are destroyed, in any thread. The pool keeps up
+    // to maxCachedBytes of unused memory, a value of 0 disables it.
+    void setMessagePoolSize(uint32 maxCachedBytes);
+    uint32 messagePoolSize() const;
+    struct MessagePoolStatistics
+    {
+        uint64 messageHits;
+        uint64 messageMisses;
+        uint64 bufferHits;
+        uint64 bufferMisses;
+        uint32 cachedBytes;
+    };
+    MessagePoolStatistics messagePoolStatistics() const;
+
+    // While a message with a body of at least minBodyLength bytes is arriving, the receiver's
+    // IMessageReceiver::handleMessageDataReceived() is called whenever more of the body has arrived, so that
+    // a Reader in streaming mode can decode it while the rest is still in transit. 0, the default, disables
+    // notifications.
+    void setStreamingBodyThreshold(uint32 minBodyLength);
+    uint32 streamingBodyThreshold() const;
+
+    // How thoroughly the headers and the Arguments of received messages are checked, see
+    // Arguments::ValidationLevel. The default is FullValidation. Only lower it if the peer is trusted to
+    // send well-formed data, e.g. a peer-to-peer connection to a process of the same application.
+    void setValidationLevel(Arguments::ValidationLevel level);
+    Arguments::ValidationLevel validationLevel() const;
+
     void setDefaultReplyTimeout(int msecs);
     int defaultReplyTimeout() const;
     enum TimeoutSpecialValues {
@@ -30,9 +30,13 @@
 #include "eventdispatcher_p.h"
 #include "icompletionlistener.h"
 #include "iioeventforwarder.h"
+#include "itransportlistener.h"
+#include "messagepool.h"
 #include "spinlock.h"
+#include "types.h"
 
 #include <deque>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -79,8 +83,9 @@ class ClientConnectedHandler;
 class ConnectionStateChanger;
 
 // This class sits between EventDispatcher and ITransport for I/O event forwarding purposes,
-// which is why it is both a listener (for EventDispatcher) and a source (mainly for ITransport)
-class ConnectionPrivate : public IIoEventForwarder, public ICompletionListener
+// which is why it is both a listener (for EventDispatcher) and a source (mainly for ITransport).
+// It is also the write listener of its transport, in order to send queued messages in batches.
+class ConnectionPrivate : public IIoEventForwarder, public ICompletionListener, public ITransportListener
 {
 public:
     enum State {
@@ -99,6 +104,9 @@ public:
     // from IIOEventForwarder
     IO::Status handleIoReady(IO::RW rw) override;
 
+    // from ITransportListener - writes as many queued messages as possible with one syscall
+    IO::Status handleTransportCanWrite() override;
+
     void startAuthentication();
     void handleHelloReply();
     void handleHelloFailed();
@@ -116,6 +124,7 @@ public:
     bool maybeDispatchToPendingReply(Message *m);
     bool maybeDispatchToPendingReply(uint32 serial, Error error);
     void receiveNextMessage();
+    void handleReceiveProgress(Message *message); // see Connection::setStreamingBodyThreshold()
 
     void unregisterPendingReply(PendingReplyPrivate *p);
     void cancelAllPendingReplies(Error withError);
@@ -134,7 +143,14 @@ public:
     IConnectionStateListener *m_connectionStateListener = nullptr;
 
     Message *m_receivingMessage = nullptr;
+    std::shared_ptr<MessagePool> m_messagePool = std::make_shared<MessagePool>(); // null if disabled
+    uint32 m_streamingBodyThreshold = 0; // 0 if disabled
+    Arguments::ValidationLevel m_validationLevel = Arguments::FullValidation;
+    CompletionFunc m_receiveProgressListener = CompletionFunc([this](void *task) {
+        handleReceiveProgress(static_cast<Message *>(task));
+    });
     std::deque<Message> m_sendQueue; // waiting to be sent
+    std::vector<chunk> m_sendChunks; // for handleTransportCanWrite(), kept around to avoid reallocations
 
     // only one of them can be non-null. exception: in the main thread, m_mainThreadConnection
     // equals this, so that the main thread knows it's the main thread and not just a thread-local
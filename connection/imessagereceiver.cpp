@@ -39,3 +39,7 @@ void IMessageReceiver::handlePendingReplyFinished(PendingReply * /* pendingReply
     // if we get here that might be bad! but it also might not be under special circumstances, so
     // don't complain.
 }
+
+void IMessageReceiver::handleMessageDataReceived(const Message & /* message */, Connection *)
+{
+}
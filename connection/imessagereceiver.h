@@ -42,6 +42,13 @@ public:
     // The default implementation does nothing since somebody must still have the PendingReply, so the
     // Message is still reachable. That's a somewhat strange but valid situation.
     virtual void handlePendingReplyFinished(PendingReply *pendingReply, Connection *connection);
+    // Called while a large message is still arriving, see Connection::setStreamingBodyThreshold().
+    // message.arguments() contains the part of the body received so far. To decode it early, attach a
+    // Reader in streaming mode at the first call and call Reader::replaceData() with the new
+    // message.arguments().data() at each subsequent call. The complete message is delivered as usual
+    // afterwards, through one of the methods above; the Reader stays attached to it, so it can finish
+    // after one more replaceData(). Don't close the connection from here.
+    virtual void handleMessageDataReceived(const Message &message, Connection *connection);
 };
 
 #endif // IMESSAGERECEIVER_H
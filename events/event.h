@@ -22,7 +22,8 @@ struct Event
         MainConnectionDisconnect,
         SecondaryConnectionConnect,
         SecondaryConnectionDisconnect,
-        UniqueNameReceived
+        UniqueNameReceived,
+        BufferedDataReceived
     };
 
     Event(Type t) : type(t) {}
@@ -94,4 +95,9 @@ struct UniqueNameReceivedEvent : public Event
     std::string uniqueName;
 };
 
+struct BufferedDataReceivedEvent : public Event
+{
+    BufferedDataReceivedEvent() : Event(Event::BufferedDataReceived) {}
+};
+
 #endif // EVENT_H
@@ -29,7 +29,9 @@
 #include "malloccache.h"
 #include "message.h"
 #include "platform.h"
+#include "signatureprogram.h"
 #include "stringtools.h"
+#include "validationkernels.h"
 
 #include <algorithm>
 #include <cassert>
@@ -127,6 +129,14 @@ cstring printableState(Arguments::IoState state)
     return cstring(strings[state]);
 }
 
+// static
+bool Arguments::fixedStructLayout(cstring structSignature, FixedStructLayout *layout)
+{
+    const std::shared_ptr<const SignatureProgram> program = SignatureProgram::get(structSignature,
+                                                                                  VariantSignature);
+    return program && program->fixedStructLayout(0, layout);
+}
+
 // When using this to iterate over the reader, it will make an exact copy using the Writer.
 // You need to do something only in states where something special should happen.
 // To check errors, "simply" (sorry!) check the reader->state() and writer()->state().
@@ -150,7 +160,7 @@ void Arguments::copyOneElement(Arguments::Reader *reader, Arguments::Writer *wri
         break;
     case Arguments::BeginVariant:
         reader->beginVariant();
-        writer->beginVariant();
+        writer->beginVariant(reader->currentSignature());
         break;
     case Arguments::EndVariant:
         reader->endVariant();
@@ -262,6 +272,7 @@ Arguments::Private &Arguments::Private::operator=(const Private &other)
 void Arguments::Private::initFrom(const Private &other)
 {
     m_isByteSwapped = other.m_isByteSwapped;
+    m_validationLevel = other.m_validationLevel;
 
     // make a deep copy
     // use only one malloced block for signature and main data - this saves one malloc and free
@@ -399,6 +410,16 @@ bool Arguments::isByteSwapped() const
     return d->m_isByteSwapped;
 }
 
+void Arguments::setValidationLevel(ValidationLevel level)
+{
+    d->m_validationLevel = level;
+}
+
+Arguments::ValidationLevel Arguments::validationLevel() const
+{
+    return d->m_validationLevel;
+}
+
 static void printMaybeNilProlog(std::stringstream *out, const std::string &nestingPrefix, bool isNil,
                                 const char *typeName)
 {
@@ -605,8 +626,8 @@ bool Arguments::isStringValid(cstring string)
     if (!string.ptr || string.length + 1 >= MaxArrayLength || string.ptr[string.length] != 0) {
         return false;
     }
-    // check that there are no embedded nulls, exploiting the highly optimized strlen...
-    return strlen(string.ptr) == string.length;
+    // no embedded nulls, and valid UTF-8 as required by the spec
+    return validation::isUtf8WithoutNul(reinterpret_cast<const byte *>(string.ptr), string.length);
 }
 
 static inline bool isObjectNameLetter(char c)
@@ -620,27 +641,14 @@ bool Arguments::isObjectPathValid(cstring path)
     if (!path.ptr || path.length + 1 >= MaxArrayLength || path.ptr[path.length] != 0) {
         return false;
     }
-    char prevLetter = path.ptr[0];
-    if (prevLetter != '/') {
+    if (path.ptr[0] != '/') {
         return false;
     }
     if (path.length == 1) {
         return true; // "/" special case
     }
-    for (uint32 i = 1; i < path.length; i++) {
-        char currentLetter = path.ptr[i];
-        if (prevLetter == '/') {
-            if (!isObjectNameLetter(currentLetter)) {
-                return false;
-            }
-        } else {
-            if (currentLetter != '/' && !isObjectNameLetter(currentLetter)) {
-                return false;
-            }
-        }
-        prevLetter = currentLetter;
-    }
-    return prevLetter != '/';
+    return path.ptr[path.length - 1] != '/' &&
+           validation::isObjectPathCharacters(reinterpret_cast<const byte *>(path.ptr), path.length);
 }
 
 // static
@@ -719,10 +727,14 @@ bool parseSingleCompleteType(cstring *s, Nesting *nest)
         }
         chopFirst(s);
         bool isEmptyStruct = true;
-        while (parseSingleCompleteType(s, nest)) {
+        // a member that fails to parse must not be mistaken for the end of the struct, e.g. in "(a{sv)"
+        while (s->length && *s->ptr != ')') {
+            if (!parseSingleCompleteType(s, nest)) {
+                return false;
+            }
             isEmptyStruct = false;
         }
-        if (!s->length || *s->ptr != ')' || isEmptyStruct) {
+        if (!s->length || isEmptyStruct) {
             return false;
         }
         chopFirst(s);
@@ -765,12 +777,24 @@ bool parseSingleCompleteType(cstring *s, Nesting *nest)
 
 //static
 bool Arguments::isSignatureValid(cstring signature, SignatureType type)
+{
+    // programs are only created for valid signatures, and most signatures are seen many times
+    return bool(SignatureProgram::get(signature, type));
+}
+
+//static
+Arguments::SignatureCacheStatistics Arguments::signatureCacheStatistics()
+{
+    return SignatureProgram::cacheStatistics();
+}
+
+bool isSignatureValidUncached(cstring signature, Arguments::SignatureType type)
 {
     Nesting nest;
     if (!signature.ptr || signature.ptr[signature.length] != 0) {
         return false;
     }
-    if (type == VariantSignature) {
+    if (type == Arguments::VariantSignature) {
         if (!signature.length) {
             return false;
         }
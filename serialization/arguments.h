@@ -49,6 +49,18 @@ public:
         VariantSignature
     };
 
+    // How thoroughly a Reader checks the data. Reading is memory-safe at every level: lengths, nesting,
+    // signatures (including those of variants, which determine how to parse) and the null termination of
+    // strings are always checked.
+    enum ValidationLevel
+    {
+        FullValidation = 0,
+        // Don't check the contents of strings, object paths and signature values - the most expensive part
+        StructuralValidation,
+        // Also don't check that padding is zero and that booleans are 0 or 1
+        TrustedData
+    };
+
     enum
     {
         MaxSignatureLength = 255,
@@ -66,7 +78,8 @@ public:
         // "exceptional" states
         NotStarted = 0,
         Finished,
-        NeedMoreData, // recoverable by adding data; should only happen when parsing the not length-prefixed variable message header
+        NeedMoreData, // recoverable by adding data; happens when parsing the not length-prefixed variable
+                      // message header and in streaming mode of Reader
         InvalidData, // non-recoverable
         // Writer states when the next type is still open (not iterating in an array or dict)
         // ### it is inconsistent to have DictKey, but nothing for other constraints. The name AnyData is
@@ -146,14 +159,65 @@ public:
     chunk data() const;
     const std::vector<int> &fileDescriptors() const;
     bool isByteSwapped() const;
+    // Readers use the level of their Arguments at construction time; the default is FullValidation
+    void setValidationLevel(ValidationLevel level);
+    ValidationLevel validationLevel() const;
 
     static bool isStringValid(cstring string);
     static bool isObjectPathValid(cstring objectPath);
     static bool isObjectPathElementValid(cstring pathElement);
     static bool isSignatureValid(cstring signature, SignatureType type = MethodSignature);
 
+    // Validated signatures are cached per thread, together with what Readers and Writers need to know
+    // about them, in a small cache with least recently used replacement. These are the statistics of
+    // the calling thread's cache. Empty and one-character signatures are handled without the cache and
+    // not counted.
+    struct SignatureCacheStatistics
+    {
+        uint64 hits;
+        uint64 misses; // including lookups of invalid signatures, which are not cached
+    };
+    static SignatureCacheStatistics signatureCacheStatistics();
+
     static void copyOneElement(Reader *reader, Writer *writer);
 
+    // The memory layout of a struct that contains only fixed-size types, except booleans and Unix file
+    // descriptors (which need validation). Arrays of such structs can be read and written in bulk, see
+    // Reader::readFixedStructArray() and Writer::writeFixedStructArray().
+    struct FixedStructLayout
+    {
+        struct Field
+        {
+            IoState type;
+            uint32 offset;
+            uint32 size;
+        };
+        std::vector<Field> fields; // all fields, including those of nested structs, in order
+        uint32 size; // of the data of one struct, without trailing alignment padding
+        uint32 stride; // distance between structs in an array, i.e. size aligned to 8 bytes
+
+        // for array data as returned by readFixedStructArray()
+        uint32 elementCount(uint32 dataLength) const { return (dataLength + stride - 1) / stride; }
+    };
+    // Returns false if @p structSignature is not a struct suitable for bulk reading and writing
+    static bool fixedStructLayout(cstring structSignature, FixedStructLayout *layout);
+
+    // The values of one member of the structs in an array of structs, in order, as read by
+    // Reader::readStructArrayColumns()
+    struct Column
+    {
+        IoState type;
+        uint32 count;
+        // For Boolean and numeric types: count values of the corresponding type, e.g. bool for Boolean and
+        // uint32 for Uint32, in host byte order. Access them with values().
+        std::vector<byte> data;
+        // For String, ObjectPath and Signature: count strings pointing into the data, as from readString()
+        std::vector<cstring> strings;
+
+        template<typename T>
+        const T *values() const { return reinterpret_cast<const T *>(data.data()); }
+    };
+
 private:
     struct podCstring // Same as cstring but without ctor.
                       // Can't put the cstring type into a union because it has a constructor :/
@@ -177,6 +241,34 @@ private:
     } DataUnion;
 
 public:
+    // Positions of the top-level arguments, and of the values in top-level dicts by key, for random access
+    // with Reader::seekToArgument() and Reader::seekToDictValue(). It is built in one pass over the data
+    // that skips over arrays (except the entries of top-level dicts) without looking inside, and costs
+    // about as much as two passes with a Reader - it pays off when the same Arguments are accessed several
+    // times. Because of the skipping, the data is only partially validated; reading after a seek can still
+    // fail. Dicts with double or Unix file descriptor keys are not indexed by key.
+    // The index refers to the data of the Arguments, so it can't be used after the Arguments is gone.
+    class DFERRY_EXPORT Index
+    {
+    public:
+        explicit Index(const Arguments &arguments);
+        Index(Index &&other);
+        Index &operator=(Index &&other);
+        Index(const Index &other);
+        Index &operator=(const Index &other);
+        ~Index();
+
+        // MalformedMessageData etc. if the data was found to be invalid while building the index, and then
+        // there are no arguments to seek to. NoError does not guarantee that all of the data is valid.
+        Error error() const;
+        uint32 argumentCount() const;
+
+        class Private;
+    private:
+        friend class Reader;
+        Private *d;
+    };
+
     // error handling is done by asking state() or isError(), not by method return values.
     // occasionally looking at isError() is less work than checking every call.
     class DFERRY_EXPORT Reader
@@ -201,9 +293,18 @@ public:
         cstring currentSignature() const; // current signature, either main signature or current variant
         uint32 currentSignaturePosition() const;
         cstring currentSingleCompleteTypeSignature() const;
-        // HACK call this in NeedMoreData state when more data has been added; this replaces m_data
+        // Call this in NeedMoreData state when more data has been added; this replaces m_data. The new
+        // data must start with the old data.
         // WARNING: calling replaceData() invalidates copies (if any) of this Reader
         void replaceData(chunk data);
+        // In streaming mode, the data does not need to be complete: arrays and dicts can be entered before
+        // all of their data has arrived, and reading stops in NeedMoreData at the end of the available data
+        // until replaceData() adds more. Whole-array operations need the whole array; until it has
+        // arrived, readPrimitiveArray() and readFixedStructArray() decline, peekPrimitiveArray() returns
+        // BeginArray, and skipArray() and skipDict() go to NeedMoreData to try again after replaceData().
+        // Without streaming mode, running out of data inside an array means that the data is invalid.
+        void setStreaming(bool streaming);
+        bool isStreaming() const;
 
         bool isFinished() const { return m_state == Finished; }
         bool isError() const { return m_state == InvalidData || m_state == NeedMoreData; } // TODO remove
@@ -284,6 +385,34 @@ public:
         // instead of the type of primitive.
         Arguments::IoState peekPrimitiveArray(EmptyArrayOption option = SkipIfEmpty) const;
 
+        // Like readPrimitiveArray(), for arrays of structs with a fixed layout as described in
+        // FixedStructLayout. The first return value is BeginStruct if successful, and then @p layout
+        // describes the array data in the second return value: structs are layout->stride bytes apart
+        // and the last one has no padding at the end. Returns InvalidData and leaves the Reader
+        // unchanged if the array is not suitable, which includes byte-swapped arrays unless they
+        // contain only bytes.
+        std::pair<Arguments::IoState, chunk> readFixedStructArray(FixedStructLayout *layout);
+        // In state BeginArray, reads a whole array of structs with only basic type members (except Unix file
+        // descriptors), e.g. "a(sut)", into one Column per member, and leaves the array. That is equivalent
+        // to reading all the values one by one, but much faster. The vectors in @p columns keep their
+        // capacity, so reusing @p columns avoids allocations. Returns false and leaves the Reader unchanged
+        // if the array is not suitable or its data is not valid (then regular reading will find the error),
+        // and in that case the contents of @p columns are unspecified.
+        bool readStructArrayColumns(std::vector<Column> *columns);
+
+        // Random access using @p index, which must have been built from the Arguments this Reader reads.
+        // Moves to the start of top-level argument @p argument, from anywhere, as if all arguments before
+        // it had been skipped. Returns false and leaves the Reader unchanged if there is no such argument.
+        bool seekToArgument(const Index &index, uint32 argument);
+        // Moves to the value of the first entry with key @p key in the dict that is top-level argument
+        // @p argument. The Reader is then inside the dict, as if all the entries before had been read, so
+        // reading can continue with the following entries and endDict(). Returns false and leaves the
+        // Reader unchanged if the argument is not a dict with keys of a matching type, or if there is no
+        // such key. The first overload is for string, object path and signature keys, the second for
+        // integer and boolean keys; unsigned 64-bit keys are compared as if converted to int64.
+        bool seekToDictValue(const Index &index, uint32 argument, cstring key);
+        bool seekToDictValue(const Index &index, uint32 argument, int64 key);
+
 #ifdef WITH_DICT_ENTRY
         void beginDictEntry();
         void endDictEntry();
@@ -293,6 +422,7 @@ public:
         friend class Private;
 
     private:
+        friend class Index;
         void beginRead();
         void doReadPrimitiveType();
         void doReadString(uint32 lengthPrefixSize);
@@ -300,6 +430,7 @@ public:
         void beginArrayOrDict(bool isDict, EmptyArrayOption option);
         void skipArrayOrDictSignature(bool isDict);
         void skipArrayOrDict(bool isDict);
+        bool isArrayComplete() const;
 
         Private *d;
 
@@ -315,6 +446,10 @@ public:
     {
     public:
         explicit Writer();
+        // Writes into @p buffer, which must stay valid while the Writer uses it, and moves to a heap
+        // buffer only if it is too small. finish() copies the result out of the buffer, so the buffer
+        // can be reused after reset(). An unaligned or very small buffer is ignored.
+        explicit Writer(chunk buffer);
         Writer(Writer &&other);
         void operator=(Writer &&other);
         // TODO unit-test copy and assignment
@@ -327,6 +462,9 @@ public:
         // error propagates to Arguments (if the error wasn't that the Arguments is not writable),
         // so it is still available later
         Error error() const; // see also: aggregateStack()
+        // Discards everything written and prepares for writing new arguments, without freeing the data
+        // buffer. The buffer of a Writer without caller-provided buffer is given away in finish(), though.
+        void reset();
 
         IoState state() const { return m_state; }
         cstring stateString() const;
@@ -351,6 +489,10 @@ public:
         void endStruct();
 
         void beginVariant();
+        // Like beginVariant(), but the contents must be of the single complete type @p signature
+        // (null-terminated). Faster because the data does not need to be moved after the variant is
+        // finished. An empty signature is the same as calling beginVariant().
+        void beginVariant(cstring signature);
         void endVariant();
 
         Arguments finish();
@@ -374,6 +516,23 @@ public:
         void writeUnixFd(int32 fd);
 
         void writePrimitiveArray(IoState type, chunk data);
+        // Writes an array of structs with signature @p structSignature and a fixed layout as described in
+        // FixedStructLayout, e.g. "(tdd)". @p data contains the structs laid out as in the description,
+        // stride bytes apart. The last struct may or may not be followed by padding in @p data.
+        // Alignment padding in the data is ignored and written as zeros.
+        void writeFixedStructArray(cstring structSignature, chunk data);
+
+        // Fast path for writing values of a type known in advance, mainly for writeTyped() in
+        // typedarguments.h. rawDataPosition() returns false if the fast path is not available in the
+        // current state (inside a variant, an empty array or a dict, or after an error) - use the
+        // regular API then. Otherwise it returns the data position where the next value starts.
+        // writeRawValue() checks @p signature, which must be one single complete type, like the regular
+        // API would, and returns a buffer with room up to @p endPosition, or nullptr on error. Types that
+        // contain Unix file descriptors ('h') are rejected with InvalidType, write those with writeUnixFd().
+        // The caller must then write the value's data, including alignment padding (relative to the
+        // start of the buffer), from the position returned by rawDataPosition() up to endPosition.
+        bool rawDataPosition(uint32 *dataPosition) const;
+        byte *writeRawValue(cstring signature, uint32 endPosition);
 
         // Return the current serialized data; if the current state of writing has any aggregates open
         // OR is in an error state, return an empty chunk (instead of invalid serialized data).
@@ -394,12 +553,6 @@ public:
         friend class Private;
 
     private:
-        friend class MessagePrivate;
-        void writeVariantForMessageHeader(char sig); // faster variant for typical message headers;
-        // does not work for nested variants which aren't needed for message headers. Also does not
-        // change the aggregate stack, but Message knows how to handle it.
-        void fixupAfterWriteVariantForMessageHeader();
-
         void doWritePrimitiveType(IoState type, uint32 alignAndSize);
         void doWriteString(IoState type, uint32 lengthPrefixSize);
         void advanceState(cstring signatureFragment, IoState newState);
@@ -33,6 +33,7 @@ class Arguments::Private
 public:
     Private()
        : m_isByteSwapped(false),
+         m_validationLevel(FullValidation),
          m_memOwnership(nullptr)
     {}
 
@@ -45,6 +46,7 @@ public:
 
     chunk m_data;
     bool m_isByteSwapped;
+    ValidationLevel m_validationLevel;
     byte *m_memOwnership;
     cstring m_signature;
     std::vector<int> m_fileDescriptors;
@@ -83,6 +85,8 @@ struct Nesting
 
 cstring printableState(Arguments::IoState state);
 bool parseSingleCompleteType(cstring *s, Nesting *nest);
+// Arguments::isSignatureValid() without the cache in SignatureProgram::get()
+bool isSignatureValidUncached(cstring signature, Arguments::SignatureType type);
 
 inline bool isAligned(uint32 value, uint32 alignment)
 {
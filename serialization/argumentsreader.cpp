@@ -29,8 +29,11 @@
 #include "malloccache.h"
 #include "message.h"
 #include "platform.h"
+#include "signatureprogram.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 
 #ifdef HAVE_BOOST
 #include <boost/container/small_vector.hpp>
@@ -44,18 +47,66 @@ public:
        : m_args(nullptr),
          m_signaturePosition(uint32(-1)),
          m_dataPosition(0),
-         m_nilArrayNesting(0)
+         m_nilArrayNesting(0),
+         m_isStreaming(false),
+         m_validationLevel(FullValidation),
+         m_arrayHeaderPosition(0),
+         m_argumentDataStart(0),
+         m_instructions(nullptr)
     {}
 
+    void setProgram(std::shared_ptr<const SignatureProgram> program)
+    {
+        m_instructions = program ? program->instructions() : nullptr;
+        m_programs.push_back(std::move(program));
+    }
+
+    void restorePreviousProgram()
+    {
+        m_programs.pop_back();
+        m_instructions = m_programs.back() ? m_programs.back()->instructions() : nullptr;
+    }
+
+    // leave all aggregates, for seeking to a top-level position
+    void resetToTopLevel()
+    {
+        while (m_programs.size() > 1) {
+            restorePreviousProgram();
+        }
+        m_signature = m_args->d->m_signature;
+        m_aggregateStack.clear();
+        m_nesting = Nesting();
+        m_nilArrayNesting = 0;
+        m_variantProgram.reset();
+    }
+
     const Arguments *m_args;
     cstring m_signature;
     uint32 m_signaturePosition;
     chunk m_data;
     uint32 m_dataPosition;
     uint32 m_nilArrayNesting; // this keeps track of how many nil arrays we are in
+    bool m_isStreaming;
+    ValidationLevel m_validationLevel; // of m_args at construction
+    // data position before the length of the array in BeginArray / BeginDict state, for rewinding in
+    // skipArrayOrDict() when the array is incomplete in streaming mode
+    uint32 m_arrayHeaderPosition;
+    // data position before the padding of the current top-level argument, for Index
+    uint32 m_argumentDataStart;
     Error m_error;
     Nesting m_nesting;
 
+    // The compiled programs of the main signature and of the signatures of the variants we are in.
+    // m_instructions is a shortcut to the instructions of the program for m_signature.
+#ifdef HAVE_BOOST
+    boost::container::small_vector<std::shared_ptr<const SignatureProgram>, 4> m_programs;
+#else
+    std::vector<std::shared_ptr<const SignatureProgram>> m_programs;
+#endif
+    const SignatureProgram::Instruction *m_instructions;
+    // the program of the variant signature read in advanceState(), until beginVariant() switches to it
+    std::shared_ptr<const SignatureProgram> m_variantProgram;
+
     struct ArrayInfo
     {
         uint32 dataEnd; // one past the last data byte of the array
@@ -168,9 +219,13 @@ void Arguments::Reader::beginRead()
     VALID_IF(d->m_args, Error::NotAttachedToArguments);
     d->m_signature = d->m_args->d->m_signature;
     d->m_data = d->m_args->d->m_data;
+    d->m_validationLevel = d->m_args->d->m_validationLevel;
     // as a slightly hacky optimizaton, we allow empty Argumentss to allocate no space for d->m_buffer.
     if (d->m_signature.length) {
-        VALID_IF(Arguments::isSignatureValid(d->m_signature), Error::InvalidSignature);
+        std::shared_ptr<const SignatureProgram> program = SignatureProgram::get(d->m_signature,
+                                                                                MethodSignature);
+        VALID_IF(program, Error::InvalidSignature);
+        d->setProgram(std::move(program));
     }
     advanceState();
 }
@@ -207,16 +262,17 @@ uint32 Arguments::Reader::currentSignaturePosition() const
 
 cstring Arguments::Reader::currentSingleCompleteTypeSignature() const
 {
-    const uint32 startingLength = d->m_signature.length - d->m_signaturePosition;
-    cstring sigCopy = { d->m_signature.ptr + d->m_signaturePosition, startingLength };
-    Nesting nest;
-    if (!parseSingleCompleteType(&sigCopy, &nest)) {
-        // the signature should have been validated before, but e.g. in Finished state this may happen
+    // e.g. in Finished state, there is no current type
+    if (d->m_signaturePosition >= d->m_signature.length) {
+        return cstring();
+    }
+    const SignatureProgram::Instruction &instruction = d->m_instructions[d->m_signaturePosition];
+    const IoState type = instruction.type.state();
+    if (type == EndStruct || type == BeginDict || type == EndDict) {
         return cstring();
     }
-    sigCopy.ptr = d->m_signature.ptr + d->m_signaturePosition;
-    sigCopy.length = startingLength - sigCopy.length;
-    return sigCopy;
+    return cstring(d->m_signature.ptr + d->m_signaturePosition,
+                   instruction.end + 1 - d->m_signaturePosition);
 }
 
 void Arguments::Reader::replaceData(chunk data)
@@ -247,13 +303,33 @@ void Arguments::Reader::replaceData(chunk data)
     }
 }
 
+void Arguments::Reader::setStreaming(bool streaming)
+{
+    d->m_isStreaming = streaming;
+    // the constructor may have stopped at an array that can now be entered
+    if (streaming && m_state == NeedMoreData) {
+        advanceState();
+    }
+}
+
+bool Arguments::Reader::isStreaming() const
+{
+    return d->m_isStreaming;
+}
+
+bool Arguments::Reader::isArrayComplete() const
+{
+    // m_u.Uint32 is the future ArrayInfo::dataEnd in BeginArray and BeginDict states
+    return m_u.Uint32 <= d->m_data.length;
+}
+
 void Arguments::Reader::doReadPrimitiveType()
 {
     switch(m_state) {
     case Boolean: {
         uint32 num = basic::readUint32(d->m_data.ptr + d->m_dataPosition, d->m_args->d->m_isByteSwapped);
         m_u.Boolean = num == 1;
-        VALID_IF(num <= 1, Error::MalformedMessageData);
+        VALID_IF(num <= 1 || d->m_validationLevel == TrustedData, Error::MalformedMessageData);
         break; }
     case Byte:
         m_u.Byte = d->m_data.ptr[d->m_dataPosition];
@@ -300,9 +376,10 @@ void Arguments::Reader::doReadString(uint32 lengthPrefixSize)
     if (lengthPrefixSize == 1) {
         stringLength += d->m_data.ptr[d->m_dataPosition];
     } else {
-        stringLength += basic::readUint32(d->m_data.ptr + d->m_dataPosition,
-                                          d->m_args->d->m_isByteSwapped);
-        VALID_IF(stringLength + 1 < Arguments::MaxArrayLength, Error::MalformedMessageData);
+        const uint32 length = basic::readUint32(d->m_data.ptr + d->m_dataPosition, d->m_args->d->m_isByteSwapped);
+        // like stringLength + 1 < MaxArrayLength, but without overflow
+        VALID_IF(length < Arguments::MaxArrayLength - 2, Error::MalformedMessageData);
+        stringLength += length;
     }
     d->m_dataPosition += lengthPrefixSize;
     if (unlikely(d->m_dataPosition + stringLength > d->m_data.length)) {
@@ -313,7 +390,10 @@ void Arguments::Reader::doReadString(uint32 lengthPrefixSize)
     m_u.String.length = stringLength - 1; // terminating null is not counted
     d->m_dataPosition += stringLength;
     bool isValidString = false;
-    if (m_state == String) {
+    if (d->m_validationLevel != FullValidation) {
+        // the null termination is part of memory safety for users of the string
+        isValidString = m_u.String.ptr[m_u.String.length] == '\0';
+    } else if (m_state == String) {
         isValidString = Arguments::isStringValid(cstring(m_u.String.ptr, m_u.String.length));
     } else if (m_state == ObjectPath) {
         isValidString = Arguments::isObjectPathValid(cstring(m_u.String.ptr, m_u.String.length));
@@ -353,6 +433,7 @@ void Arguments::Reader::advanceState()
             m_state = Finished;
             return;
         }
+        d->m_argumentDataStart = savedDataPosition;
     } else {
         const Private::AggregateInfo &aggregateInfo = d->m_aggregateStack.back();
         switch (aggregateInfo.aggregateType) {
@@ -411,7 +492,7 @@ void Arguments::Reader::advanceState()
 
     // for aggregate types, ty.alignment is just the alignment.
     // for primitive types, it's also the actual size.
-    const TypeInfo ty = typeInfo(d->m_signature.ptr[d->m_signaturePosition]);
+    const TypeInfo ty = d->m_instructions[d->m_signaturePosition].type;
     m_state = ty.state();
 
     VALID_IF(m_state != InvalidData, Error::MalformedMessageData);
@@ -425,7 +506,8 @@ void Arguments::Reader::advanceState()
         if (unlikely(d->m_dataPosition > d->m_data.length)) {
             goto out_needMoreData;
         }
-        VALID_IF(isPaddingZero(d->m_data, padStart, d->m_dataPosition), Error::MalformedMessageData);
+        VALID_IF(d->m_validationLevel == TrustedData || isPaddingZero(d->m_data, padStart, d->m_dataPosition),
+                 Error::MalformedMessageData);
 
         if (ty.isPrimitive || ty.isString) {
             if (unlikely(d->m_dataPosition + ty.alignment > d->m_data.length)) {
@@ -466,6 +548,7 @@ void Arguments::Reader::advanceState()
         if (unlikely(d->m_nilArrayNesting)) {
             static const char *emptyString = "";
             signature = cstring(emptyString, 0);
+            d->m_variantProgram.reset();
         } else {
             if (unlikely(d->m_dataPosition >= d->m_data.length)) {
                 goto out_needMoreData;
@@ -476,8 +559,8 @@ void Arguments::Reader::advanceState()
             if (unlikely(d->m_dataPosition > d->m_data.length)) {
                 goto out_needMoreData;
             }
-            VALID_IF(Arguments::isSignatureValid(signature, Arguments::VariantSignature),
-                     Error::MalformedMessageData);
+            d->m_variantProgram = SignatureProgram::get(signature, Arguments::VariantSignature);
+            VALID_IF(d->m_variantProgram, Error::MalformedMessageData);
         }
         // do not clobber nesting before potentially going to out_needMoreData!
         VALID_IF(d->m_nesting.beginVariant(), Error::MalformedMessageData);
@@ -500,7 +583,8 @@ void Arguments::Reader::advanceState()
             d->m_dataPosition += sizeof(uint32);
         }
 
-        if (d->m_signature.ptr[d->m_signaturePosition + 1] == '{') {
+        const TypeInfo contentType = d->m_instructions[d->m_signaturePosition + 1].type;
+        if (contentType.state() == BeginDict) {
             m_state = BeginDict;
         }
 
@@ -514,15 +598,18 @@ void Arguments::Reader::advanceState()
         // TODO: unit-test this
         if (likely(!d->m_nilArrayNesting)) {
             const uint32 padStart = d->m_dataPosition;
-            const uint32 alignment = m_state == BeginDict ? uint32(StructAlignment) :
-                                     typeInfo(d->m_signature.ptr[d->m_signaturePosition + 1]).alignment;
+            const uint32 alignment = m_state == BeginDict ? uint32(StructAlignment) : contentType.alignment;
             d->m_dataPosition = align(d->m_dataPosition, alignment);
-            VALID_IF(isPaddingZero(d->m_data, padStart, d->m_dataPosition), Error::MalformedMessageData);
+            VALID_IF(d->m_validationLevel == TrustedData ||
+                     isPaddingZero(d->m_data, padStart, d->m_dataPosition), Error::MalformedMessageData);
             dataEnd = d->m_dataPosition + arrayLength;
-            if (unlikely(dataEnd > d->m_data.length)) {
+            // in streaming mode, enter the array as soon as its first element could be there
+            if (unlikely(dataEnd > d->m_data.length) &&
+                (!d->m_isStreaming || d->m_dataPosition > d->m_data.length)) {
                 goto out_needMoreData;
             }
         }
+        d->m_arrayHeaderPosition = savedDataPosition;
 
         VALID_IF(d->m_nesting.beginArray(), Error::MalformedMessageData);
         if (m_state == BeginDict) {
@@ -544,8 +631,17 @@ void Arguments::Reader::advanceState()
 
 out_needMoreData:
     // we only start an array when the data for it has fully arrived (possible due to the length
-    // prefix), so if we still run out of data in an array the input is invalid.
-    VALID_IF(!d->m_nesting.array, Error::MalformedMessageData);
+    // prefix), so if we still run out of data in an array the input is invalid. In streaming mode,
+    // it is only invalid if the innermost array should have fully arrived.
+    if (d->m_nesting.array) {
+        VALID_IF(d->m_isStreaming, Error::MalformedMessageData);
+        for (auto it = d->m_aggregateStack.rbegin(); it != d->m_aggregateStack.rend(); ++it) {
+            if (it->aggregateType == BeginArray || it->aggregateType == BeginDict) {
+                VALID_IF(it->arr.dataEnd > d->m_data.length, Error::MalformedMessageData);
+                break;
+            }
+        }
+    }
     m_state = NeedMoreData;
     d->m_signaturePosition = savedSignaturePosition;
     d->m_dataPosition = savedDataPosition;
@@ -553,32 +649,27 @@ out_needMoreData:
 
 void Arguments::Reader::skipArrayOrDictSignature(bool isDict)
 {
-    // Note that we cannot just pass a dummy Nesting instance to parseSingleCompleteType, it must
-    // actually check the nesting because an array may contain other nested aggregates. So we must
+    // We must still check the nesting because an array may contain other nested aggregates. So we must
     // compensate for the already raised nesting levels from BeginArray handling in advanceState().
     d->m_nesting.endArray();
     if (isDict) {
         d->m_nesting.endParen();
-        // the Reader ad-hoc parsing code moved at ahead by one to skip the '{', but parseSingleCompleteType()
-        // needs to see the full dict signature, so fix it up
+        // the Reader ad-hoc parsing code moved at ahead by one to skip the '{', go back to the 'a'
         d->m_signaturePosition--;
     }
 
-    // parse the full (i.e. starting with the 'a') array (or dict) signature in order to skip it -
-    // barring bugs, must have been too deep nesting inside variants if parsing fails
-    cstring remainingSig(d->m_signature.ptr + d->m_signaturePosition,
-                         d->m_signature.length - d->m_signaturePosition);
-    VALID_IF(parseSingleCompleteType(&remainingSig, &d->m_nesting), Error::MalformedMessageData);
-    d->m_signaturePosition = d->m_signature.length - remainingSig.length;
-
-    // Compensate for pre-increment in advanceState()
-    d->m_signaturePosition--;
+    // jump to the end of the full (i.e. starting with the 'a') array (or dict) signature in order to
+    // skip it - it can't have too deep nesting by itself, but inside variants it can
+    const SignatureProgram::Instruction &instruction = d->m_instructions[d->m_signaturePosition];
+    VALID_IF(instruction.fitsNesting(d->m_nesting), Error::MalformedMessageData);
+    // that is one before the next type, compensating for pre-increment in advanceState()
+    d->m_signaturePosition = instruction.end;
 
     d->m_nesting.beginArray();
     if (isDict) {
         d->m_nesting.beginParen();
         // Compensate for code in advanceState() that kind of ignores the '}' at the end of a dict.
-        // Unlike advanceState(), parseSingleCompleteType() does properly parse that one.
+        // Unlike advanceState(), the instruction's end does include that one.
         d->m_signaturePosition--;
     }
 }
@@ -613,6 +704,20 @@ bool Arguments::Reader::beginArray(EmptyArrayOption option)
 
 void Arguments::Reader::skipArrayOrDict(bool isDict)
 {
+    if (unlikely(!isArrayComplete())) {
+        // streaming mode and the array hasn't fully arrived yet: undo the BeginArray / BeginDict
+        // handling in advanceState() and try again after replaceData()
+        d->m_nesting.endArray();
+        if (isDict) {
+            d->m_nesting.endParen();
+            d->m_signaturePosition--; // skipDict() skipped the '{'
+        }
+        d->m_signaturePosition--; // compensate for the pre-increment in advanceState()
+        d->m_dataPosition = d->m_arrayHeaderPosition;
+        m_state = NeedMoreData;
+        return;
+    }
+
     // fast-forward the signature and data positions
     skipArrayOrDictSignature(isDict);
     d->m_dataPosition = m_u.Uint32;
@@ -662,13 +767,16 @@ std::pair<Arguments::IoState, chunk> Arguments::Reader::readPrimitiveArray()
     // the point of "primitive array" accessors is that the data can be just memcpy()ed, so we
     // reject anything that needs validation, including booleans
 
-    const TypeInfo elementType = typeInfo(d->m_signature.ptr[d->m_signaturePosition + 1]);
+    const TypeInfo elementType = d->m_instructions[d->m_signaturePosition + 1].type;
     if (!elementType.isPrimitive || elementType.state() == Boolean || elementType.state() == UnixFd) {
         return ret;
     }
     if (d->m_args->d->m_isByteSwapped && elementType.state() != Byte) {
         return ret;
     }
+    if (!isArrayComplete()) {
+        return ret;
+    }
 
     const uint32 size = m_u.Uint32 - d->m_dataPosition;
     // does the end of data line up with the end of the last data element?
@@ -693,6 +801,247 @@ std::pair<Arguments::IoState, chunk> Arguments::Reader::readPrimitiveArray()
     return ret;
 }
 
+std::pair<Arguments::IoState, chunk> Arguments::Reader::readFixedStructArray(FixedStructLayout *layout)
+{
+    auto ret = std::make_pair(InvalidData, chunk());
+
+    if (m_state != BeginArray || !isArrayComplete()) {
+        return ret;
+    }
+    const uint32 elementPosition = d->m_signaturePosition + 1;
+    if (!d->m_programs.back()->fixedStructLayout(elementPosition, layout)) {
+        return ret;
+    }
+    if (d->m_args->d->m_isByteSwapped) {
+        for (const FixedStructLayout::Field &field : layout->fields) {
+            if (field.size != 1) {
+                return ret;
+            }
+        }
+    }
+
+    // The array data is already aligned to 8 bytes. It must end with the end of a struct.
+    const uint32 dataStart = d->m_dataPosition;
+    const uint32 size = m_u.Uint32 - dataStart;
+    if (size && (size < layout->size || (size - layout->size) % layout->stride)) {
+        return ret;
+    }
+
+    // like in regular reading, padding must be zero
+    uint32 fieldsSize = 0;
+    for (const FixedStructLayout::Field &field : layout->fields) {
+        fieldsSize += field.size;
+    }
+    if (fieldsSize != layout->stride && d->m_validationLevel != TrustedData) {
+        const uint32 count = layout->elementCount(size);
+        for (uint32 i = 0; i < count; i++) {
+            const uint32 elementStart = dataStart + i * layout->stride;
+            uint32 padStart = elementStart;
+            for (const FixedStructLayout::Field &field : layout->fields) {
+                if (!isPaddingZero(d->m_data, padStart, elementStart + field.offset)) {
+                    return ret;
+                }
+                padStart = elementStart + field.offset + field.size;
+            }
+            if (i + 1 < count && !isPaddingZero(d->m_data, padStart, elementStart + layout->stride)) {
+                return ret;
+            }
+        }
+    }
+
+    if (size) {
+        ret.second.ptr = d->m_data.ptr + dataStart;
+        ret.second.length = size;
+    }
+    ret.first = BeginStruct;
+
+    // like in readPrimitiveArray(), leave the array
+    d->m_signaturePosition = d->m_instructions[elementPosition].end;
+    d->m_dataPosition = m_u.Uint32;
+    m_state = EndArray;
+    d->m_nesting.endArray();
+    advanceState();
+
+    return ret;
+}
+
+// copies a value of @p size bytes from the data into a column, fixing the byte order if needed
+static inline void copyColumnValue(byte *out, const byte *in, uint32 size, bool isByteSwapped)
+{
+    if (likely(!isByteSwapped)) {
+        switch (size) {
+        case 1:
+            *out = *in;
+            break;
+        case 2:
+            memcpy(out, in, 2);
+            break;
+        case 4:
+            memcpy(out, in, 4);
+            break;
+        default:
+            memcpy(out, in, 8);
+            break;
+        }
+    } else {
+        for (uint32 i = 0; i < size; i++) {
+            out[i] = in[size - 1 - i];
+        }
+    }
+}
+
+bool Arguments::Reader::readStructArrayColumns(std::vector<Column> *columns)
+{
+    if (m_state != BeginArray || !isArrayComplete()) {
+        return false;
+    }
+    const uint32 elementPosition = d->m_signaturePosition + 1;
+    const SignatureProgram::Instruction &element = d->m_instructions[elementPosition];
+    if (element.type.state() != BeginStruct || !element.fitsNesting(d->m_nesting)) {
+        return false;
+    }
+
+    // the members, and the minimum size of a struct to find the maximum number of structs in the array
+    struct Member
+    {
+        TypeInfo type;
+        Column *column;
+        // the storage of column, which doesn't move while filling it
+        byte *values;
+        cstring *strings;
+    };
+    Member members[MaxSignatureLength];
+    uint32 memberCount = 0;
+    uint32 minSize = 0;
+    for (uint32 i = elementPosition + 1; i < element.end; i++) {
+        const TypeInfo type = d->m_instructions[i].type;
+        if (!(type.isPrimitive || type.isString) || type.state() == UnixFd) {
+            return false;
+        }
+        members[memberCount++].type = type;
+        // a string has at least the length prefix and the null terminator
+        minSize += type.isString ? type.alignment + 1 : type.alignment;
+    }
+    if (!memberCount) {
+        return false; // structs can't be empty, but don't rely on that here
+    }
+
+    const uint32 dataStart = d->m_dataPosition;
+    const uint32 dataEnd = m_u.Uint32;
+    // structs start 8-byte aligned, the last one has no padding after it
+    const uint32 length = dataEnd - dataStart;
+    const uint32 maxCount = length >= minSize ? (length - minSize) / align(minSize, StructAlignment) + 1 : 0;
+
+    columns->resize(memberCount);
+    for (uint32 i = 0; i < memberCount; i++) {
+        Column &column = (*columns)[i];
+        column.type = members[i].type.state();
+        column.count = 0;
+        if (members[i].type.isString) {
+            column.data.clear();
+            column.strings.resize(maxCount);
+        } else {
+            column.data.resize(maxCount * (column.type == Boolean ? sizeof(bool) : members[i].type.alignment));
+            column.strings.clear();
+        }
+        members[i].column = &column;
+        members[i].values = column.data.data();
+        members[i].strings = column.strings.data();
+    }
+
+    const byte *const data = d->m_data.ptr;
+    const bool isByteSwapped = d->m_args->d->m_isByteSwapped;
+    const ValidationLevel level = d->m_validationLevel;
+    uint32 count = 0;
+    uint32 position = dataStart;
+    while (position < dataEnd) {
+        if (count == maxCount) {
+            return false;
+        }
+        for (uint32 i = 0; i < memberCount; i++) {
+            const TypeInfo type = members[i].type;
+            const uint32 padStart = position;
+            position = align(position, i ? type.alignment : uint32(StructAlignment));
+            if (unlikely(position + type.alignment > dataEnd) ||
+                (level != TrustedData && !isPaddingZero(d->m_data, padStart, position))) {
+                return false;
+            }
+
+            if (type.isPrimitive) {
+                const uint32 size = type.alignment;
+                if (type.state() == Boolean) {
+                    const uint32 value = basic::readUint32(data + position, isByteSwapped);
+                    if (value > 1 && level != TrustedData) {
+                        return false;
+                    }
+                    reinterpret_cast<bool *>(members[i].values)[count] = value == 1;
+                } else {
+                    copyColumnValue(members[i].values + count * size, data + position, size, isByteSwapped);
+                }
+                position += size;
+                continue;
+            }
+
+            // like doReadString()
+            uint32 stringLength;
+            if (type.alignment == 1) {
+                stringLength = data[position];
+            } else {
+                stringLength = basic::readUint32(data + position, isByteSwapped);
+                if (stringLength >= Arguments::MaxArrayLength - 2) {
+                    return false;
+                }
+            }
+            position += type.alignment;
+            if (unlikely(position + stringLength + 1 > dataEnd)) {
+                return false;
+            }
+            const cstring str(reinterpret_cast<char *>(d->m_data.ptr) + position, stringLength);
+            bool isValidString = str.ptr[stringLength] == '\0';
+            if (isValidString && level == FullValidation) {
+                switch (type.state()) {
+                case String:
+                    isValidString = Arguments::isStringValid(str);
+                    break;
+                case ObjectPath:
+                    isValidString = Arguments::isObjectPathValid(str);
+                    break;
+                default:
+                    isValidString = Arguments::isSignatureValid(str);
+                    break;
+                }
+            }
+            if (!isValidString) {
+                return false;
+            }
+            members[i].strings[count] = str;
+            position += stringLength + 1;
+        }
+        count++;
+    }
+    if (position != dataEnd) {
+        return false;
+    }
+
+    for (uint32 i = 0; i < memberCount; i++) {
+        Column &column = *members[i].column;
+        column.count = count;
+        if (members[i].type.isString) {
+            column.strings.resize(count);
+        } else {
+            column.data.resize(count * (column.type == Boolean ? sizeof(bool) : members[i].type.alignment));
+        }
+    }
+
+    // like in readFixedStructArray(), leave the array
+    d->m_signaturePosition = element.end;
+    d->m_dataPosition = dataEnd;
+    m_state = EndArray;
+    d->m_nesting.endArray();
+    advanceState();
+    return true;
+}
+
 Arguments::IoState Arguments::Reader::peekPrimitiveArray(EmptyArrayOption option) const
 {
     // almost duplicated from readPrimitiveArray(), so keep it in sync
@@ -703,13 +1052,16 @@ Arguments::IoState Arguments::Reader::peekPrimitiveArray(EmptyArrayOption option
     if (option == SkipIfEmpty && !arrayLength) {
         return BeginArray;
     }
-    const TypeInfo elementType = typeInfo(d->m_signature.ptr[d->m_signaturePosition + 1]);
+    const TypeInfo elementType = d->m_instructions[d->m_signaturePosition + 1].type;
     if (!elementType.isPrimitive || elementType.state() == Boolean || elementType.state() == UnixFd) {
         return BeginArray;
     }
     if (d->m_args->d->m_isByteSwapped && elementType.state() != Byte) {
         return BeginArray;
     }
+    if (!isArrayComplete()) {
+        return BeginArray;
+    }
     return elementType.state();
 }
 
@@ -847,6 +1199,7 @@ void Arguments::Reader::beginVariant()
     d->m_signature.ptr = m_u.String.ptr;
     d->m_signature.length = m_u.String.length;
     d->m_signaturePosition = uint32(-1); // we increment d->m_signaturePosition before reading a char
+    d->setProgram(std::move(d->m_variantProgram));
 
     advanceState();
 }
@@ -872,6 +1225,7 @@ void Arguments::Reader::endVariant()
     d->m_signature.length = variantInfo.prevSignature.length;
     d->m_signaturePosition = variantInfo.prevSignaturePosition;
     d->m_aggregateStack.pop_back();
+    d->restorePreviousProgram();
 
     advanceState();
 }
@@ -1021,3 +1375,308 @@ Arguments::IoState Arguments::Reader::currentAggregate() const
     }
     return d->m_aggregateStack.back().aggregateType;
 }
+
+class Arguments::Index::Private
+{
+public:
+    Private()
+       : m_args(nullptr)
+    {}
+
+    struct Argument
+    {
+        uint32 signaturePosition;
+        uint32 dataStart; // before alignment padding
+    };
+
+    struct DictEntry
+    {
+        uint32 hash;
+        uint32 valueDataStart; // before alignment padding, i.e. the end of the key
+        // integer keys, or the offset of a string key in the data in the high and its length in the low half
+        uint64 key;
+    };
+
+    struct Dict
+    {
+        uint32 argument;
+        IoState keyType;
+        uint32 dataEnd;
+        std::vector<DictEntry> entries; // sorted by hash, otherwise in order
+    };
+
+    static uint32 hashKey(const void *key, uint32 length)
+    {
+        // FNV-1a
+        const byte *const bytes = static_cast<const byte *>(key);
+        uint32 hash = 2166136261u;
+        for (uint32 i = 0; i < length; i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    bool isForReader(const Arguments::Reader::Private *reader) const
+    {
+        return m_args == reader->m_args && m_data.ptr == reader->m_data.ptr &&
+               m_data.length == reader->m_data.length;
+    }
+
+    const Dict *findDict(uint32 argument) const
+    {
+        for (const Dict &dict : m_dicts) {
+            if (dict.argument == argument) {
+                return &dict;
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns the first entry in @p dict with a key for which @p isEqual returns true, or nullptr
+    template<typename F>
+    static const DictEntry *findEntry(const Dict &dict, uint32 hash, F isEqual)
+    {
+        DictEntry probe;
+        probe.hash = hash;
+        auto it = std::lower_bound(dict.entries.begin(), dict.entries.end(), probe,
+                                   [](const DictEntry &a, const DictEntry &b) { return a.hash < b.hash; });
+        for (; it != dict.entries.end() && it->hash == hash; ++it) {
+            if (isEqual(it->key)) {
+                return &*it;
+            }
+        }
+        return nullptr;
+    }
+
+    void indexDict(Arguments::Reader *reader);
+
+    Error m_error;
+    const Arguments *m_args;
+    chunk m_data;
+    std::vector<Argument> m_arguments;
+    std::vector<Dict> m_dicts;
+};
+
+void Arguments::Index::Private::indexDict(Arguments::Reader *reader)
+{
+    Arguments::Reader::Private *const rd = reader->d;
+    Dict dict;
+    dict.argument = m_arguments.size() - 1;
+    dict.keyType = rd->m_instructions[rd->m_signaturePosition + 2].type.state();
+    dict.dataEnd = reader->m_u.Uint32;
+    if (dict.keyType == Double || dict.keyType == UnixFd) {
+        reader->skipDict();
+        return;
+    }
+
+    reader->beginDict();
+    while (reader->state() == dict.keyType) {
+        DictEntry entry;
+        entry.valueDataStart = rd->m_dataPosition;
+        switch (dict.keyType) {
+        case String:
+        case ObjectPath:
+        case Signature: {
+            const cstring key = reader->readString();
+            entry.hash = hashKey(key.ptr, key.length);
+            entry.key = uint64(reinterpret_cast<byte *>(key.ptr) - m_data.ptr) << 32 | key.length;
+            break; }
+        default: {
+            int64 key = 0;
+            switch (dict.keyType) {
+            case Boolean:
+                key = reader->readBoolean();
+                break;
+            case Byte:
+                key = reader->readByte();
+                break;
+            case Int16:
+                key = reader->readInt16();
+                break;
+            case Uint16:
+                key = reader->readUint16();
+                break;
+            case Int32:
+                key = reader->readInt32();
+                break;
+            case Uint32:
+                key = reader->readUint32();
+                break;
+            case Int64:
+                key = reader->readInt64();
+                break;
+            default:
+                assert(dict.keyType == Uint64);
+                key = int64(reader->readUint64());
+                break;
+            }
+            entry.hash = hashKey(&key, sizeof(key));
+            entry.key = uint64(key);
+            break; }
+        }
+        dict.entries.push_back(entry);
+        reader->skipCurrentElement();
+    }
+    if (reader->state() != EndDict) {
+        return; // error, which the caller handles
+    }
+    reader->endDict();
+    // keep the order of entries with the same hash, so that the first of duplicate keys is found
+    std::stable_sort(dict.entries.begin(), dict.entries.end(),
+                     [](const DictEntry &a, const DictEntry &b) { return a.hash < b.hash; });
+    m_dicts.push_back(std::move(dict));
+}
+
+Arguments::Index::Index(const Arguments &arguments)
+   : d(new Private)
+{
+    d->m_args = &arguments;
+    Reader reader(arguments);
+    d->m_data = reader.d->m_data;
+    while (reader.state() != Finished && !reader.isError()) {
+        const Private::Argument argument = { reader.d->m_signaturePosition, reader.d->m_argumentDataStart };
+        d->m_arguments.push_back(argument);
+        if (reader.state() == BeginDict) {
+            d->indexDict(&reader);
+        } else {
+            reader.skipCurrentElement();
+        }
+    }
+    if (reader.state() != Finished) {
+        d->m_error = reader.error().isError() ? reader.error() : Error(Error::MalformedMessageData);
+        d->m_arguments.clear();
+        d->m_dicts.clear();
+    }
+}
+
+Arguments::Index::Index(Index &&other)
+   : d(other.d)
+{
+    other.d = nullptr;
+}
+
+Arguments::Index &Arguments::Index::operator=(Index &&other)
+{
+    if (this != &other) {
+        delete d;
+        d = other.d;
+        other.d = nullptr;
+    }
+    return *this;
+}
+
+Arguments::Index::Index(const Index &other)
+   : d(nullptr)
+{
+    if (other.d) {
+        d = new Private(*other.d);
+    }
+}
+
+Arguments::Index &Arguments::Index::operator=(const Index &other)
+{
+    if (d && other.d) {
+        *d = *other.d;
+    } else {
+        Index temp(other);
+        std::swap(d, temp.d);
+    }
+    return *this;
+}
+
+Arguments::Index::~Index()
+{
+    delete d;
+    d = nullptr;
+}
+
+Error Arguments::Index::error() const
+{
+    return d ? d->m_error : Error();
+}
+
+uint32 Arguments::Index::argumentCount() const
+{
+    return d ? d->m_arguments.size() : 0;
+}
+
+bool Arguments::Reader::seekToArgument(const Index &index, uint32 argument)
+{
+    if (m_state == InvalidData || !index.d || !index.d->isForReader(d) ||
+        argument >= index.d->m_arguments.size()) {
+        return false;
+    }
+    const Index::Private::Argument &position = index.d->m_arguments[argument];
+    d->resetToTopLevel();
+    // compensate for the pre-increment in advanceState()
+    d->m_signaturePosition = position.signaturePosition - 1;
+    d->m_dataPosition = position.dataStart;
+    advanceState();
+    return true;
+}
+
+static bool isStringKeyType(Arguments::IoState type)
+{
+    return type == Arguments::String || type == Arguments::ObjectPath || type == Arguments::Signature;
+}
+
+// Enters @p dict and moves to before the value of @p entry, so that advanceState() reads the value
+static void seekToDictEntry(Arguments::Reader::Private *d, const Arguments::Index::Private &index,
+                            const Arguments::Index::Private::Dict &dict,
+                            const Arguments::Index::Private::DictEntry &entry)
+{
+    d->resetToTopLevel();
+    // like beginDict() after the BeginDict handling in advanceState()
+    d->m_nesting.beginArray();
+    d->m_nesting.beginParen();
+    const uint32 keyPosition = index.m_arguments[dict.argument].signaturePosition + 2;
+    Arguments::Reader::Private::AggregateInfo aggregateInfo;
+    aggregateInfo.aggregateType = Arguments::BeginDict;
+    aggregateInfo.arr.dataEnd = dict.dataEnd;
+    aggregateInfo.arr.containedTypeBegin = keyPosition;
+    d->m_aggregateStack.push_back(aggregateInfo);
+    d->m_signaturePosition = keyPosition;
+    d->m_dataPosition = entry.valueDataStart;
+}
+
+bool Arguments::Reader::seekToDictValue(const Index &index, uint32 argument, cstring key)
+{
+    if (m_state == InvalidData || !index.d || !index.d->isForReader(d)) {
+        return false;
+    }
+    const Index::Private::Dict *const dict = index.d->findDict(argument);
+    if (!dict || !isStringKeyType(dict->keyType)) {
+        return false;
+    }
+    const byte *const data = index.d->m_data.ptr;
+    const Index::Private::DictEntry *const entry = Index::Private::findEntry(
+        *dict, Index::Private::hashKey(key.ptr, key.length), [data, key](uint64 entryKey) {
+            return uint32(entryKey) == key.length && memcmp(data + (entryKey >> 32), key.ptr, key.length) == 0;
+        });
+    if (!entry) {
+        return false;
+    }
+    seekToDictEntry(d, *index.d, *dict, *entry);
+    advanceState();
+    return true;
+}
+
+bool Arguments::Reader::seekToDictValue(const Index &index, uint32 argument, int64 key)
+{
+    if (m_state == InvalidData || !index.d || !index.d->isForReader(d)) {
+        return false;
+    }
+    const Index::Private::Dict *const dict = index.d->findDict(argument);
+    if (!dict || isStringKeyType(dict->keyType)) {
+        return false;
+    }
+    const Index::Private::DictEntry *const entry = Index::Private::findEntry(
+        *dict, Index::Private::hashKey(&key, sizeof(key)),
+        [key](uint64 entryKey) { return entryKey == uint64(key); });
+    if (!entry) {
+        return false;
+    }
+    seekToDictEntry(d, *index.d, *dict, *entry);
+    advanceState();
+    return true;
+}
@@ -26,6 +26,7 @@
 
 #include "basictypeio.h"
 #include "malloccache.h"
+#include "signatureprogram.h"
 
 #include <cstring>
 
@@ -49,6 +50,21 @@ public:
          m_data(reinterpret_cast<byte *>(malloc(InitialDataCapacity))),
          m_dataCapacity(InitialDataCapacity),
          m_dataPosition(SignatureReservedSpace),
+         m_externalData(nullptr),
+         m_externalDataCapacity(0),
+         m_nilArrayNesting(0)
+    {
+        m_signature.ptr = reinterpret_cast<char *>(m_data + 1); // reserve a byte for length prefix
+        m_signature.length = 0;
+    }
+
+    explicit Private(chunk externalData)
+       : m_signaturePosition(0),
+         m_data(externalData.ptr),
+         m_dataCapacity(externalData.length),
+         m_dataPosition(SignatureReservedSpace),
+         m_externalData(externalData.ptr),
+         m_externalDataCapacity(externalData.length),
          m_nilArrayNesting(0)
     {
         m_signature.ptr = reinterpret_cast<char *>(m_data + 1); // reserve a byte for length prefix
@@ -70,7 +86,14 @@ public:
         } while (size > newCapacity);
 
         m_signature.ptr -= reinterpret_cast<size_t>(m_data);
-        m_data = reinterpret_cast<byte *>(realloc(m_data, newCapacity));
+        if (isDataExternal()) {
+            // the caller-provided buffer is too small, continue on the heap
+            byte *const newData = reinterpret_cast<byte *>(malloc(newCapacity));
+            memcpy(newData, m_data, m_dataPosition);
+            m_data = newData;
+        } else {
+            m_data = reinterpret_cast<byte *>(realloc(m_data, newCapacity));
+        }
         m_signature.ptr += reinterpret_cast<size_t>(m_data);
         m_dataCapacity = newCapacity;
 
@@ -89,6 +112,11 @@ public:
         }
     }
 
+    bool isDataExternal() const
+    {
+        return m_data && m_data == m_externalData;
+    }
+
     bool insideVariant()
     {
         return !m_queuedData.empty();
@@ -163,6 +191,10 @@ public:
     uint32 m_dataCapacity;
     uint32 m_dataPosition;
 
+    // from the Writer(chunk) constructor, used for m_data when possible
+    byte *m_externalData;
+    uint32 m_externalDataCapacity;
+
     int m_nilArrayNesting;
     std::vector<int> m_fileDescriptors;
     Error m_error;
@@ -199,7 +231,9 @@ public:
         // a variant switches the currently parsed signature, so we
         // need to store the old signature and parse position.
         uint32 prevSignatureOffset; // relative to m_data
-        uint32 prevSignaturePosition;
+        uint32 prevSignaturePosition : 31;
+        // the outermost variant with undeclared contents, which must flush queued data when ending
+        bool isFirstQueued : 1;
     };
 
     struct StructInfo
@@ -254,6 +288,9 @@ void Arguments::Writer::Private::operator=(const Private &other)
     m_data = reinterpret_cast<byte *>(malloc(m_dataCapacity));
     memcpy(m_data, other.m_data, m_dataPosition);
     m_signature.ptr += m_data - other.m_data;
+    // the copy can't share the caller-provided buffer
+    m_externalData = nullptr;
+    m_externalDataCapacity = 0;
 
     m_nilArrayNesting = other.m_nilArrayNesting;
     m_fileDescriptors = other.m_fileDescriptors;
@@ -269,6 +306,21 @@ Arguments::Writer::Writer()
 {
 }
 
+static bool isUsableExternalData(chunk buffer)
+{
+    // the buffer must be aligned for basic::writeFoo(), and hold more than the reserved space for the
+    // signature to be of any use
+    return buffer.ptr && isAligned(uint32(reinterpret_cast<size_t>(buffer.ptr)), 8) &&
+           buffer.length >= Arguments::Writer::Private::SignatureReservedSpace + 64;
+}
+
+Arguments::Writer::Writer(chunk buffer)
+   : d(isUsableExternalData(buffer) ? new(allocCache.allocate()) Private(buffer)
+                                    : new(allocCache.allocate()) Private),
+     m_state(AnyData)
+{
+}
+
 Arguments::Writer::Writer(Writer &&other)
    : d(other.d),
      m_state(other.m_state),
@@ -318,7 +370,9 @@ void Arguments::Writer::operator=(const Writer &other)
 Arguments::Writer::~Writer()
 {
     if (d) {
-        free(d->m_data);
+        if (!d->isDataExternal()) {
+            free(d->m_data);
+        }
         d->m_data = nullptr;
         d->~Private();
         allocCache.free(d);
@@ -336,6 +390,30 @@ Error Arguments::Writer::error() const
     return d->m_error;
 }
 
+void Arguments::Writer::reset()
+{
+    if (!d->m_data) { // given away in finish()
+        if (d->m_externalData) {
+            d->m_data = d->m_externalData;
+            d->m_dataCapacity = d->m_externalDataCapacity;
+        } else {
+            d->m_data = reinterpret_cast<byte *>(malloc(Private::InitialDataCapacity));
+            d->m_dataCapacity = Private::InitialDataCapacity;
+        }
+    }
+    d->m_nesting = Nesting();
+    d->m_signature.ptr = reinterpret_cast<char *>(d->m_data + 1);
+    d->m_signature.length = 0;
+    d->m_signaturePosition = 0;
+    d->m_dataPosition = Private::SignatureReservedSpace;
+    d->m_nilArrayNesting = 0;
+    d->m_fileDescriptors.clear();
+    d->m_error = Error();
+    d->m_aggregateStack.clear();
+    d->m_queuedData.clear();
+    m_state = AnyData;
+}
+
 cstring Arguments::Writer::stateString() const
 {
     return printableState(m_state);
@@ -631,6 +709,11 @@ void Arguments::Writer::advanceState(cstring signatureFragment, IoState newState
         break;
 
     case BeginVariant: {
+        // the contained type, if declared with beginVariant(cstring). Check it before changing
+        // any state so that failure leaves nesting and the aggregate stack consistent.
+        const cstring declaredSignature(m_u.String.ptr, m_u.String.length);
+        VALID_IF(!declaredSignature.length || Arguments::isSignatureValid(declaredSignature, VariantSignature),
+                 Error::InvalidSignature);
         VALID_IF(d->m_nesting.beginVariant(), Error::ExcessiveNesting);
         aggregateInfo.aggregateType = BeginVariant;
 
@@ -638,23 +721,40 @@ void Arguments::Writer::advanceState(cstring signatureFragment, IoState newState
         variantInfo.prevSignatureOffset = uint32(reinterpret_cast<byte *>(d->m_signature.ptr) - d->m_data);
         d->m_signature.ptr[-1] = byte(d->m_signature.length);
         variantInfo.prevSignaturePosition = d->m_signaturePosition;
+        variantInfo.isFirstQueued = false;
+
+        if (declaredSignature.length && !d->insideVariant()) {
+            // The signature is known, so write it into the data stream right away and check the contents
+            // against it like in the second iteration of an array. Nothing to queue and fix up later.
+            const uint32 newDataPosition = d->m_dataPosition + 1 + declaredSignature.length + 1;
+            d->reserveData(newDataPosition, &m_state);
+            d->m_data[d->m_dataPosition] = byte(declaredSignature.length);
+            d->m_signature.ptr = reinterpret_cast<char *>(d->m_data) + d->m_dataPosition + 1;
+            memcpy(d->m_signature.ptr, declaredSignature.ptr, declaredSignature.length + 1);
+            d->m_dataPosition = newDataPosition;
+        } else {
+            // Inside a variant with undeclared contents, everything is queued anyway, so a declared
+            // signature only saves building the signature.
+            if (!d->insideVariant()) {
+                d->m_dataPositionBeforeVariant = d->m_dataPosition;
+                variantInfo.isFirstQueued = true;
+            }
 
-        if (!d->insideVariant()) {
-            d->m_dataPositionBeforeVariant = d->m_dataPosition;
-        }
-
-        d->m_aggregateStack.push_back(aggregateInfo);
-
-        d->m_queuedData.reserve(16);
-        d->m_queuedData.push_back(Private::QueuedDataInfo(1, Private::QueuedDataInfo::VariantSignature));
+            d->m_queuedData.reserve(16);
+            d->m_queuedData.push_back(Private::QueuedDataInfo(1, Private::QueuedDataInfo::VariantSignature));
 
-        const uint32 newDataPosition = d->m_dataPosition + Private::SignatureReservedSpace;
-        d->reserveData(newDataPosition, &m_state);
-        // allocate new signature in the data buffer, reserve one byte for length prefix
-        d->m_signature.ptr = reinterpret_cast<char *>(d->m_data) + d->m_dataPosition + 1;
-        d->m_signature.length = 0;
+            const uint32 newDataPosition = d->m_dataPosition + Private::SignatureReservedSpace;
+            d->reserveData(newDataPosition, &m_state);
+            // allocate new signature in the data buffer, reserve one byte for length prefix
+            d->m_signature.ptr = reinterpret_cast<char *>(d->m_data) + d->m_dataPosition + 1;
+            if (declaredSignature.length) {
+                memcpy(d->m_signature.ptr, declaredSignature.ptr, declaredSignature.length);
+            }
+            d->m_dataPosition = newDataPosition;
+        }
+        d->m_signature.length = declaredSignature.length;
         d->m_signaturePosition = 0;
-        d->m_dataPosition = newDataPosition;
+        d->m_aggregateStack.push_back(aggregateInfo);
         break; }
     case EndVariant: {
         VALID_IF(!d->m_aggregateStack.empty(), Error::CannotEndVariantHere);
@@ -666,6 +766,8 @@ void Arguments::Writer::advanceState(cstring signatureFragment, IoState newState
             // allowed for writing a type signature like "av" in the shortest possible way.
             // No use adding stuff when it's not required or even possible.
             VALID_IF(d->m_signaturePosition > 0, Error::EmptyVariant);
+            // a declared type must be written completely
+            VALID_IF(d->m_signaturePosition == d->m_signature.length, Error::NotSingleCompleteTypeInVariant);
             assert(d->m_signaturePosition <= MaxSignatureLength); // should have been caught earlier
         }
         d->m_signature.ptr[-1] = byte(d->m_signaturePosition);
@@ -676,8 +778,8 @@ void Arguments::Writer::advanceState(cstring signatureFragment, IoState newState
         d->m_signaturePosition = variantInfo.prevSignaturePosition;
         d->m_aggregateStack.pop_back();
 
-        // if not in any variant anymore, flush queued data and resume unqueued operation
-        if (d->m_signature.ptr == reinterpret_cast<char *>(d->m_data) + 1) {
+        // if not in any variant with queued data anymore, flush it and resume unqueued operation
+        if (variantInfo.isFirstQueued) {
             flushQueuedData();
         }
 
@@ -869,33 +971,21 @@ void Arguments::Writer::endStruct()
 
 void Arguments::Writer::beginVariant()
 {
+    m_u.String.ptr = nullptr;
+    m_u.String.length = 0;
     advanceState(cstring("v", strlen("v")), BeginVariant);
 }
 
-void Arguments::Writer::endVariant()
-{
-    advanceState(cstring(), EndVariant);
-}
-
-void Arguments::Writer::writeVariantForMessageHeader(char sig)
+void Arguments::Writer::beginVariant(cstring signature)
 {
-    // Note: the signature we're working with there is a(yv)
-    // If we know that and can trust the client, this can be very easy and fast...
-    d->m_signature.ptr[3] = 'v';
-    d->m_signature.length = 4;
-    d->m_signaturePosition = 4;
-
-    d->reserveData(d->m_dataPosition, &m_state);
-    d->m_data[d->m_dataPosition++] = 1;
-    d->m_data[d->m_dataPosition++] = sig;
-    d->m_data[d->m_dataPosition++] = 0;
+    m_u.String.ptr = signature.ptr;
+    m_u.String.length = signature.length;
+    advanceState(cstring("v", strlen("v")), BeginVariant);
 }
 
-void Arguments::Writer::fixupAfterWriteVariantForMessageHeader()
+void Arguments::Writer::endVariant()
 {
-    // We just wrote something to the main signature when we shouldn't have.
-    d->m_signature.length = 4;
-    d->m_signaturePosition = 4;
+    advanceState(cstring(), EndVariant);
 }
 
 static char letterForPrimitiveIoState(Arguments::IoState ios)
@@ -964,6 +1054,191 @@ void Arguments::Writer::writePrimitiveArray(IoState type, chunk data)
     endArray();
 }
 
+void Arguments::Writer::writeFixedStructArray(cstring structSignature, chunk data)
+{
+    FixedStructLayout layout;
+    if (!Arguments::fixedStructLayout(structSignature, &layout)) {
+        m_state = InvalidData;
+        d->m_error.setCode(Error::NotPrimitiveType);
+        return;
+    }
+    if (data.length > Arguments::MaxArrayLength) {
+        m_state = InvalidData;
+        d->m_error.setCode(Error::ArrayOrDictTooLong);
+        return;
+    }
+    const uint32 count = layout.elementCount(data.length);
+    // the last struct may or may not be followed by padding in the input
+    const uint32 arrayLength = count ? (count - 1) * layout.stride + layout.size : 0;
+    if (data.length != arrayLength && data.length != count * layout.stride) {
+        m_state = InvalidData;
+        d->m_error.setCode(Error::CannotEndArrayOrDictHere);
+        return;
+    }
+
+    uint32 position = 0;
+    if (rawDataPosition(&position)) {
+        if (structSignature.length + 1 > MaxSignatureLength) {
+            m_state = InvalidData;
+            d->m_error.setCode(Error::SignatureTooLong);
+            return;
+        }
+        char arraySignature[MaxSignatureLength + 1];
+        arraySignature[0] = 'a';
+        memcpy(arraySignature + 1, structSignature.ptr, structSignature.length);
+        arraySignature[structSignature.length + 1] = '\0';
+
+        const uint32 lengthPosition = align(position, sizeof(uint32));
+        const uint32 dataStart = align(lengthPosition + sizeof(uint32), StructAlignment);
+        byte *const buffer = writeRawValue(cstring(arraySignature, structSignature.length + 1),
+                                           dataStart + arrayLength);
+        if (!buffer) {
+            return;
+        }
+        zeroPad(buffer, sizeof(uint32), &position);
+        basic::writeUint32(buffer + lengthPosition, arrayLength);
+        position = lengthPosition + sizeof(uint32);
+        zeroPad(buffer, StructAlignment, &position);
+        if (arrayLength) {
+            memcpy(buffer + dataStart, data.ptr, arrayLength);
+        }
+
+        // clear any garbage in padding, which is likely in an array of C structs
+        uint32 fieldsSize = 0;
+        for (const FixedStructLayout::Field &field : layout.fields) {
+            fieldsSize += field.size;
+        }
+        if (fieldsSize != layout.stride) {
+            for (uint32 i = 0; i < count; i++) {
+                const uint32 elementStart = dataStart + i * layout.stride;
+                uint32 padStart = elementStart;
+                for (const FixedStructLayout::Field &field : layout.fields) {
+                    memset(buffer + padStart, 0, elementStart + field.offset - padStart);
+                    padStart = elementStart + field.offset + field.size;
+                }
+                if (i + 1 < count) {
+                    memset(buffer + padStart, 0, elementStart + layout.stride - padStart);
+                }
+            }
+        }
+        return;
+    }
+
+    // The slow way, one struct at a time, inside variants etc. For an empty array, write a dummy
+    // struct to get the types.
+    beginArray(count ? NonEmptyArray : WriteTypesOfEmptyArray);
+    for (uint32 i = 0; i < std::max(count, 1u); i++) {
+        const byte *const element = count ? data.ptr + i * layout.stride : nullptr;
+        std::vector<FixedStructLayout::Field>::const_iterator field = layout.fields.begin();
+        for (uint32 j = 0; j < structSignature.length; j++) {
+            const char c = structSignature.ptr[j];
+            if (c == '(') {
+                beginStruct();
+                continue;
+            } else if (c == ')') {
+                endStruct();
+                continue;
+            }
+            DataUnion value;
+            value.Uint64 = 0;
+            if (element) {
+                memcpy(&value, element + field->offset, field->size);
+            }
+            switch (field->type) {
+            case Byte: writeByte(value.Byte); break;
+            case Int16: writeInt16(value.Int16); break;
+            case Uint16: writeUint16(value.Uint16); break;
+            case Int32: writeInt32(value.Int32); break;
+            case Uint32: writeUint32(value.Uint32); break;
+            case Int64: writeInt64(value.Int64); break;
+            case Uint64: writeUint64(value.Uint64); break;
+            case Double: writeDouble(value.Double); break;
+            default: assert(false); break;
+            }
+            ++field;
+        }
+    }
+    endArray();
+}
+
+bool Arguments::Writer::rawDataPosition(uint32 *dataPosition) const
+{
+    // Inside variants, data is queued for fixup in flushQueuedData(), and in nil arrays, data is
+    // discarded. In dicts, there is extra alignment and checking for each entry. We leave all that
+    // to advanceState().
+    if (m_state == InvalidData || d->insideVariant() || d->m_nilArrayNesting) {
+        return false;
+    }
+    if (!d->m_aggregateStack.empty()) {
+        const IoState aggregateType = d->m_aggregateStack.back().aggregateType;
+        if (aggregateType != BeginStruct && aggregateType != BeginArray) {
+            return false;
+        }
+    }
+    *dataPosition = d->m_dataPosition;
+    return true;
+}
+
+byte *Arguments::Writer::writeRawValue(cstring signature, uint32 endPosition)
+{
+    // This is the subset of advanceState() that applies to a single complete type in the states
+    // accepted by rawDataPosition().
+    uint32 dataPosition = 0;
+    // Unix file descriptors would need to be added to m_fileDescriptors, which raw data can't do
+    if (unlikely(!rawDataPosition(&dataPosition) || endPosition < dataPosition ||
+                 memchr(signature.ptr, 'h', signature.length))) {
+        if (m_state != InvalidData) {
+            m_state = InvalidData;
+            d->m_error.setCode(Error::InvalidType);
+        }
+        return nullptr;
+    }
+
+    const std::shared_ptr<const SignatureProgram> program =
+        SignatureProgram::get(signature, VariantSignature); // a variant signature is one single complete type
+    if (unlikely(!program || !program->instructions()[0].fitsNesting(d->m_nesting))) {
+        m_state = InvalidData;
+        d->m_error.setCode(Error::InvalidSignature);
+        return nullptr;
+    }
+
+    bool isWritingSignature = d->m_signaturePosition == d->m_signature.length;
+    if (!d->m_aggregateStack.empty()) {
+        const Private::AggregateInfo &aggregateInfo = d->m_aggregateStack.back();
+        if (aggregateInfo.aggregateType == BeginArray &&
+            d->m_signaturePosition >= aggregateInfo.arr.containedTypeBegin + 1) {
+            // start the next array entry, see advanceState()
+            d->m_signaturePosition = aggregateInfo.arr.containedTypeBegin;
+            isWritingSignature = false;
+        }
+    }
+
+    if (isWritingSignature) {
+        if (unlikely(d->m_signaturePosition + signature.length > MaxSignatureLength)) {
+            m_state = InvalidData;
+            d->m_error.setCode(Error::SignatureTooLong);
+            return nullptr;
+        }
+        memcpy(d->m_signature.ptr + d->m_signaturePosition, signature.ptr, signature.length);
+        d->m_signature.length += signature.length;
+    } else if (unlikely(d->m_signaturePosition + signature.length > d->m_signature.length ||
+                        memcmp(d->m_signature.ptr + d->m_signaturePosition, signature.ptr,
+                               signature.length) != 0)) {
+        m_state = InvalidData;
+        d->m_error.setCode(Error::TypeMismatchInSubsequentArrayIteration);
+        return nullptr;
+    }
+    d->m_signaturePosition += signature.length;
+
+    d->reserveData(endPosition, &m_state);
+    if (unlikely(m_state == InvalidData)) {
+        return nullptr;
+    }
+    m_state = AnyData;
+    d->m_dataPosition = endPosition;
+    return d->m_data;
+}
+
 Arguments Arguments::Writer::finish()
 {
     // what needs to happen here:
@@ -1010,6 +1285,19 @@ Arguments Arguments::Writer::finish()
         args.d->m_memOwnership = nullptr;
         args.d->m_signature = cstring();
         args.d->m_data = chunk();
+    } else if (d->isDataExternal()) {
+        // copy out of the caller-provided buffer, without the unused part of the reserved space
+        // (same layout as in Arguments::Private::initFrom())
+        const uint32 alignedSigLength = align(d->m_signature.length + 1, 8);
+        byte *const memOwnership = reinterpret_cast<byte *>(malloc(alignedSigLength + dataSize));
+        memcpy(memOwnership, d->m_signature.ptr, d->m_signature.length + 1);
+        uint32 bufferPos = d->m_signature.length + 1;
+        zeroPad(memOwnership, 8, &bufferPos);
+        memcpy(memOwnership + alignedSigLength, d->m_data + Private::SignatureReservedSpace, dataSize);
+
+        args.d->m_memOwnership = memOwnership;
+        args.d->m_signature = cstring(memOwnership, d->m_signature.length);
+        args.d->m_data = chunk(memOwnership + alignedSigLength, dataSize);
     } else {
         args.d->m_memOwnership = d->m_data;
         args.d->m_signature = cstring(d->m_data + 1 /* w/o length prefix */, d->m_signature.length);
@@ -0,0 +1,312 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "byteorder.h"
+
+#include "arguments_p.h"
+#include "basictypeio.h"
+#include "signatureprogram.h"
+
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+void byteSwapArray16(byte *data, uint32 count)
+{
+    uint32 i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i * 2);
+        const __m128i v = _mm_loadu_si128(p);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u8(data + i * 2, vrev16q_u8(vld1q_u8(data + i * 2)));
+    }
+#endif
+    for (; i < count; i++) {
+        byte *p = data + i * 2;
+        std::swap(p[0], p[1]);
+    }
+}
+
+void byteSwapArray32(byte *data, uint32 count)
+{
+    uint32 i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i * 4);
+        __m128i v = _mm_loadu_si128(p);
+        // swap the 16 bit halves of each 32 bit value, then the bytes in each 16 bit half
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u8(data + i * 4, vrev32q_u8(vld1q_u8(data + i * 4)));
+    }
+#endif
+    for (; i < count; i++) {
+        byte *p = data + i * 4;
+        std::swap(p[0], p[3]);
+        std::swap(p[1], p[2]);
+    }
+}
+
+void byteSwapArray64(byte *data, uint32 count)
+{
+    uint32 i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= count; i += 2) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i * 8);
+        __m128i v = _mm_loadu_si128(p);
+        // reverse the order of the 16 bit quarters of each 64 bit value, then swap the bytes in each quarter
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1b), 0x1b);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= count; i += 2) {
+        vst1q_u8(data + i * 8, vrev64q_u8(vld1q_u8(data + i * 8)));
+    }
+#endif
+    for (; i < count; i++) {
+        byte *p = data + i * 8;
+        std::swap(p[0], p[7]);
+        std::swap(p[1], p[6]);
+        std::swap(p[2], p[5]);
+        std::swap(p[3], p[4]);
+    }
+}
+
+namespace {
+class ByteSwapper
+{
+public:
+    ByteSwapper(chunk data, bool dataIsForeign)
+       : m_data(data),
+         m_pos(0),
+         m_dataIsForeign(dataIsForeign)
+    {}
+
+    bool swapSingleCompleteType(const SignatureProgram &program, uint32 position);
+
+private:
+    bool alignPosition(uint32 alignment);
+    bool skip(uint32 length);
+    // swaps the length prefix of strings and arrays and returns it in native byte order
+    bool swapLength(uint32 *length);
+    bool swapArrayContents(const SignatureProgram &program, uint32 contentPosition, uint32 end);
+
+    chunk m_data;
+    uint32 m_pos;
+    bool m_dataIsForeign;
+    Nesting m_nesting;
+};
+}
+
+bool ByteSwapper::alignPosition(uint32 alignment)
+{
+    m_pos = align(m_pos, alignment);
+    return m_pos <= m_data.length;
+}
+
+bool ByteSwapper::skip(uint32 length)
+{
+    if (length > m_data.length - m_pos) {
+        return false;
+    }
+    m_pos += length;
+    return true;
+}
+
+bool ByteSwapper::swapLength(uint32 *length)
+{
+    if (m_data.length - m_pos < sizeof(uint32)) {
+        return false;
+    }
+    byte *p = m_data.ptr + m_pos;
+    if (!m_dataIsForeign) {
+        *length = basic::readUint32(p, false);
+    }
+    byteSwapArray32(p, 1);
+    if (m_dataIsForeign) {
+        *length = basic::readUint32(p, false);
+    }
+    m_pos += sizeof(uint32);
+    return true;
+}
+
+bool ByteSwapper::swapSingleCompleteType(const SignatureProgram &program, uint32 position)
+{
+    const SignatureProgram::Instruction &instruction = program.instructions()[position];
+    if (!alignPosition(instruction.type.alignment)) {
+        return false;
+    }
+    byte *const p = m_data.ptr + m_pos;
+    switch (program.signature().ptr[position]) {
+    case 'y':
+        return skip(1);
+    case 'n':
+    case 'q':
+        if (!skip(2)) {
+            return false;
+        }
+        byteSwapArray16(p, 1);
+        return true;
+    case 'b':
+    case 'i':
+    case 'u':
+    case 'h':
+        if (!skip(4)) {
+            return false;
+        }
+        byteSwapArray32(p, 1);
+        return true;
+    case 'x':
+    case 't':
+    case 'd':
+        if (!skip(8)) {
+            return false;
+        }
+        byteSwapArray64(p, 1);
+        return true;
+    case 's':
+    case 'o': {
+        uint32 length = 0;
+        return swapLength(&length) && skip(length) && skip(1); }
+    case 'g':
+        return skip(1) && skip(*p) && skip(1);
+    case 'v': {
+        if (!skip(1) || !skip(*p) || !skip(1)) {
+            return false;
+        }
+        const std::shared_ptr<const SignatureProgram> variantProgram =
+            SignatureProgram::get(cstring(reinterpret_cast<const char *>(p) + 1, *p),
+                                  Arguments::VariantSignature);
+        if (!variantProgram || !m_nesting.beginVariant()) {
+            return false;
+        }
+        const bool ok = swapSingleCompleteType(*variantProgram, 0);
+        m_nesting.endVariant();
+        return ok; }
+    case '(': {
+        if (!m_nesting.beginParen()) {
+            return false;
+        }
+        for (uint32 member = position + 1; member < instruction.end;
+             member = program.instructions()[member].end + 1) {
+            if (!swapSingleCompleteType(program, member)) {
+                return false;
+            }
+        }
+        m_nesting.endParen();
+        return true; }
+    case 'a': {
+        uint32 length = 0;
+        if (!swapLength(&length) || !m_nesting.beginArray()) {
+            return false;
+        }
+        const uint32 contentPosition = position + 1;
+        // the padding between length and first element is there even if the array is empty
+        if (!alignPosition(program.instructions()[contentPosition].type.alignment) ||
+            length > m_data.length - m_pos) {
+            return false;
+        }
+        const bool ok = swapArrayContents(program, contentPosition, m_pos + length);
+        m_nesting.endArray();
+        return ok; }
+    default:
+        return false;
+    }
+}
+
+bool ByteSwapper::swapArrayContents(const SignatureProgram &program, uint32 contentPosition, uint32 end)
+{
+    const SignatureProgram::Instruction &content = program.instructions()[contentPosition];
+    const uint32 length = end - m_pos;
+    byte *const p = m_data.ptr + m_pos;
+
+    // the fast path for arrays of primitive types
+    if (content.type.isPrimitive) {
+        const uint32 size = content.type.alignment;
+        if (length % size != 0) {
+            return false;
+        }
+        switch (size) {
+        case 2:
+            byteSwapArray16(p, length / 2);
+            break;
+        case 4:
+            byteSwapArray32(p, length / 4);
+            break;
+        case 8:
+            byteSwapArray64(p, length / 8);
+            break;
+        default:
+            break;
+        }
+        m_pos = end;
+        return true;
+    }
+
+    if (program.signature().ptr[contentPosition] == '{') {
+        const uint32 keyPosition = contentPosition + 1;
+        const uint32 valuePosition = program.instructions()[keyPosition].end + 1;
+        while (m_pos < end) {
+            if (!m_nesting.beginParen() || !alignPosition(StructAlignment) ||
+                !swapSingleCompleteType(program, keyPosition) ||
+                !swapSingleCompleteType(program, valuePosition)) {
+                return false;
+            }
+            m_nesting.endParen();
+        }
+    } else {
+        while (m_pos < end) {
+            if (!swapSingleCompleteType(program, contentPosition)) {
+                return false;
+            }
+        }
+    }
+    return m_pos == end;
+}
+
+bool swapByteOrder(cstring signature, Arguments::SignatureType type, chunk data, bool dataIsForeign)
+{
+    const std::shared_ptr<const SignatureProgram> program = SignatureProgram::get(signature, type);
+    if (!program) {
+        return false;
+    }
+    ByteSwapper swapper(data, dataIsForeign);
+    for (uint32 position = 0; position < signature.length;
+         position = program->instructions()[position].end + 1) {
+        if (!swapper.swapSingleCompleteType(*program, position)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#ifndef BYTEORDER_H
+#define BYTEORDER_H
+
+#include "arguments.h"
+
+// Converts D-Bus data with the given signature between the two byte orders, in place. This is done
+// once for a whole received message so that reading it later never needs to swap bytes.
+// If @p dataIsForeign, the data is in the opposite of the native byte order and will be converted
+// to native byte order, else the other way around.
+// @p data must start at an 8 byte aligned position in the message. Returns false if the data does
+// not match the signature, in which case it may have been partially converted.
+bool swapByteOrder(cstring signature, Arguments::SignatureType type, chunk data, bool dataIsForeign);
+
+// Reverse the bytes of each of the @p count values starting at @p data, which needs no alignment.
+// These use SIMD instructions where available.
+void byteSwapArray16(byte *data, uint32 count);
+void byteSwapArray32(byte *data, uint32 count);
+void byteSwapArray64(byte *data, uint32 count);
+
+#endif // BYTEORDER_H
@@ -0,0 +1,948 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "gvariant.h"
+
+#include "arguments_p.h"
+#include "basictypeio.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+// alignment and size of a type in GVariant format; fixedSize is 0 for variable-size types
+struct GVariantTypeInfo
+{
+    uint32 alignment;
+    uint32 fixedSize;
+};
+
+struct Encoder
+{
+    void pad(uint32 alignment) { data.resize(align(data.size(), alignment), 0); }
+    void append(const void *value, uint32 length)
+    {
+        const byte *const bytes = static_cast<const byte *>(value);
+        data.insert(data.end(), bytes, bytes + length);
+    }
+    uint32 size() const { return data.size(); }
+    bool isError() const { return error.isError(); }
+    // writes the table of end offsets (relative to containerStart) at the end of a container
+    void appendOffsets(uint32 containerStart, const std::vector<uint32> &ends, bool isReversed);
+
+    std::vector<byte> data;
+    Error error;
+    bool isSourceByteSwapped = false; // then fixed-size arrays can't be copied as they are
+};
+}
+
+// Returns the position of the last character of the single complete type starting at @p position in
+// @p signature, which must be valid. The signature doesn't need to be null-terminated.
+static uint32 parseType(const char *signature, uint32 position, GVariantTypeInfo *info)
+{
+    switch (signature[position]) {
+    case 'y':
+    case 'b':
+        *info = GVariantTypeInfo{ 1, 1 };
+        break;
+    case 'n':
+    case 'q':
+        *info = GVariantTypeInfo{ 2, 2 };
+        break;
+    case 'i':
+    case 'u':
+    case 'h':
+        *info = GVariantTypeInfo{ 4, 4 };
+        break;
+    case 'x':
+    case 't':
+    case 'd':
+        *info = GVariantTypeInfo{ 8, 8 };
+        break;
+    case 'v':
+        *info = GVariantTypeInfo{ 8, 0 };
+        break;
+    case 'a':
+        position = parseType(signature, position + 1, info);
+        info->fixedSize = 0;
+        break;
+    case '(':
+    case '{': {
+        const char end = signature[position] == '(' ? ')' : '}';
+        uint32 alignment = 1;
+        uint32 size = 0;
+        bool isFixedSize = true;
+        for (position++; signature[position] != end; position++) {
+            GVariantTypeInfo member;
+            position = parseType(signature, position, &member);
+            alignment = std::max(alignment, member.alignment);
+            if (isFixedSize && member.fixedSize) {
+                size = align(size, member.alignment) + member.fixedSize;
+            } else {
+                isFixedSize = false;
+            }
+        }
+        info->alignment = alignment;
+        // the empty struct ("unit type"), which only occurs as the tuple of empty arguments, is one byte
+        info->fixedSize = isFixedSize ? (size ? align(size, alignment) : 1) : 0;
+        break; }
+    default: // strings, object paths and signatures
+        *info = GVariantTypeInfo{ 1, 0 };
+        break;
+    }
+    return position;
+}
+
+// The size of the end offsets in a container is the smallest that can represent the container size.
+// Sizes are limited to Arguments::MaxMessageLength, so 8 byte offsets are never needed.
+static uint32 offsetSizeForContainer(uint32 containerSize)
+{
+    return containerSize == 0 ? 0 : containerSize <= 0xff ? 1 : containerSize <= 0xffff ? 2 : 4;
+}
+
+static uint32 offsetSizeForContents(uint32 contentsSize, uint32 offsetCount)
+{
+    if (uint64(contentsSize) + offsetCount <= 0xff) {
+        return 1;
+    }
+    return uint64(contentsSize) + 2 * uint64(offsetCount) <= 0xffff ? 2 : 4;
+}
+
+// offsets are little-endian regardless of the byte order of the data
+static uint32 readOffset(const byte *p, uint32 offsetSize)
+{
+    uint32 ret = 0;
+    for (uint32 i = 0; i < offsetSize; i++) {
+        ret |= uint32(p[i]) << (8 * i);
+    }
+    return ret;
+}
+
+void Encoder::appendOffsets(uint32 containerStart, const std::vector<uint32> &ends, bool isReversed)
+{
+    const uint32 offsetSize = offsetSizeForContents(size() - containerStart, ends.size());
+    const uint32 tableStart = size();
+    data.resize(tableStart + offsetSize * ends.size());
+    byte *p = data.data() + tableStart;
+    for (uint32 i = 0; i < ends.size(); i++) {
+        const uint32 end = ends[isReversed ? ends.size() - 1 - i : i];
+        for (uint32 j = 0; j < offsetSize; j++) {
+            *p++ = byte(end >> (8 * j));
+        }
+    }
+}
+
+static void encodeValue(Arguments::Reader *reader, const char *type, Encoder *out);
+
+// for structs, dict entries and the top-level tuple; @p end is the closing character of the signature
+static void encodeMembers(Arguments::Reader *reader, const char *firstMember, char end,
+                          const GVariantTypeInfo &info, Encoder *out)
+{
+    const uint32 start = out->size();
+    std::vector<uint32> ends;
+    for (const char *member = firstMember; *member != end && !out->isError(); ) {
+        GVariantTypeInfo memberInfo;
+        const uint32 memberEnd = parseType(member, 0, &memberInfo);
+        encodeValue(reader, member, out);
+        member += memberEnd + 1;
+        // the end of the last member is implied by the start of the offsets
+        if (!memberInfo.fixedSize && *member != end) {
+            ends.push_back(out->size() - start);
+        }
+    }
+    if (out->isError()) {
+        return;
+    }
+    if (info.fixedSize) {
+        out->data.resize(start + info.fixedSize, 0);
+    } else {
+        // the offset of the first member is last
+        out->appendOffsets(start, ends, /* isReversed = */ true);
+    }
+}
+
+static void encodeArray(Arguments::Reader *reader, const char *elementType, Encoder *out)
+{
+    const bool isDict = elementType[0] == '{';
+    GVariantTypeInfo elementInfo;
+    parseType(elementType, 0, &elementInfo);
+    const uint32 start = out->size();
+
+    const char letter = elementType[0];
+    if (!isDict && elementInfo.fixedSize && letter != 'b' && letter != 'h' && letter != '(' &&
+        (!out->isSourceByteSwapped || elementInfo.fixedSize == 1)) {
+        // same layout in both formats
+        const std::pair<Arguments::IoState, chunk> array = reader->readPrimitiveArray();
+        if (array.first == Arguments::InvalidData) {
+            out->error = Error::MalformedMessageData;
+            return;
+        }
+        out->append(array.second.ptr, array.second.length);
+        return;
+    }
+
+    std::vector<uint32> ends;
+    if (isDict) {
+        reader->beginDict();
+    } else {
+        reader->beginArray();
+    }
+    const Arguments::IoState endState = isDict ? Arguments::EndDict : Arguments::EndArray;
+    while (reader->state() != endState && !reader->isError() && !out->isError()) {
+        if (isDict) {
+            out->pad(elementInfo.alignment);
+            encodeMembers(reader, elementType + 1, '}', elementInfo, out);
+        } else {
+            encodeValue(reader, elementType, out);
+        }
+        if (!elementInfo.fixedSize) {
+            ends.push_back(out->size() - start);
+        }
+    }
+    if (reader->isError() || out->isError()) {
+        return;
+    }
+    if (isDict) {
+        reader->endDict();
+    } else {
+        reader->endArray();
+    }
+    if (!elementInfo.fixedSize) {
+        out->appendOffsets(start, ends, /* isReversed = */ false);
+    }
+}
+
+static void encodeValue(Arguments::Reader *reader, const char *type, Encoder *out)
+{
+    if (reader->isError() || out->isError()) {
+        return;
+    }
+    GVariantTypeInfo info;
+    parseType(type, 0, &info);
+    out->pad(info.alignment);
+
+    switch (type[0]) {
+    case 'y': {
+        const byte value = reader->readByte();
+        out->append(&value, sizeof(value));
+        break; }
+    case 'b': {
+        const byte value = reader->readBoolean() ? 1 : 0;
+        out->append(&value, sizeof(value));
+        break; }
+    case 'n': {
+        const int16 value = reader->readInt16();
+        out->append(&value, sizeof(value));
+        break; }
+    case 'q': {
+        const uint16 value = reader->readUint16();
+        out->append(&value, sizeof(value));
+        break; }
+    case 'i': {
+        const int32 value = reader->readInt32();
+        out->append(&value, sizeof(value));
+        break; }
+    case 'u': {
+        const uint32 value = reader->readUint32();
+        out->append(&value, sizeof(value));
+        break; }
+    case 'x': {
+        const int64 value = reader->readInt64();
+        out->append(&value, sizeof(value));
+        break; }
+    case 't': {
+        const uint64 value = reader->readUint64();
+        out->append(&value, sizeof(value));
+        break; }
+    case 'd': {
+        const double value = reader->readDouble();
+        out->append(&value, sizeof(value));
+        break; }
+    case 's':
+    case 'o':
+    case 'g': {
+        const cstring value = type[0] == 's' ? reader->readString()
+                              : type[0] == 'o' ? reader->readObjectPath() : reader->readSignature();
+        out->append(value.ptr, value.length + 1); // including the null terminator
+        break; }
+    case 'v': {
+        reader->beginVariant();
+        if (reader->isError()) {
+            return;
+        }
+        // the signature is in the data of the reader, which doesn't move
+        const cstring signature = reader->currentSignature();
+        if (memchr(signature.ptr, 'h', signature.length)) {
+            out->error = Error::InvalidType;
+            return;
+        }
+        encodeValue(reader, signature.ptr, out);
+        if (reader->isError() || out->isError()) {
+            return;
+        }
+        reader->endVariant();
+        const byte separator = 0;
+        out->append(&separator, 1);
+        out->append(signature.ptr, signature.length);
+        break; }
+    case 'a':
+        encodeArray(reader, type + 1, out);
+        break;
+    case '(':
+        reader->beginStruct();
+        encodeMembers(reader, type + 1, ')', info, out);
+        if (!reader->isError() && !out->isError()) {
+            reader->endStruct();
+        }
+        break;
+    default:
+        out->error = Error::InvalidType;
+        break;
+    }
+}
+
+// Writes a value of type @p type for the types of an empty array
+static void writeTypeOnly(const char *type, Arguments::Writer *writer)
+{
+    switch (type[0]) {
+    case 'y':
+        writer->writeByte(0);
+        break;
+    case 'b':
+        writer->writeBoolean(false);
+        break;
+    case 'n':
+        writer->writeInt16(0);
+        break;
+    case 'q':
+        writer->writeUint16(0);
+        break;
+    case 'i':
+        writer->writeInt32(0);
+        break;
+    case 'u':
+        writer->writeUint32(0);
+        break;
+    case 'x':
+        writer->writeInt64(0);
+        break;
+    case 't':
+        writer->writeUint64(0);
+        break;
+    case 'd':
+        writer->writeDouble(0.0);
+        break;
+    case 's':
+        writer->writeString(cstring(""));
+        break;
+    case 'o':
+        writer->writeObjectPath(cstring("/"));
+        break;
+    case 'g':
+        writer->writeSignature(cstring(""));
+        break;
+    case 'v':
+        writer->beginVariant();
+        writer->endVariant();
+        break;
+    case 'a':
+        if (type[1] == '{') {
+            writer->beginDict(Arguments::Writer::WriteTypesOfEmptyArray);
+            GVariantTypeInfo keyInfo;
+            const uint32 keyEnd = parseType(type, 2, &keyInfo);
+            writeTypeOnly(type + 2, writer);
+            writeTypeOnly(type + keyEnd + 1, writer);
+            writer->endDict();
+        } else {
+            writer->beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+            writeTypeOnly(type + 1, writer);
+            writer->endArray();
+        }
+        break;
+    case '(': {
+        writer->beginStruct();
+        uint32 position = 1;
+        while (type[position] != ')') {
+            GVariantTypeInfo memberInfo;
+            const uint32 memberEnd = parseType(type, position, &memberInfo);
+            writeTypeOnly(type + position, writer);
+            position = memberEnd + 1;
+        }
+        writer->endStruct();
+        break; }
+    default:
+        assert(false);
+        break;
+    }
+}
+
+// Returns false if the data is not valid
+static bool decodeValue(const GVariantArguments::Value &value, Arguments::Writer *writer)
+{
+    if (!writer->isValid()) {
+        return true; // the Writer's error is reported
+    }
+    switch (value.type()) {
+    case Arguments::InvalidData:
+        return false;
+    case Arguments::BeginArray: {
+        const char *const elementType = value.signature().ptr + 1;
+        if (!value.count()) {
+            writer->beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+            writeTypeOnly(elementType, writer);
+            writer->endArray();
+            return true;
+        }
+        GVariantTypeInfo elementInfo;
+        parseType(elementType, 0, &elementInfo);
+        if (elementInfo.fixedSize && elementType[0] != 'b' && elementType[0] != '(') {
+            // same layout in both formats
+            writer->writePrimitiveArray(typeInfo(elementType[0]).state(), value.data());
+            return true;
+        }
+        writer->beginArray();
+        for (uint32 i = 0; i < value.count(); i++) {
+            if (!decodeValue(value[i], writer)) {
+                return false;
+            }
+        }
+        writer->endArray();
+        return true; }
+    case Arguments::BeginDict: {
+        if (!value.count()) {
+            writeTypeOnly(value.signature().ptr, writer);
+            return true;
+        }
+        writer->beginDict();
+        for (uint32 i = 0; i < value.count(); i++) {
+            const GVariantArguments::Value entry = value[i];
+            if (!decodeValue(entry[0], writer) || !decodeValue(entry[1], writer)) {
+                return false;
+            }
+        }
+        writer->endDict();
+        return true; }
+    case Arguments::BeginStruct:
+        writer->beginStruct();
+        for (uint32 i = 0; i < value.count(); i++) {
+            if (!decodeValue(value[i], writer)) {
+                return false;
+            }
+        }
+        writer->endStruct();
+        return true;
+    case Arguments::BeginVariant:
+        writer->beginVariant();
+        if (!decodeValue(value[0], writer)) {
+            return false;
+        }
+        writer->endVariant();
+        return true;
+    case Arguments::Boolean:
+        writer->writeBoolean(value.toBoolean());
+        return true;
+    case Arguments::Byte:
+        writer->writeByte(value.toByte());
+        return true;
+    case Arguments::Int16:
+        writer->writeInt16(value.toInt16());
+        return true;
+    case Arguments::Uint16:
+        writer->writeUint16(value.toUint16());
+        return true;
+    case Arguments::Int32:
+        writer->writeInt32(value.toInt32());
+        return true;
+    case Arguments::Uint32:
+        writer->writeUint32(value.toUint32());
+        return true;
+    case Arguments::Int64:
+        writer->writeInt64(value.toInt64());
+        return true;
+    case Arguments::Uint64:
+        writer->writeUint64(value.toUint64());
+        return true;
+    case Arguments::Double:
+        writer->writeDouble(value.toDouble());
+        return true;
+    case Arguments::String:
+        writer->writeString(value.toString());
+        return true;
+    case Arguments::ObjectPath:
+        writer->writeObjectPath(value.toString());
+        return true;
+    case Arguments::Signature:
+        writer->writeSignature(value.toString());
+        return true;
+    default:
+        return false;
+    }
+}
+
+class GVariantArguments::Private
+{
+public:
+    void setSignature(cstring signature)
+    {
+        m_signature.assign(signature.ptr, signature.length);
+        m_tupleSignature = '(' + m_signature + ')';
+    }
+    Value root() const
+    {
+        return Value(cstring(m_tupleSignature.c_str(), m_tupleSignature.length()),
+                     chunk(const_cast<byte *>(m_data.data()), m_data.size()));
+    }
+
+    Error m_error;
+    std::string m_signature;
+    std::string m_tupleSignature;
+    std::vector<byte> m_data;
+};
+
+GVariantArguments::GVariantArguments()
+   : d(new Private)
+{
+    d->setSignature(cstring(""));
+    d->m_data.push_back(0); // the unit type
+}
+
+GVariantArguments::GVariantArguments(const Arguments &arguments)
+   : d(new Private)
+{
+    const cstring signature = arguments.signature();
+    d->setSignature(signature);
+    if (signature.length && memchr(signature.ptr, 'h', signature.length)) {
+        d->m_error = Error::InvalidType;
+        return;
+    }
+
+    GVariantTypeInfo info;
+    parseType(d->m_tupleSignature.c_str(), 0, &info);
+    Encoder encoder;
+    encoder.isSourceByteSwapped = arguments.isByteSwapped();
+    encoder.data.reserve(arguments.data().length + arguments.data().length / 4);
+    Arguments::Reader reader(arguments);
+    encodeMembers(&reader, d->m_tupleSignature.c_str() + 1, ')', info, &encoder);
+
+    if (reader.isError()) {
+        d->m_error = reader.error();
+    } else if (encoder.isError()) {
+        d->m_error = encoder.error;
+    } else if (!reader.isFinished()) {
+        d->m_error = Error::MalformedMessageData;
+    } else if (encoder.size() > Arguments::MaxMessageLength) {
+        d->m_error = Error::ArgumentsTooLong;
+    } else {
+        d->m_data = std::move(encoder.data);
+    }
+}
+
+GVariantArguments::GVariantArguments(cstring signature, chunk data)
+   : d(new Private)
+{
+    if (!Arguments::isSignatureValid(signature) || memchr(signature.ptr, 'h', signature.length)) {
+        d->setSignature(cstring(""));
+        d->m_error = Error::InvalidSignature;
+        return;
+    }
+    d->setSignature(signature);
+    if (data.length > Arguments::MaxMessageLength) {
+        d->m_error = Error::ArgumentsTooLong;
+        return;
+    }
+    d->m_data.assign(data.ptr, data.ptr + data.length);
+    if (!d->root().isValid()) {
+        d->m_error = Error::MalformedMessageData;
+    }
+}
+
+GVariantArguments::GVariantArguments(GVariantArguments &&other)
+   : d(other.d)
+{
+    other.d = nullptr;
+}
+
+GVariantArguments &GVariantArguments::operator=(GVariantArguments &&other)
+{
+    if (this != &other) {
+        delete d;
+        d = other.d;
+        other.d = nullptr;
+    }
+    return *this;
+}
+
+GVariantArguments::GVariantArguments(const GVariantArguments &other)
+   : d(new Private(*other.d))
+{
+}
+
+GVariantArguments &GVariantArguments::operator=(const GVariantArguments &other)
+{
+    if (this != &other) {
+        *d = *other.d;
+    }
+    return *this;
+}
+
+GVariantArguments::~GVariantArguments()
+{
+    delete d;
+    d = nullptr;
+}
+
+Error GVariantArguments::error() const
+{
+    return d->m_error;
+}
+
+cstring GVariantArguments::signature() const
+{
+    return cstring(d->m_signature.c_str(), d->m_signature.length());
+}
+
+chunk GVariantArguments::data() const
+{
+    return chunk(const_cast<byte *>(d->m_data.data()), d->m_data.size());
+}
+
+Arguments GVariantArguments::toArguments() const
+{
+    Arguments::Writer writer;
+    bool isValid = !d->m_error.isError();
+    if (isValid) {
+        const Value root = d->root();
+        for (uint32 i = 0; isValid && i < root.count(); i++) {
+            isValid = decodeValue(root[i], &writer);
+        }
+    }
+    if (!isValid) {
+        Arguments ret;
+        Arguments::Private::get(&ret)->m_error = d->m_error.isError() ? d->m_error
+                                                                      : Error(Error::MalformedMessageData);
+        return ret;
+    }
+    return writer.finish();
+}
+
+uint32 GVariantArguments::argumentCount() const
+{
+    return d->m_error.isError() ? 0 : d->root().count();
+}
+
+GVariantArguments::Value GVariantArguments::argument(uint32 index) const
+{
+    return d->m_error.isError() ? Value() : d->root()[index];
+}
+
+GVariantArguments::Value::Value()
+   : m_type(Arguments::InvalidData),
+     m_count(0),
+     m_offsetsStart(0),
+     m_offsetSize(0)
+{
+}
+
+GVariantArguments::Value::Value(cstring signature, chunk data)
+   : m_signature(signature),
+     m_data(data),
+     m_type(Arguments::InvalidData),
+     m_count(0),
+     m_offsetsStart(0),
+     m_offsetSize(0)
+{
+    const char letter = signature.ptr[0];
+    GVariantTypeInfo info;
+    parseType(signature.ptr, 0, &info);
+
+    switch (letter) {
+    case 'a': {
+        GVariantTypeInfo elementInfo;
+        parseType(signature.ptr, 1, &elementInfo);
+        if (elementInfo.fixedSize) {
+            if (data.length % elementInfo.fixedSize) {
+                return;
+            }
+            m_count = data.length / elementInfo.fixedSize;
+        } else if (data.length) {
+            m_offsetSize = offsetSizeForContainer(data.length);
+            // the last offset is the end of the last element, which is where the offsets start
+            const uint32 lastEnd = readOffset(data.ptr + data.length - m_offsetSize, m_offsetSize);
+            if (lastEnd > data.length - m_offsetSize || (data.length - lastEnd) % m_offsetSize) {
+                return;
+            }
+            m_offsetsStart = lastEnd;
+            m_count = (data.length - lastEnd) / m_offsetSize;
+        }
+        m_type = signature.ptr[1] == '{' ? Arguments::BeginDict : Arguments::BeginArray;
+        break; }
+    case '(':
+    case '{': {
+        const char end = letter == '(' ? ')' : '}';
+        uint32 offsetCount = 0;
+        for (uint32 position = 1; signature.ptr[position] != end; position++) {
+            GVariantTypeInfo memberInfo;
+            position = parseType(signature.ptr, position, &memberInfo);
+            if (!memberInfo.fixedSize && signature.ptr[position + 1] != end) {
+                offsetCount++;
+            }
+            m_count++;
+        }
+        if (info.fixedSize) {
+            if (data.length != info.fixedSize) {
+                return;
+            }
+            m_offsetsStart = data.length;
+        } else {
+            m_offsetSize = offsetSizeForContainer(data.length);
+            if (uint64(offsetCount) * m_offsetSize > data.length) {
+                return;
+            }
+            m_offsetsStart = data.length - offsetCount * m_offsetSize;
+            // the framing offsets are stored in reverse order, each one the end of a member
+            uint32 previousEnd = 0;
+            for (uint32 i = 1; i <= offsetCount; i++) {
+                const uint32 end = readOffset(data.ptr + data.length - i * m_offsetSize, m_offsetSize);
+                if (end < previousEnd || end > m_offsetsStart) {
+                    return;
+                }
+                previousEnd = end;
+            }
+        }
+        m_type = Arguments::BeginStruct;
+        break; }
+    case 'v': {
+        // the contents are followed by a null byte and the signature of the contents
+        uint32 separator = data.length;
+        while (separator > 0 && data.ptr[separator - 1] != 0) {
+            separator--;
+        }
+        if (separator == 0) {
+            return;
+        }
+        separator--;
+        const uint32 signatureLength = data.length - separator - 1;
+        if (signatureLength > Arguments::MaxSignatureLength) {
+            return;
+        }
+        char contentSignature[Arguments::MaxSignatureLength + 1];
+        memcpy(contentSignature, data.ptr + separator + 1, signatureLength);
+        contentSignature[signatureLength] = '\0';
+        if (!Arguments::isSignatureValid(cstring(contentSignature, signatureLength), Arguments::VariantSignature) ||
+            memchr(contentSignature, 'h', signatureLength)) {
+            return;
+        }
+        m_offsetsStart = separator;
+        m_count = 1;
+        m_type = Arguments::BeginVariant;
+        break; }
+    case 's':
+    case 'o':
+    case 'g': {
+        if (!data.length || data.ptr[data.length - 1] != 0) {
+            return;
+        }
+        const cstring str(data.ptr, data.length - 1);
+        const bool isValid = letter == 's' ? Arguments::isStringValid(str)
+                             : letter == 'o' ? Arguments::isObjectPathValid(str)
+                             : Arguments::isSignatureValid(str);
+        if (!isValid) {
+            return;
+        }
+        m_type = typeInfo(letter).state();
+        break; }
+    case 'h':
+        return; // not supported
+    default:
+        // the other basic types, which are fixed-size
+        if (data.length != info.fixedSize || (letter == 'b' && data.ptr[0] > 1)) {
+            return;
+        }
+        m_type = typeInfo(letter).state();
+        break;
+    }
+}
+
+GVariantArguments::Value GVariantArguments::Value::operator[](uint32 index) const
+{
+    if (index >= m_count) {
+        return Value();
+    }
+    switch (m_type) {
+    case Arguments::BeginArray:
+    case Arguments::BeginDict: {
+        const cstring elementType(m_signature.ptr + 1, m_signature.length - 1);
+        GVariantTypeInfo elementInfo;
+        parseType(elementType.ptr, 0, &elementInfo);
+        if (elementInfo.fixedSize) {
+            return Value(elementType, chunk(m_data.ptr + index * elementInfo.fixedSize, elementInfo.fixedSize));
+        }
+        const byte *const offsets = m_data.ptr + m_offsetsStart;
+        const uint32 start = index ? align(readOffset(offsets + (index - 1) * m_offsetSize, m_offsetSize),
+                                           elementInfo.alignment)
+                                   : 0;
+        const uint32 end = readOffset(offsets + index * m_offsetSize, m_offsetSize);
+        if (start > end || end > m_offsetsStart) {
+            return Value();
+        }
+        return Value(elementType, chunk(m_data.ptr + start, end - start)); }
+    case Arguments::BeginStruct: {
+        // the members before index determine where it starts
+        const char end = m_signature.ptr[0] == '(' ? ')' : '}';
+        uint32 position = 1;
+        uint32 dataPosition = 0;
+        uint32 offsetIndex = 0;
+        for (uint32 i = 0; ; i++) {
+            GVariantTypeInfo memberInfo;
+            const uint32 typeEnd = parseType(m_signature.ptr, position, &memberInfo);
+            const uint32 start = align(dataPosition, memberInfo.alignment);
+            uint32 memberEnd;
+            if (memberInfo.fixedSize) {
+                memberEnd = start + memberInfo.fixedSize;
+            } else if (m_signature.ptr[typeEnd + 1] == end) {
+                memberEnd = m_offsetsStart;
+            } else {
+                // the offsets are in reverse order, from the end of the data
+                offsetIndex++;
+                memberEnd = readOffset(m_data.ptr + m_data.length - offsetIndex * m_offsetSize, m_offsetSize);
+            }
+            if (start > memberEnd || memberEnd > m_offsetsStart) {
+                return Value();
+            }
+            if (i == index) {
+                return Value(cstring(m_signature.ptr + position, typeEnd - position + 1),
+                             chunk(m_data.ptr + start, memberEnd - start));
+            }
+            dataPosition = memberEnd;
+            position = typeEnd + 1;
+        }
+        break; }
+    case Arguments::BeginVariant:
+        return Value(cstring(m_data.ptr + m_offsetsStart + 1, m_data.length - m_offsetsStart - 1),
+                     chunk(m_data.ptr, m_offsetsStart));
+    default:
+        break;
+    }
+    return Value();
+}
+
+GVariantArguments::Value GVariantArguments::Value::lookup(cstring key) const
+{
+    const char keyType = m_signature.ptr[2];
+    if (m_type != Arguments::BeginDict || (keyType != 's' && keyType != 'o' && keyType != 'g')) {
+        return Value();
+    }
+    // Compare the keys in place instead of going through operator[], which would validate every entry.
+    // A key is a string and the first member of its entry, so its end is the entry's only framing offset.
+    const byte *const offsets = m_data.ptr + m_offsetsStart;
+    GVariantTypeInfo entryInfo;
+    parseType(m_signature.ptr + 1, 0, &entryInfo);
+    uint32 entryStart = 0;
+    for (uint32 i = 0; i < m_count; i++) {
+        const uint32 entryEnd = readOffset(offsets + i * m_offsetSize, m_offsetSize);
+        if (entryStart > entryEnd || entryEnd > m_offsetsStart) {
+            return Value();
+        }
+        const uint32 entryLength = entryEnd - entryStart;
+        const uint32 entryOffsetSize = offsetSizeForContainer(entryLength);
+        if (entryLength > entryOffsetSize) {
+            const byte *const entryData = m_data.ptr + entryStart;
+            const uint32 keyEnd = readOffset(entryData + entryLength - entryOffsetSize, entryOffsetSize);
+            if (keyEnd == 0 || keyEnd > entryLength - entryOffsetSize) {
+                return Value();
+            }
+            if (keyEnd == key.length + 1 && memcmp(entryData, key.ptr, key.length) == 0 &&
+                entryData[key.length] == 0) {
+                return (*this)[i][1];
+            }
+        }
+        entryStart = align(entryEnd, entryInfo.alignment);
+    }
+    return Value();
+}
+
+template<typename T>
+T GVariantArguments::Value::toPrimitive(Arguments::IoState type) const
+{
+    T ret = 0;
+    if (m_type == type) {
+        // the value is only aligned if all offsets in the data were "normal"
+        memcpy(&ret, m_data.ptr, sizeof(T));
+    }
+    return ret;
+}
+
+bool GVariantArguments::Value::toBoolean() const
+{
+    return toPrimitive<byte>(Arguments::Boolean) != 0;
+}
+
+byte GVariantArguments::Value::toByte() const
+{
+    return toPrimitive<byte>(Arguments::Byte);
+}
+
+int16 GVariantArguments::Value::toInt16() const
+{
+    return toPrimitive<int16>(Arguments::Int16);
+}
+
+uint16 GVariantArguments::Value::toUint16() const
+{
+    return toPrimitive<uint16>(Arguments::Uint16);
+}
+
+int32 GVariantArguments::Value::toInt32() const
+{
+    return toPrimitive<int32>(Arguments::Int32);
+}
+
+uint32 GVariantArguments::Value::toUint32() const
+{
+    return toPrimitive<uint32>(Arguments::Uint32);
+}
+
+int64 GVariantArguments::Value::toInt64() const
+{
+    return toPrimitive<int64>(Arguments::Int64);
+}
+
+uint64 GVariantArguments::Value::toUint64() const
+{
+    return toPrimitive<uint64>(Arguments::Uint64);
+}
+
+double GVariantArguments::Value::toDouble() const
+{
+    return toPrimitive<double>(Arguments::Double);
+}
+
+cstring GVariantArguments::Value::toString() const
+{
+    if (m_type != Arguments::String && m_type != Arguments::ObjectPath && m_type != Arguments::Signature) {
+        return cstring();
+    }
+    return cstring(m_data.ptr, m_data.length - 1);
+}
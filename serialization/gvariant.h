@@ -0,0 +1,123 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#ifndef GVARIANT_H
+#define GVARIANT_H
+
+#include "arguments.h"
+#include "error.h"
+#include "types.h"
+
+// Arguments in the GVariant serialization format (used by GLib, and the proposed format of "D-Bus 2.0").
+// Instead of length prefixes, containers with variable-size contents store the end offsets of their
+// elements in a table at their end, so that the n-th element of an array or member of a struct can be
+// found without reading anything before it. That makes sparse reads from large data, e.g. looking up a
+// few entries in a big dict of settings, much cheaper than with Arguments::Reader.
+// The data is in native byte order. Unix file descriptors (type "h") are not supported.
+class DFERRY_EXPORT GVariantArguments
+{
+public:
+    class Value;
+
+    GVariantArguments();
+    // Converts from the classic D-Bus format. error() is set if @p arguments is not valid.
+    explicit GVariantArguments(const Arguments &arguments);
+    // Copies @p data, which must be a GVariant tuple of the types in @p signature, like the body of a
+    // message with signature @p signature. Only the framing of the whole tuple is checked here.
+    GVariantArguments(cstring signature, chunk data);
+    GVariantArguments(GVariantArguments &&other);
+    GVariantArguments &operator=(GVariantArguments &&other);
+    GVariantArguments(const GVariantArguments &other);
+    GVariantArguments &operator=(const GVariantArguments &other);
+    ~GVariantArguments();
+
+    Error error() const;
+    cstring signature() const; // of the arguments, without the parentheses of the tuple
+    chunk data() const;
+
+    // Converts to the classic D-Bus format, checking all of the data. The returned Arguments has an
+    // error if the data is not valid.
+    Arguments toArguments() const;
+
+    uint32 argumentCount() const;
+    Value argument(uint32 index) const;
+
+    // A view into the data of a single value, which must stay valid while the Value is used. Creating a
+    // Value checks the framing of a container and the whole data of other types, so that accessing a
+    // value in a large data set only checks what is on the way to it.
+    class DFERRY_EXPORT Value
+    {
+    public:
+        Value(); // an invalid value
+        bool isValid() const { return m_type != Arguments::InvalidData; }
+        // BeginArray, BeginDict, BeginStruct (also for dict entries, with key and value as members),
+        // BeginVariant, one of the basic types, or InvalidData
+        Arguments::IoState type() const { return m_type; }
+        // Of this value; not null-terminated in general
+        cstring signature() const { return m_signature; }
+        chunk data() const { return m_data; }
+
+        // Elements of an array, entries of a dict, members of a struct or dict entry, and 1 for variants
+        uint32 count() const { return m_count; }
+        // The child at @p index as in count(). Constant time, except for structs, where it is linear in
+        // the number of members. Invalid if @p index is out of range or the child's data is not valid.
+        Value operator[](uint32 index) const;
+        // In a dict with string, object path or signature keys, the value of the first entry with key
+        // @p key, or an invalid Value if there is none. The entries are not sorted, so this is linear in
+        // the number of entries - but not in the size of the values.
+        Value lookup(cstring key) const;
+
+        // These return 0 or an empty string if type() is not the requested type
+        bool toBoolean() const;
+        byte toByte() const;
+        int16 toInt16() const;
+        uint16 toUint16() const;
+        int32 toInt32() const;
+        uint32 toUint32() const;
+        int64 toInt64() const;
+        uint64 toUint64() const;
+        double toDouble() const;
+        cstring toString() const; // for String, ObjectPath and Signature; null-terminated
+
+    private:
+        friend class GVariantArguments;
+        Value(cstring signature, chunk data);
+        template<typename T>
+        T toPrimitive(Arguments::IoState type) const;
+
+        cstring m_signature;
+        chunk m_data;
+        Arguments::IoState m_type;
+        uint32 m_count;
+        // in containers with variable-size elements / members: where the table of end offsets starts,
+        // and the size of each offset
+        uint32 m_offsetsStart;
+        uint32 m_offsetSize;
+    };
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // GVARIANT_H
@@ -26,6 +26,7 @@
 
 #include "arguments_p.h"
 #include "basictypeio.h"
+#include "byteorder.h"
 #include "malloccache.h"
 #include "stringtools.h"
 
@@ -100,6 +101,19 @@ static const Message::VariableHeader s_intHeaderAtIndex[VarHeaderStorage::s_intH
 VarHeaderStorage::VarHeaderStorage()
 {} // initialization values are in class declaration
 
+static void copyStringHeader(VarHeaderStorage *to, const VarHeaderStorage &from, Message::VariableHeader header)
+{
+    const int idx = indexOfHeader(header);
+    if (from.isRawStringHeader(header)) {
+        to->clearStringHeader(header);
+        to->m_headerPresenceBitmap |= 1u << header;
+        to->m_rawStringHeaderBitmap |= 1u << header;
+        to->rawStringHeader(idx) = from.rawStringHeader(idx);
+    } else {
+        to->setStringHeader(header, from.stringHeaders()[idx]);
+    }
+}
+
 VarHeaderStorage::VarHeaderStorage(const VarHeaderStorage &other)
 {
     // ### very suboptimal
@@ -107,7 +121,7 @@ VarHeaderStorage::VarHeaderStorage(const VarHeaderStorage &other)
         Message::VariableHeader vh = static_cast<Message::VariableHeader>(i);
         if (other.hasHeader(vh)) {
             if (isStringHeader(vh)) {
-                setStringHeader(vh, other.stringHeader(vh));
+                copyStringHeader(this, other, vh);
             } else {
                 setIntHeader(vh, other.intHeader(vh));
             }
@@ -119,7 +133,7 @@ VarHeaderStorage::~VarHeaderStorage()
 {
     for (int i = 0; i < s_stringHeaderCount; i++) {
         const Message::VariableHeader field = s_stringHeaderAtIndex[i];
-        if (hasHeader(field)) {
+        if (hasHeader(field) && !isRawStringHeader(field)) {
             // ~basic_string() instead of ~string() to work around a GCC bug
             stringHeaders()[i].~basic_string();
         }
@@ -133,7 +147,7 @@ VarHeaderStorage &VarHeaderStorage::operator=(const VarHeaderStorage &other)
         Message::VariableHeader vh = static_cast<Message::VariableHeader>(i);
         if (other.hasHeader(vh)) {
             if (isStringHeader(vh)) {
-                setStringHeader(vh, other.stringHeader(vh));
+                copyStringHeader(this, other, vh);
             } else {
                 setIntHeader(vh, other.intHeader(vh));
             }
@@ -163,21 +177,36 @@ bool VarHeaderStorage::hasIntHeader(Message::VariableHeader header) const
     return hasHeader(header) && !isStringHeader(header);
 }
 
-std::string VarHeaderStorage::stringHeader(Message::VariableHeader header) const
+std::string VarHeaderStorage::stringHeader(Message::VariableHeader header, const byte *buffer) const
 {
-    return hasStringHeader(header) ? stringHeaders()[indexOfHeader(header)] : std::string();
+    if (!hasStringHeader(header)) {
+        return std::string();
+    }
+    const int idx = indexOfHeader(header);
+    if (isRawStringHeader(header)) {
+        const RawStringHeader &raw = rawStringHeader(idx);
+        return std::string(reinterpret_cast<const char *>(buffer) + raw.offset, raw.length);
+    }
+    return stringHeaders()[idx];
 }
 
-cstring VarHeaderStorage::stringHeaderRaw(Message::VariableHeader header)
+cstring VarHeaderStorage::stringHeaderRaw(Message::VariableHeader header, const byte *buffer)
 {
     // this one is supposed to be a const method in the intended use, but it is dangerous so
     // outwardly non-const is kind of okay as a warning
     cstring ret;
     assert(isStringHeader(header));
     if (hasHeader(header)) {
-        std::string &str = stringHeaders()[indexOfHeader(header)];
-        ret.ptr = const_cast<char *>(str.c_str());
-        ret.length = str.length();
+        const int idx = indexOfHeader(header);
+        if (isRawStringHeader(header)) {
+            const RawStringHeader &raw = rawStringHeader(idx);
+            ret.ptr = const_cast<char *>(reinterpret_cast<const char *>(buffer)) + raw.offset;
+            ret.length = raw.length;
+        } else {
+            std::string &str = stringHeaders()[idx];
+            ret.ptr = const_cast<char *>(str.c_str());
+            ret.length = str.length();
+        }
     }
     return ret;
 }
@@ -188,22 +217,26 @@ void VarHeaderStorage::setStringHeader(Message::VariableHeader header, const std
         return;
     }
     const int idx = indexOfHeader(header);
-    if (hasHeader(header)) {
+    if (hasHeader(header) && !isRawStringHeader(header)) {
         stringHeaders()[idx] = value;
     } else {
         m_headerPresenceBitmap |= 1u << header;
+        m_rawStringHeaderBitmap &= ~(1u << header);
         new(stringHeaders() + idx) std::string(value);
     }
 }
 
-bool VarHeaderStorage::setStringHeader_deser(Message::VariableHeader header, cstring value)
+bool VarHeaderStorage::setStringHeader_deser(Message::VariableHeader header, cstring value, const byte *buffer)
 {
     assert(isStringHeader(header));
     if (hasHeader(header)) {
         return false;
     }
     m_headerPresenceBitmap |= 1u << header;
-    new(stringHeaders() + indexOfHeader(header)) std::string(value.ptr, value.length);
+    m_rawStringHeaderBitmap |= 1u << header;
+    RawStringHeader &raw = rawStringHeader(indexOfHeader(header));
+    raw.offset = reinterpret_cast<const byte *>(value.ptr) - buffer;
+    raw.length = value.length;
     return true;
 }
 
@@ -214,10 +247,33 @@ void VarHeaderStorage::clearStringHeader(Message::VariableHeader header)
     }
     if (hasHeader(header)) {
         m_headerPresenceBitmap &= ~(1u << header);
-        stringHeaders()[indexOfHeader(header)].~basic_string();
+        if (isRawStringHeader(header)) {
+            m_rawStringHeaderBitmap &= ~(1u << header);
+        } else {
+            stringHeaders()[indexOfHeader(header)].~basic_string();
+        }
+    }
+}
+
+void VarHeaderStorage::materializeRawStringHeaders(const byte *buffer)
+{
+    for (int i = 0; i < s_stringHeaderCount && m_rawStringHeaderBitmap; i++) {
+        const Message::VariableHeader field = s_stringHeaderAtIndex[i];
+        if (isRawStringHeader(field)) {
+            const RawStringHeader raw = rawStringHeader(i);
+            m_rawStringHeaderBitmap &= ~(1u << field);
+            new(stringHeaders() + i) std::string(reinterpret_cast<const char *>(buffer) + raw.offset,
+                                                 raw.length);
+        }
     }
 }
 
+void VarHeaderStorage::forgetRawStringHeaders()
+{
+    m_headerPresenceBitmap &= ~m_rawStringHeaderBitmap;
+    m_rawStringHeaderBitmap = 0;
+}
+
 uint32 VarHeaderStorage::intHeader(Message::VariableHeader header) const
 {
     return hasIntHeader(header) ? m_intHeaders[indexOfHeader(header)] : 0;
@@ -253,6 +309,15 @@ void VarHeaderStorage::clearIntHeader(Message::VariableHeader header)
 
 // TODO think of copying signature from and to output!
 
+// a view into the data of arguments that belong to a SharedMessageBuffer
+static Arguments sharedBodyArguments(const Arguments &arguments)
+{
+    Arguments ret(nullptr, arguments.signature(), arguments.data(), arguments.fileDescriptors(),
+                  arguments.isByteSwapped());
+    ret.setValidationLevel(arguments.validationLevel());
+    return ret;
+}
+
 MessagePrivate::MessagePrivate(Message *parent)
    : m_message(parent),
      m_bufferPos(0),
@@ -262,10 +327,17 @@ MessagePrivate::MessagePrivate(Message *parent)
      m_flags(0),
      m_protocolVersion(1),
      m_dirty(true),
+     m_bodyIsSeparate(false),
+     m_bufferIsPooled(false),
      m_headerLength(0),
      m_headerPadding(0),
      m_bodyLength(0),
-     m_serial(0)
+     m_serial(0),
+     m_validationLevel(Arguments::FullValidation),
+     m_receiveProgressListener(nullptr),
+     m_streamingBodyThreshold(0),
+     m_sharedBuffer(nullptr),
+     m_sharedBody(nullptr)
 {}
 
 MessagePrivate::MessagePrivate(const MessagePrivate &other, Message *parent)
@@ -277,15 +349,36 @@ MessagePrivate::MessagePrivate(const MessagePrivate &other, Message *parent)
      m_flags(other.m_flags),
      m_protocolVersion(other.m_protocolVersion),
      m_dirty(other.m_dirty),
+     m_bodyIsSeparate(other.m_bodyIsSeparate),
+     m_bufferIsPooled(false), // the buffer is shared or copied with malloc()
      m_headerLength(other.m_headerLength),
      m_headerPadding(other.m_headerPadding),
      m_bodyLength(other.m_bodyLength),
      m_serial(other.m_serial),
      m_error(other.m_error),
-     m_mainArguments(other.m_mainArguments),
-     m_varHeaders(other.m_varHeaders)
-{
-    if (other.m_buffer.ptr) {
+     // the arguments of a shared buffer or body are set up below without copying the data
+     m_mainArguments(other.canShareBuffer() || other.m_sharedBody ? Arguments() : other.m_mainArguments),
+     m_varHeaders(other.m_varHeaders),
+     m_validationLevel(other.m_validationLevel),
+     m_receiveProgressListener(nullptr),
+     m_streamingBodyThreshold(0),
+     m_sharedBuffer(nullptr),
+     m_sharedBody(nullptr)
+{
+    if (other.m_sharedBody) {
+        m_sharedBody = other.m_sharedBody;
+        m_sharedBody->refCount++;
+        m_mainArguments = sharedBodyArguments(other.m_mainArguments);
+    }
+    if (other.canShareBuffer()) {
+        // Copying the same message from several threads at once is not supported (and wasn't before
+        // buffer sharing because the file descriptors are shared with the Arguments copy)
+        const_cast<MessagePrivate &>(other).shareBuffer();
+        m_sharedBuffer = other.m_sharedBuffer;
+        m_sharedBuffer->refCount++;
+        m_buffer = other.m_buffer;
+        setBodyArguments(m_bodyLength, m_sharedBuffer->fileDescriptors);
+    } else if (other.m_buffer.ptr) {
         // we don't keep pointers into the buffer (only indexes), right? right?
         m_buffer.ptr = static_cast<byte *>(malloc(other.m_buffer.length));
         m_buffer.length = other.m_buffer.length;
@@ -295,15 +388,17 @@ MessagePrivate::MessagePrivate(const MessagePrivate &other, Message *parent)
 #ifdef __unix__
         // TODO ensure all "actual" file descriptor handling everywhere is inside this ifdef
         // (note conditional compilation of whole file localsocket.cpp)
-        argUnixFds()->clear();
-        std::vector<int> *otherUnixFds = const_cast<MessagePrivate &>(other).argUnixFds();
-        argUnixFds()->reserve(otherUnixFds->size());
-        for (int fd : *otherUnixFds) {
-            int fdCopy = ::dup(fd);
-            if (fdCopy == -1) {
-                // TODO error...
+        if (!m_sharedBody) { // otherwise, m_sharedBody owns them
+            argUnixFds()->clear();
+            std::vector<int> *otherUnixFds = const_cast<MessagePrivate &>(other).argUnixFds();
+            argUnixFds()->reserve(otherUnixFds->size());
+            for (int fd : *otherUnixFds) {
+                int fdCopy = ::dup(fd);
+                if (fdCopy == -1) {
+                    // TODO error...
+                }
+                argUnixFds()->push_back(fdCopy);
             }
-            argUnixFds()->push_back(fdCopy);
         }
 #endif
     } else {
@@ -319,11 +414,36 @@ MessagePrivate::~MessagePrivate()
     clear(/* onlyReleaseResources = */ true);
 }
 
+static void deletePrivate(MessagePrivate *d)
+{
+    if (unlikely(d->m_pool)) {
+        // keep the pool alive until the memory is back in it
+        const std::shared_ptr<MessagePool> pool = d->m_pool;
+        d->~MessagePrivate();
+        pool->freeMessage(d);
+    } else {
+        d->~MessagePrivate();
+        msgAllocCaches.msgPrivate.free(d);
+    }
+}
+
 Message::Message()
    : d(new(msgAllocCaches.msgPrivate.allocate()) MessagePrivate(this))
 {
 }
 
+Message::Message(const std::shared_ptr<MessagePool> &pool)
+   : d(new(pool->allocateMessage()) MessagePrivate(this))
+{
+    d->m_pool = pool;
+}
+
+// static
+Message *MessagePrivate::createPooled(const std::shared_ptr<MessagePool> &pool)
+{
+    return new Message(pool);
+}
+
 Message::Message(Message &&other)
    : d(other.d)
 {
@@ -335,8 +455,7 @@ Message &Message::operator=(Message &&other)
 {
     if (this != &other) {
         if (d) {
-            d->~MessagePrivate();
-            msgAllocCaches.msgPrivate.free(d);
+            deletePrivate(d);
         }
         d = other.d;
         if (other.d) {
@@ -360,8 +479,7 @@ Message &Message::operator=(const Message &other)
 {
     if (this != &other) {
         if (d) {
-            d->~MessagePrivate();
-            msgAllocCaches.msgPrivate.free(d);
+            deletePrivate(d);
         }
         if (other.d) {
             // ### can be optimized by implementing and using assignment of MessagePrivate
@@ -376,8 +494,7 @@ Message &Message::operator=(const Message &other)
 Message::~Message()
 {
     if (d) {
-        d->~MessagePrivate();
-        msgAllocCaches.msgPrivate.free(d);
+        deletePrivate(d);
         d = nullptr;
     }
 }
@@ -648,7 +765,16 @@ std::string Message::stringHeader(VariableHeader header, bool *isPresent) const
     if (isPresent) {
         *isPresent = exists;
     }
-    return exists ? d->m_varHeaders.stringHeader(header) : std::string();
+    return exists ? d->m_varHeaders.stringHeader(header, d->m_buffer.ptr) : std::string();
+}
+
+cstring Message::stringHeaderView(VariableHeader header, bool *isPresent) const
+{
+    const bool exists = d->m_varHeaders.hasStringHeader(header);
+    if (isPresent) {
+        *isPresent = exists;
+    }
+    return exists ? d->m_varHeaders.stringHeaderRaw(header, d->m_buffer.ptr) : cstring();
 }
 
 void Message::setStringHeader(VariableHeader header, const std::string &value)
@@ -683,6 +809,7 @@ bool Message::expectsReply() const
 
 void Message::setExpectsReply(bool expectsReply)
 {
+    d->m_dirty = true;
     if (expectsReply) {
         d->m_flags &= ~MessagePrivate::NoReplyExpectedFlag;
     } else {
@@ -697,6 +824,7 @@ bool Message::autoStartService() const
 
 void Message::setAutoStartService(bool autoStart) const
 {
+    d->m_dirty = true;
     if (autoStart) {
         d->m_flags &= ~MessagePrivate::NoAutoStartServiceFlag;
     } else {
@@ -711,6 +839,7 @@ bool Message::interactiveAuthorizationAllowed() const
 
 void Message::setInteractiveAuthorizationAllowed(bool allowInteractive) const
 {
+    d->m_dirty = true;
     if (allowInteractive) {
         d->m_flags &= ~MessagePrivate::NoAllowInteractiveAuthorizationFlag;
     } else {
@@ -720,22 +849,26 @@ void Message::setInteractiveAuthorizationAllowed(bool allowInteractive) const
 
 void Message::setArguments(Arguments arguments)
 {
-    d->m_dirty = true;
-    d->m_error = arguments.error();
-    const size_t fdCount = arguments.fileDescriptors().size();
-    if (fdCount) {
-        d->m_varHeaders.setIntHeader(Message::UnixFdsHeader, fdCount);
-    } else {
-        d->m_varHeaders.clearIntHeader(Message::UnixFdsHeader);
-    }
+    d->adoptArguments(std::move(arguments), nullptr);
+}
 
-    cstring signature = arguments.signature();
-    if (signature.length) {
-        d->m_varHeaders.setStringHeader(Message::SignatureHeader, toStdString(signature));
-    } else {
-        d->m_varHeaders.clearStringHeader(Message::SignatureHeader);
+void Message::setArgumentsFrom(const Message &message)
+{
+    if (&message == this) {
+        return;
+    }
+    MessagePrivate *const source = message.d;
+    SharedMessageBuffer *sharedBody = source->m_sharedBody;
+    if (!sharedBody && source->canShareBuffer()) {
+        source->shareBuffer();
+        sharedBody = source->m_sharedBuffer;
     }
-    d->m_mainArguments = std::move(arguments);
+    if (!sharedBody) {
+        setArguments(source->m_mainArguments);
+        return;
+    }
+    sharedBody->refCount++;
+    d->adoptArguments(sharedBodyArguments(source->m_mainArguments), sharedBody);
 }
 
 const Arguments &Message::arguments() const
@@ -745,6 +878,8 @@ const Arguments &Message::arguments() const
 
 static const uint32 s_properFixedHeaderLength = 12;
 static const uint32 s_extendedFixedHeaderLength = 16;
+// bodies at least this long are not copied into the message buffer for sending
+static const uint32 s_separateBodyMinLength = 8192;
 
 #ifndef DFERRY_SERDES_ONLY
 void MessagePrivate::receive(ITransport *transport)
@@ -763,28 +898,6 @@ bool Message::isReceiving() const
     return d->m_state == MessagePrivate::Receiving;
 }
 
-void MessagePrivate::send(ITransport *transport)
-{
-    if (!serialize()) {
-        m_state = Serialized;
-        assert(m_error.isError());
-        if (!m_error.isError()) {
-            // TODO This error code makes no sense here. We don't have a "generic error" code, and a specific
-            // error code should have been set by whatever code detected the error. Hence the assertion.
-            m_error = Error::MalformedReply;
-        }
-        // Note: We don't call notifyCompletionListener(); since all our timers are internal, we can
-        // expect them to check for errors after this returns. Specifically, Connection::send() has
-        // access to the timer in the PendingReply, so it can produce a deferred error notification
-        // just like success notifications are deferred.
-        return;
-    }
-    if (m_state != MessagePrivate::Sending) {
-        transport->setWriteListener(this);
-        m_state = MessagePrivate::Sending;
-    }
-}
-
 bool Message::isSending() const
 {
     return d->m_state == MessagePrivate::Sending;
@@ -795,6 +908,12 @@ void MessagePrivate::setCompletionListener(ICompletionListener *listener)
     m_completionListener = listener;
 }
 
+void MessagePrivate::setReceiveProgressListener(ICompletionListener *listener, uint32 minBodyLength)
+{
+    m_receiveProgressListener = listener;
+    m_streamingBodyThreshold = minBodyLength;
+}
+
 void MessagePrivate::notifyCompletionListener()
 {
     if (m_completionListener) {
@@ -823,17 +942,10 @@ IO::Status MessagePrivate::handleTransportCanRead()
 
         const bool headersDone = m_headerLength > 0 && m_bufferPos >= m_headerLength;
 
-        if (m_bufferPos == 0) {
-            // According to the DBus spec, file descriptors can arrive anywhere in the message, but
-            // (assuming the message is written in one sendmsg() call) according to UNIX domain socket
-            // documentation, file descriptors will arrive in the first byte of the sent block they are
-            // attached to. We go with the UNIX domain socket documentation.
-            // TODO review and test this for very large messages that cannot be sent in one call
-            ioRes = readTransport()->readWithFileDescriptors(m_buffer.ptr + m_bufferPos, readMax,
-                                                             argUnixFds());
-        } else {
-            ioRes = readTransport()->read(m_buffer.ptr + m_bufferPos, readMax);
-        }
+        // The transport reads ahead as much as it can get, so one read from the socket serves many small
+        // messages. It returns file descriptors together with the data they belong to, which is anywhere
+        // in the message from our point of view. Their count is verified when the message is complete.
+        ioRes = readTransport()->readBuffered(m_buffer.ptr + m_bufferPos, readMax, argUnixFds());
         m_bufferPos += ioRes.length;
         assert(m_bufferPos <= m_buffer.length);
 
@@ -846,10 +958,7 @@ IO::Status MessagePrivate::handleTransportCanRead()
                 }
             }
             if (m_headerLength > 0 && m_bufferPos >= m_headerLength) {
-                // ### If we expected to receive the FDs at any point in the message (as opposed to just the
-                //     first byte), we'd have to verify FD count later. But we don't, so this is expedient.
-                if (!deserializeVariableHeaders() ||
-                        m_varHeaders.intHeader(Message::UnixFdsHeader) != argUnixFds()->size()) {
+                if (!deserializeVariableHeaders()) {
                     ret = IO::Status::RemoteClosed;
                     m_error = Error::MalformedReply;
                     break;
@@ -859,20 +968,37 @@ IO::Status MessagePrivate::handleTransportCanRead()
         if (m_headerLength > 0 && m_bufferPos >= m_headerLength + m_bodyLength) {
             // all done!
             assert(m_bufferPos == m_headerLength + m_bodyLength);
+            if (m_varHeaders.intHeader(Message::UnixFdsHeader) != argUnixFds()->size()) {
+                ret = IO::Status::RemoteClosed;
+                m_error = Error::MalformedReply;
+                break;
+            }
+            if (!normalizeByteOrder()) {
+                ret = IO::Status::RemoteClosed;
+                m_error = Error::MalformedReply;
+                break;
+            }
             m_state = Serialized;
-            chunk bodyData(m_buffer.ptr + m_headerLength, m_bodyLength);
-            m_mainArguments = Arguments(nullptr, m_varHeaders.stringHeaderRaw(Message::SignatureHeader),
-                                        bodyData, std::move(*argUnixFds()), m_isByteSwapped);
+            setBodyArguments(m_bodyLength, std::move(*argUnixFds()));
             assert(ioRes.status == IO::Status::OK && ret == IO::Status::OK);
             readTransport()->setReadListener(nullptr);
             notifyCompletionListener(); // do not access members after this because it might delete us!
             break;
         }
+        if (m_receiveProgressListener && ioRes.length && m_headerLength > 0 && m_bufferPos > m_headerLength &&
+            m_bodyLength >= m_streamingBodyThreshold) {
+            // Streaming: expose the partial body. The buffer has its final size, so the data does not move
+            // anymore. The byte order is only normalized at the end; Readers look at the byte order flag of
+            // their Arguments for every read, so they continue correctly after that.
+            setBodyArguments(m_bufferPos - m_headerLength, std::move(*argUnixFds()));
+            m_receiveProgressListener->handleCompletion(m_message);
+        }
         if (!readTransport()->isOpen()) {
             ret = IO::Status::RemoteClosed;
             break;
         }
-    } while (ioRes.status == IO::Status::OK);
+        // stop when no data is available for now - we'll be called again when there is
+    } while (ioRes.status == IO::Status::OK && ioRes.length);
 
     if (ret != IO::Status::OK) {
         clear();
@@ -885,65 +1011,6 @@ IO::Status MessagePrivate::handleTransportCanRead()
     }
     return ret;
 }
-
-IO::Status MessagePrivate::handleTransportCanWrite()
-{
-    if (m_state != Sending) {
-        return IO::Status::InternalError;
-    }
-    while (true) {
-        assert(m_buffer.length >= m_bufferPos);
-        const uint32 toWrite = m_buffer.length - m_bufferPos;
-        if (!toWrite) {
-            m_state = Serialized;
-            writeTransport()->setWriteListener(nullptr);
-            notifyCompletionListener();
-            break;
-        }
-        IO::Result ioRes;
-        if (m_bufferPos == 0) {
-            const size_t sendFdsCount = m_mainArguments.fileDescriptors().size();
-            if (sendFdsCount == 0) {
-                ioRes = writeTransport()->write(chunk(m_buffer.ptr + m_bufferPos, toWrite));
-            } else if (sendFdsCount > writeTransport()->supportedPassingUnixFdsCount()) {
-                m_error.setCode(Error::SendingTooManyUnixFds);
-                m_state = Serialized;
-                writeTransport()->setWriteListener(nullptr);
-                // ### Oh well, now we have a special Error value to pass through the stack
-                // (for error handling), but also notifyCompletionListener() for sucessful completion
-                // handling. Can we get rid of one or the other, or are there actually good reasons for
-                // the difference?
-                // Pro separation:
-                // - the arguments I came up with for not doing error handling through callbacks
-                // - the ...convenience?... of using callbacks
-                // - possibly better performance of happy path
-                //
-                // Contra separation:
-                // - two different mechanisms for similar things...
-                // - inconsistency - though is that really a problem? the situations are different.
-                // - suddenly IO code needs to ~know (at least pass through and be technically exposed to)
-                //   error values it doesn't know and can't handle itself; theoretically could use some
-                //   error value wrapping mechanism to pass through opaque errors).
-                return IO::Status::PayloadError; // the connection is fine, only this message has a problem
-            } else {
-                ioRes = writeTransport()
-                    ->writeWithFileDescriptors(chunk(m_buffer.ptr + m_bufferPos, toWrite),
-                                               m_mainArguments.fileDescriptors());
-            }
-        } else {
-            ioRes = writeTransport()->write(chunk(m_buffer.ptr + m_bufferPos, toWrite));
-        }
-        if (ioRes.status != IO::Status::OK) {
-            m_error = Error::RemoteDisconnect;
-            m_state = Serialized; // in a way... serialization has completed, unsuccessfully
-            writeTransport()->setWriteListener(nullptr);
-            notifyCompletionListener();
-            return IO::Status::RemoteClosed;
-        }
-        m_bufferPos += ioRes.length;
-    }
-    return IO::Status::OK;
-}
 #endif // !DFERRY_SERDES_ONLY
 
 chunk Message::serializeAndView()
@@ -952,6 +1019,9 @@ chunk Message::serializeAndView()
     if (!d->serialize()) {
         return ret;
     }
+    if (!d->joinSeparateBody()) {
+        return ret;
+    }
     ret = d->m_buffer;
     return ret;
 }
@@ -962,9 +1032,11 @@ std::vector<byte> Message::save()
     if (!d->serialize()) {
         return ret;
     }
-    ret.reserve(d->m_buffer.length);
-    for (uint32 i = 0; i < d->m_buffer.length; i++) {
-        ret.push_back(d->m_buffer.ptr[i]);
+    ret.reserve(d->serializedLength());
+    ret.insert(ret.end(), d->m_buffer.ptr, d->m_buffer.ptr + d->m_buffer.length);
+    if (d->m_bodyIsSeparate) {
+        const chunk body = d->m_mainArguments.data();
+        ret.insert(ret.end(), body.ptr, body.ptr + body.length);
     }
     return ret;
 }
@@ -975,31 +1047,56 @@ void Message::deserializeAndTake(chunk memOwnership)
         free(memOwnership.ptr);
         return;
     }
-    d->m_headerLength = 0;
-    d->m_bodyLength = 0;
-
     d->clearBuffer();
     d->m_buffer = memOwnership;
-    d->m_bufferPos = d->m_buffer.length;
+    d->deserializeBuffer();
+}
 
-    bool ok = d->m_buffer.length >= s_extendedFixedHeaderLength;
-    ok = ok && d->deserializeFixedHeaders();
-    ok = ok && d->m_buffer.length >= d->m_headerLength;
-    ok = ok && d->deserializeVariableHeaders();
-    ok = ok && d->m_buffer.length == d->m_headerLength + d->m_bodyLength;
+void MessagePrivate::deserializeShared(chunk data, std::shared_ptr<const void> owner)
+{
+    assert(m_state < FirstIoState);
+    clearBuffer();
+    m_buffer = data;
+    m_sharedBuffer = new SharedMessageBuffer;
+    m_sharedBuffer->refCount = 1;
+    m_sharedBuffer->buffer = data;
+    m_sharedBuffer->isPooled = false;
+    m_sharedBuffer->owner = std::move(owner);
+    deserializeBuffer();
+}
+
+void MessagePrivate::deserializeBuffer()
+{
+    m_headerLength = 0;
+    m_bodyLength = 0;
+    m_bufferPos = m_buffer.length;
+
+    bool ok = m_buffer.length >= s_extendedFixedHeaderLength;
+    ok = ok && deserializeFixedHeaders();
+    ok = ok && m_buffer.length >= m_headerLength;
+    ok = ok && deserializeVariableHeaders();
+    ok = ok && m_buffer.length == m_headerLength + m_bodyLength;
+    ok = ok && normalizeByteOrder();
 
     if (!ok) {
-        if (!d->m_error.isError()) {
-            d->m_error = Error::MalformedReply;
+        if (!m_error.isError()) {
+            m_error = Error::MalformedReply;
         }
-        d->clear();
+        clear();
         return;
     }
 
-    chunk bodyData(d->m_buffer.ptr + d->m_headerLength, d->m_bodyLength);
-    d->m_mainArguments = Arguments(nullptr, d->m_varHeaders.stringHeaderRaw(SignatureHeader),
-                                   bodyData, d->m_isByteSwapped);
-    d->m_state = MessagePrivate::Serialized;
+    setBodyArguments(m_bodyLength, std::vector<int>());
+    m_state = Serialized;
+}
+
+void MessagePrivate::setBodyArguments(uint32 bodyDataLength, std::vector<int> fileDescriptors)
+{
+    releaseSharedBody();
+    m_mainArguments = Arguments(nullptr, m_varHeaders.stringHeaderRaw(Message::SignatureHeader, m_buffer.ptr),
+                                chunk(m_buffer.ptr + m_headerLength, bodyDataLength),
+                                std::move(fileDescriptors), m_isByteSwapped);
+    m_mainArguments.setValidationLevel(m_validationLevel);
 }
 
 // This does not return bool because full validation of the main arguments would take quite
@@ -1094,6 +1191,9 @@ bool MessagePrivate::deserializeFixedHeaders()
     // peek into the var-length header and use knowledge about array serialization to infer the
     // number of bytes still required for the header
     uint32 varArrayLength = basic::readUint32(p + 2 * sizeof(uint32), m_isByteSwapped);
+    if (varArrayLength > Arguments::MaxArrayLength) {
+        return false;
+    }
     uint32 unpaddedHeaderLength = s_extendedFixedHeaderLength + varArrayLength;
     m_headerLength = align(unpaddedHeaderLength, 8);
     m_headerPadding = m_headerLength - unpaddedHeaderLength;
@@ -1101,105 +1201,167 @@ bool MessagePrivate::deserializeFixedHeaders()
     return m_headerLength + m_bodyLength <= Arguments::MaxMessageLength;
 }
 
-bool MessagePrivate::deserializeVariableHeaders()
-{
-    // use Arguments to parse the variable header fields
-    // HACK: the fake first int argument is there to start the Arguments's data 8 byte aligned
-    byte *base = m_buffer.ptr + s_properFixedHeaderLength - sizeof(int32);
-    chunk headerData(base, m_headerLength - m_headerPadding - s_properFixedHeaderLength + sizeof(int32));
-    cstring varHeadersSig("ia(yv)");
-    Arguments argList(nullptr, varHeadersSig, headerData, m_isByteSwapped);
+// The variable header fields are an array of type a(yv) whose layout is fixed by the spec, so we parse
+// and write them directly instead of using the generic Arguments::Reader and Writer. The results of
+// parsing must be exactly the same as those of the Reader, though - see also tst_message.
+//
+// Layout of a field: the struct starts 8-byte aligned, then code (y), variant signature length (always 1),
+// variant signature letter, null, and at offset 4, which is the right alignment for all header types:
+// 'u': uint32 value | 's', 'o': uint32 length, string, null | 'g': byte length, string, null
 
-    Arguments::Reader reader(argList);
-    assert(reader.isValid());
-
-    if (reader.state() != Arguments::Int32) {
-        return false;
-    }
-    reader.readInt32();
-    if (reader.state() != Arguments::BeginArray) {
-        return false;
+static char letterForHeader(int field)
+{
+    switch (field) {
+    case Message::PathHeader:
+        return 'o';
+    case Message::SignatureHeader:
+        return 'g';
+    default:
+        return isStringHeader(field) ? 's' : 'u';
     }
-    reader.beginArray();
+}
 
-    while (reader.state() == Arguments::BeginStruct) {
-        reader.beginStruct();
-        const byte headerField = reader.readByte();
-        if (headerField < Message::PathHeader || headerField > Message::UnixFdsHeader) {
+bool MessagePrivate::deserializeVariableHeaders()
+{
+    const byte *const base = m_buffer.ptr;
+    const uint32 end = m_headerLength - m_headerPadding; // end of the field array
+    const Arguments::ValidationLevel level = m_validationLevel;
+    const chunk fieldData(m_buffer.ptr, end);
+
+    uint32 pos = s_extendedFixedHeaderLength;
+    while (pos < end) {
+        const uint32 fieldStart = align(pos, 8);
+        if (unlikely(fieldStart + 4 > end)) {
+            return false;
+        }
+        if (unlikely(level != Arguments::TrustedData && !isPaddingZero(fieldData, pos, fieldStart))) {
+            return false;
+        }
+        const byte *const field = base + fieldStart;
+        const byte headerField = field[0];
+        if (unlikely(headerField < Message::PathHeader || headerField > Message::UnixFdsHeader)) {
+            return false;
+        }
+        // the variant signature must be exactly the right type
+        const char letter = letterForHeader(headerField);
+        if (unlikely(field[1] != 1 || field[2] != letter || field[3] != '\0')) {
             return false;
         }
         const Message::VariableHeader eHeader = static_cast<Message::VariableHeader>(headerField);
+        const uint32 valueStart = fieldStart + 4;
+
+        if (letter == 'u') {
+            pos = valueStart + sizeof(uint32);
+            if (unlikely(pos > end ||
+                         !m_varHeaders.setIntHeader_deser(eHeader, basic::readUint32(base + valueStart,
+                                                                                     m_isByteSwapped)))) {
+                return false;
+            }
+            continue;
+        }
 
-        reader.beginVariant();
-
-        bool ok = true; // short-circuit evaluation ftw
-        if (isStringHeader(headerField)) {
-            if (headerField == Message::PathHeader) {
-                ok = ok && reader.state() == Arguments::ObjectPath;
-                ok = ok && m_varHeaders.setStringHeader_deser(eHeader, reader.readObjectPath());
-            } else if (headerField == Message::SignatureHeader) {
-                ok = ok && reader.state() == Arguments::Signature;
-                // The spec allows having no signature header, which means "empty signature". However...
-                // We do not drop empty signature headers when deserializing, in order to preserve
-                // the original message contents. This could be useful for debugging and testing.
-                ok = ok && m_varHeaders.setStringHeader_deser(eHeader, reader.readSignature());
-            } else {
-                ok = ok && reader.state() == Arguments::String;
-                ok = ok && m_varHeaders.setStringHeader_deser(eHeader, reader.readString());
+        uint32 stringStart;
+        uint32 length;
+        if (letter == 'g') {
+            stringStart = valueStart + 1;
+            if (unlikely(stringStart > end)) {
+                return false;
             }
+            length = base[valueStart];
         } else {
-            ok = ok && reader.state() == Arguments::Uint32;
-            ok = ok && m_varHeaders.setIntHeader_deser(eHeader, reader.readUint32());
+            stringStart = valueStart + sizeof(uint32);
+            if (unlikely(stringStart > end)) {
+                return false;
+            }
+            length = basic::readUint32(base + valueStart, m_isByteSwapped);
+            if (unlikely(length >= Arguments::MaxArrayLength - 2)) { // same limit as the Reader
+                return false;
+            }
         }
-
-        if (!ok) {
+        pos = stringStart + length + 1;
+        if (unlikely(pos > end)) {
+            return false;
+        }
+        const cstring value(reinterpret_cast<const char *>(base) + stringStart, length);
+        bool isValid;
+        if (letter == 'g') {
+            // the signature of the body determines how to parse it, so it is checked at every level
+            isValid = Arguments::isSignatureValid(value);
+        } else if (level != Arguments::FullValidation) {
+            isValid = value.ptr[length] == '\0';
+        } else if (letter == 'o') {
+            isValid = Arguments::isObjectPathValid(value);
+        } else {
+            isValid = Arguments::isStringValid(value);
+        }
+        // The spec allows having no signature header, which means "empty signature". However...
+        // We do not drop empty signature headers when deserializing, in order to preserve
+        // the original message contents. This could be useful for debugging and testing.
+        if (unlikely(!isValid || !m_varHeaders.setStringHeader_deser(eHeader, value, base))) {
             return false;
         }
-        reader.endVariant();
-        reader.endStruct();
     }
-    reader.endArray();
 
     // check that header->body padding is in fact zero filled
-    base = m_buffer.ptr;
-    for (uint32 i = m_headerLength - m_headerPadding; i < m_headerLength; i++) {
+    for (uint32 i = end; i < m_headerLength && level != Arguments::TrustedData; i++) {
         if (base[i] != '\0') {
             return false;
         }
     }
+    return true;
+}
 
-    return reader.isFinished();
+bool MessagePrivate::normalizeByteOrder()
+{
+    // Convert a message in the other byte order to native byte order once, here. Afterwards, reading the
+    // body takes the non-swapping fast paths (e.g. for primitive arrays), and the serialized data remains
+    // consistent with the endianness flag in case the message is saved or forwarded.
+    if (!m_isByteSwapped) {
+        return true;
+    }
+    static const cstring headerSignature("yyyyuua(yv)");
+    if (!swapByteOrder(headerSignature, Arguments::MethodSignature,
+                       chunk(m_buffer.ptr, m_headerLength - m_headerPadding), true)) {
+        return false;
+    }
+    if (m_bodyLength) {
+        const cstring signature = m_varHeaders.stringHeaderRaw(Message::SignatureHeader, m_buffer.ptr);
+        if (!swapByteOrder(signature, Arguments::MethodSignature,
+                           chunk(m_buffer.ptr + m_headerLength, m_bodyLength), true)) {
+            return false;
+        }
+    }
+    m_buffer.ptr[0] = s_thisMachineEndianness;
+    m_isByteSwapped = false;
+    return true;
 }
 
 bool MessagePrivate::serialize()
 {
     if ((m_state == Serialized || m_state == Sending) && !m_dirty) {
-        return true;
+        // a message from MessageTemplate is serialized except for the serial, which setSerial() patches in
+        return m_serial != 0;
     }
     if (m_state >= FirstIoState) { // Marshalled data must not be touched while doing I/O
         return false;
     }
 
+    // The arguments of a received message point into the buffer that is about to be replaced
+    if (argumentsPointIntoBuffer()) {
+        Arguments ownArguments(m_mainArguments);
+        m_mainArguments = std::move(ownArguments);
+    }
     clearBuffer();
 
     if (m_error.isError() || !requiredHeadersPresent()) {
         return false;
     }
 
-    Arguments headerArgs = serializeVariableHeaders();
-    if (headerArgs.data().length <= 0) {
+    const uint32 fieldsLength = variableHeadersLength();
+    if (!fieldsLength) {
         return false;
     }
-
-    // we need to cut out alignment padding bytes 4 to 7 in the variable header data stream because
-    // the original dbus code aligns based on address in the final data stream
-    // (offset s_properFixedHeaderLength == 12), we align based on address in the Arguments's buffer
-    // (offset 0) - note that our modification keeps the stream valid because length is measured from end
-    // of padding
-
-    assert(headerArgs.data().length > 0); // if this fails the headerLength hack will break down
-
-    const uint32 unalignedHeaderLength = s_properFixedHeaderLength + headerArgs.data().length - sizeof(uint32);
+    const uint32 unalignedHeaderLength = s_extendedFixedHeaderLength + fieldsLength;
     m_headerLength = align(unalignedHeaderLength, 8);
     m_bodyLength = m_mainArguments.data().length;
     const uint32 messageLength = m_headerLength + m_bodyLength;
@@ -1209,25 +1371,27 @@ bool MessagePrivate::serialize()
         return false;
     }
 
-    reserveBuffer(messageLength);
+    // Large bodies are not copied into the message buffer, they are sent directly from the buffer of
+    // m_mainArguments. Small ones are copied because one contiguous buffer is cheaper to handle.
+    m_bodyIsSeparate = m_bodyLength >= s_separateBodyMinLength;
+    reserveBuffer(m_bodyIsSeparate ? m_headerLength : messageLength);
 
     serializeFixedHeaders();
-
-    // copy header data: uint32 length...
-    memcpy(m_buffer.ptr + s_properFixedHeaderLength, headerArgs.data().ptr, sizeof(uint32));
-    // skip four bytes of padding and copy the rest
-    memcpy(m_buffer.ptr + s_properFixedHeaderLength + sizeof(uint32),
-           headerArgs.data().ptr + 2 * sizeof(uint32),
-           headerArgs.data().length - 2 * sizeof(uint32));
+    basic::writeUint32(m_buffer.ptr + s_properFixedHeaderLength, fieldsLength);
+    serializeVariableHeaders(m_buffer.ptr + s_extendedFixedHeaderLength);
     // zero padding between variable headers and message body
     for (uint32 i = unalignedHeaderLength; i < m_headerLength; i++) {
         m_buffer.ptr[i] = '\0';
     }
     // copy message body (if any - arguments are not mandatory)
-    if (m_mainArguments.data().length) {
-        memcpy(m_buffer.ptr + m_headerLength, m_mainArguments.data().ptr, m_mainArguments.data().length);
+    if (m_bodyIsSeparate) {
+        m_bufferPos = m_headerLength;
+    } else {
+        if (m_bodyLength) {
+            memcpy(m_buffer.ptr + m_headerLength, m_mainArguments.data().ptr, m_bodyLength);
+        }
+        m_bufferPos = m_headerLength + m_bodyLength;
     }
-    m_bufferPos = m_headerLength + m_mainArguments.data().length;
     assert(m_bufferPos <= m_buffer.length);
 
     // for the upcoming message sending, "reuse" m_bufferPos for read position (formerly write position),
@@ -1240,6 +1404,45 @@ bool MessagePrivate::serialize()
     return true;
 }
 
+uint32 MessagePrivate::serializedLength() const
+{
+    return m_bodyIsSeparate ? m_buffer.length + m_bodyLength : m_buffer.length;
+}
+
+uint32 MessagePrivate::unsentData(chunk *data) const
+{
+    uint32 count = 0;
+    if (m_bufferPos < m_buffer.length) {
+        data[count++] = chunk(m_buffer.ptr + m_bufferPos, m_buffer.length - m_bufferPos);
+    }
+    if (m_bodyIsSeparate) {
+        const uint32 bodyPos = m_bufferPos > m_buffer.length ? m_bufferPos - m_buffer.length : 0;
+        if (bodyPos < m_bodyLength) {
+            data[count++] = chunk(m_mainArguments.data().ptr + bodyPos, m_bodyLength - bodyPos);
+        }
+    }
+    return count;
+}
+
+bool MessagePrivate::joinSeparateBody()
+{
+    if (!m_bodyIsSeparate) {
+        return true;
+    }
+    if (m_state != Serialized) { // don't move data around during I/O
+        return false;
+    }
+    assert(!m_bufferIsPooled); // only received messages have pooled buffers
+    const uint32 length = m_buffer.length + m_bodyLength;
+    byte *const joined = static_cast<byte *>(malloc(length));
+    memcpy(joined, m_buffer.ptr, m_buffer.length);
+    memcpy(joined + m_buffer.length, m_mainArguments.data().ptr, m_bodyLength);
+    free(m_buffer.ptr);
+    m_buffer = chunk(joined, length);
+    m_bodyIsSeparate = false;
+    return true;
+}
+
 void MessagePrivate::serializeFixedHeaders()
 {
     assert(m_buffer.length >= s_extendedFixedHeaderLength);
@@ -1254,75 +1457,192 @@ void MessagePrivate::serializeFixedHeaders()
     basic::writeUint32(p + sizeof(uint32), m_serial);
 }
 
-static void doVarHeaderPrologue(Arguments::Writer *writer, Message::VariableHeader field)
+uint32 MessagePrivate::variableHeadersLength()
 {
-    writer->beginStruct();
-    writer->writeByte(byte(field));
-}
-
-Arguments MessagePrivate::serializeVariableHeaders()
-{
-    Arguments::Writer writer;
-
-    // note that we don't have to deal with empty arrays because all valid message types require
-    // at least one of the variable headers
-    writer.beginArray();
+    static const Error::Code stringHeaderErrors[VarHeaderStorage::s_stringHeaderCount] = {
+        Error::MessagePath,
+        Error::MessageInterface,
+        Error::MessageMethod,
+        Error::MessageErrorName,
+        Error::MessageDestination,
+        Error::MessageSender,
+        Error::MessageSignature
+    };
 
+    uint32 length = 0;
     for (int i = 0; i < VarHeaderStorage::s_stringHeaderCount; i++) {
         const Message::VariableHeader field = s_stringHeaderAtIndex[i];
         if (m_varHeaders.hasHeader(field)) {
-            doVarHeaderPrologue(&writer, field);
-
-            const std::string &str = m_varHeaders.stringHeaders()[i];
+            const cstring value = m_varHeaders.stringHeaderRaw(field, m_buffer.ptr);
+            bool isValid;
             if (field == Message::PathHeader) {
-                writer.writeVariantForMessageHeader('o');
-                writer.writeObjectPath(cstring(str.c_str(), str.length()));
+                isValid = Arguments::isObjectPathValid(value);
             } else if (field == Message::SignatureHeader) {
-                writer.writeVariantForMessageHeader('g');
-                writer.writeSignature(cstring(str.c_str(), str.length()));
+                isValid = Arguments::isSignatureValid(value);
             } else {
-                writer.writeVariantForMessageHeader('s');
-                writer.writeString(cstring(str.c_str(), str.length()));
+                isValid = Arguments::isStringValid(value);
             }
-
-            writer.fixupAfterWriteVariantForMessageHeader();
-            writer.endStruct();
-
-            if (unlikely(writer.error().isError())) {
-                static const Error::Code stringHeaderErrors[VarHeaderStorage::s_stringHeaderCount] = {
-                    Error::MessagePath,
-                    Error::MessageInterface,
-                    Error::MessageMethod,
-                    Error::MessageErrorName,
-                    Error::MessageDestination,
-                    Error::MessageSender,
-                    Error::MessageSignature
-                };
+            if (unlikely(!isValid)) {
                 m_error.setCode(stringHeaderErrors[i]);
-                return Arguments();
+                return 0;
             }
+            const uint32 lengthPrefixSize = field == Message::SignatureHeader ? 1 : sizeof(uint32);
+            length = align(length, 8) + 4 + lengthPrefixSize + value.length + 1;
         }
     }
+    for (int i = 0; i < VarHeaderStorage::s_intHeaderCount; i++) {
+        if (m_varHeaders.hasHeader(s_intHeaderAtIndex[i])) {
+            length = align(length, 8) + 4 + sizeof(uint32);
+        }
+    }
+    if (length > Arguments::MaxArrayLength) {
+        m_error.setCode(Error::ArgumentsTooLong);
+        return 0;
+    }
+    // note that we don't have to deal with empty arrays because all valid message types require
+    // at least one of the variable headers
+    assert(length);
+    return length;
+}
 
+// Write a header field at *pos in fields, which must be 8-byte aligned in the message
+static void writeStringField(byte *fields, uint32 *pos, Message::VariableHeader field, cstring value)
+{
+    zeroPad(fields, 8, pos);
+    byte *p = fields + *pos;
+    *p++ = byte(field);
+    *p++ = 1;
+    *p++ = byte(letterForHeader(field));
+    *p++ = '\0';
+    if (field == Message::SignatureHeader) {
+        *p++ = byte(value.length);
+    } else {
+        basic::writeUint32(p, value.length);
+        p += sizeof(uint32);
+    }
+    memcpy(p, value.ptr, value.length);
+    p += value.length;
+    *p++ = '\0';
+    *pos = uint32(p - fields);
+}
+
+static void writeIntField(byte *fields, uint32 *pos, Message::VariableHeader field, uint32 value)
+{
+    zeroPad(fields, 8, pos);
+    byte *const p = fields + *pos;
+    p[0] = byte(field);
+    p[1] = 1;
+    p[2] = byte(letterForHeader(field));
+    p[3] = '\0';
+    basic::writeUint32(p + 4, value);
+    *pos += 4 + sizeof(uint32);
+}
+
+void MessagePrivate::serializeVariableHeaders(byte *fields)
+{
+    // the checks have been done in variableHeadersLength()
+    uint32 pos = 0;
+    for (int i = 0; i < VarHeaderStorage::s_stringHeaderCount; i++) {
+        const Message::VariableHeader field = s_stringHeaderAtIndex[i];
+        if (m_varHeaders.hasHeader(field)) {
+            writeStringField(fields, &pos, field, m_varHeaders.stringHeaderRaw(field, m_buffer.ptr));
+        }
+    }
     for (int i = 0; i < VarHeaderStorage::s_intHeaderCount; i++) {
         const Message::VariableHeader field = s_intHeaderAtIndex[i];
         if (m_varHeaders.hasHeader(field)) {
-            doVarHeaderPrologue(&writer, field);
-            writer.writeVariantForMessageHeader('u');
-            writer.writeUint32(m_varHeaders.m_intHeaders[i]);
-            writer.fixupAfterWriteVariantForMessageHeader();
-            writer.endStruct();
+            writeIntField(fields, &pos, field, m_varHeaders.m_intHeaders[i]);
         }
     }
+}
+
+bool MessagePrivate::initFromHeaderTemplate(const MessagePrivate &t, Arguments *arguments, cstring destination)
+{
+    assert(m_state == Empty && !m_buffer.ptr);
+    assert(t.m_state == Serialized && !t.m_varHeaders.hasHeader(Message::DestinationHeader));
+    if (arguments->error().isError() || !arguments->fileDescriptors().empty() ||
+        t.m_varHeaders.hasHeader(Message::UnixFdsHeader)) {
+        return false;
+    }
+    // stringHeaderRaw() doesn't actually modify anything
+    const cstring templateSignature = const_cast<VarHeaderStorage &>(t.m_varHeaders)
+                                          .stringHeaderRaw(Message::SignatureHeader, t.m_buffer.ptr);
+    const cstring signature = arguments->signature();
+    if (signature.length != templateSignature.length ||
+        (signature.length && memcmp(signature.ptr, templateSignature.ptr, signature.length) != 0)) {
+        return false;
+    }
+    if (destination.length && !Arguments::isStringValid(destination)) {
+        return false;
+    }
+
+    const uint32 templateFieldsLength = basic::readUint32(t.m_buffer.ptr + s_properFixedHeaderLength,
+                                                          t.m_isByteSwapped);
+    uint32 fieldsLength = templateFieldsLength;
+    if (destination.length) {
+        fieldsLength = align(fieldsLength, 8) + 4 + sizeof(uint32) + destination.length + 1;
+    }
+    const uint32 unalignedHeaderLength = s_extendedFixedHeaderLength + fieldsLength;
+    const uint32 headerLength = align(unalignedHeaderLength, 8);
+    const uint32 bodyLength = arguments->data().length;
+    if (fieldsLength > Arguments::MaxArrayLength || headerLength + bodyLength > Arguments::MaxMessageLength) {
+        return false;
+    }
 
-    writer.endArray();
-    return writer.finish();
+    m_messageType = t.m_messageType;
+    m_flags = t.m_flags;
+    m_protocolVersion = t.m_protocolVersion;
+    m_headerLength = headerLength;
+    m_bodyLength = bodyLength;
+    m_bodyIsSeparate = m_bodyLength >= s_separateBodyMinLength;
+    reserveBuffer(m_bodyIsSeparate ? m_headerLength : m_headerLength + m_bodyLength);
+
+    // the string headers of the template are raw, so they refer to the copied header data just the same
+    memcpy(m_buffer.ptr, t.m_buffer.ptr, s_extendedFixedHeaderLength + templateFieldsLength);
+    m_varHeaders = t.m_varHeaders;
+    if (destination.length) {
+        byte *const fields = m_buffer.ptr + s_extendedFixedHeaderLength;
+        uint32 pos = templateFieldsLength;
+        writeStringField(fields, &pos, Message::DestinationHeader, destination);
+        const cstring value(reinterpret_cast<char *>(fields) + pos - 1 - destination.length, destination.length);
+        m_varHeaders.setStringHeader_deser(Message::DestinationHeader, value, m_buffer.ptr);
+    }
+    serializeFixedHeaders();
+    basic::writeUint32(m_buffer.ptr + s_properFixedHeaderLength, fieldsLength);
+    for (uint32 i = unalignedHeaderLength; i < m_headerLength; i++) {
+        m_buffer.ptr[i] = '\0';
+    }
+
+    if (m_bodyIsSeparate) {
+        m_buffer.length = m_headerLength;
+    } else {
+        if (m_bodyLength) {
+            memcpy(m_buffer.ptr + m_headerLength, arguments->data().ptr, m_bodyLength);
+        }
+        m_buffer.length = m_headerLength + m_bodyLength;
+    }
+    m_bufferPos = 0;
+    m_mainArguments = std::move(*arguments);
+    m_error = Error();
+    m_dirty = false;
+    m_state = Serialized;
+    return true;
 }
 
 void MessagePrivate::clearBuffer()
 {
-    if (m_buffer.ptr) {
-        free(m_buffer.ptr);
+    m_bodyIsSeparate = false;
+    if (m_sharedBuffer) {
+        m_varHeaders.materializeRawStringHeaders(m_buffer.ptr);
+        releaseSharedBuffer(/* keepFileDescriptors = */ true);
+    } else if (m_buffer.ptr) {
+        m_varHeaders.materializeRawStringHeaders(m_buffer.ptr);
+        if (m_bufferIsPooled) {
+            m_pool->freeBuffer(m_buffer.ptr, m_buffer.length);
+            m_bufferIsPooled = false;
+        } else {
+            free(m_buffer.ptr);
+        }
         m_buffer = chunk();
         m_bufferPos = 0;
     } else {
@@ -1333,7 +1653,13 @@ void MessagePrivate::clearBuffer()
 
 void MessagePrivate::clear(bool onlyReleaseResources)
 {
+    // either the headers are reset to empty or we are being destroyed, so don't bother copying them
+    m_varHeaders.forgetRawStringHeaders();
+    if (m_sharedBuffer) {
+        releaseSharedBuffer(/* keepFileDescriptors = */ false);
+    }
     clearBuffer();
+    releaseSharedBody();
 #ifdef __unix__
     for (int fd : *argUnixFds()) {
         ::close(fd);
@@ -1346,15 +1672,117 @@ void MessagePrivate::clear(bool onlyReleaseResources)
     }
 }
 
-static uint32 nextPowerOf2(uint32 x)
+bool MessagePrivate::argumentsPointIntoBuffer() const
+{
+    // <= because the body of a message without arguments starts at the end of the buffer
+    const byte *const argumentsData = m_mainArguments.data().ptr;
+    return argumentsData && argumentsData >= m_buffer.ptr && argumentsData <= m_buffer.ptr + m_buffer.length;
+}
+
+bool MessagePrivate::canShareBuffer() const
 {
-    --x;
-    x |= x >> 1;
-    x |= x >> 2;
-    x |= x >> 4;
-    x |= x >> 8;
-    x |= x >> 16;
-    return ++x;
+    return m_state == Serialized && m_buffer.ptr && (m_sharedBuffer || argumentsPointIntoBuffer());
+}
+
+void MessagePrivate::shareBuffer()
+{
+    if (m_sharedBuffer) {
+        return;
+    }
+    m_sharedBuffer = new SharedMessageBuffer;
+    m_sharedBuffer->refCount = 1;
+    m_sharedBuffer->buffer = m_buffer;
+    m_sharedBuffer->isPooled = m_bufferIsPooled;
+    m_sharedBuffer->pool = m_pool;
+    m_sharedBuffer->fileDescriptors = *argUnixFds();
+    m_bufferIsPooled = false;
+}
+
+static void dereferenceSharedBuffer(SharedMessageBuffer *shared)
+{
+    if (--shared->refCount == 0) {
+        if (shared->isPooled) {
+            shared->pool->freeBuffer(shared->buffer.ptr, shared->buffer.length);
+        } else if (!shared->owner) {
+            free(shared->buffer.ptr);
+        }
+#ifdef __unix__
+        for (int fd : shared->fileDescriptors) {
+            ::close(fd);
+        }
+#endif
+        delete shared;
+    }
+}
+
+void MessagePrivate::releaseSharedBuffer(bool keepFileDescriptors)
+{
+    SharedMessageBuffer *const shared = m_sharedBuffer;
+    m_sharedBuffer = nullptr;
+    m_buffer = chunk();
+    m_bufferPos = 0;
+#ifdef __unix__
+    if (keepFileDescriptors) {
+        // other copies may still use (and later close) them
+        for (int &fd : *argUnixFds()) {
+            fd = ::dup(fd);
+        }
+    } else {
+        argUnixFds()->clear();
+    }
+#else
+    (void)keepFileDescriptors;
+#endif
+
+    dereferenceSharedBuffer(shared);
+}
+
+void MessagePrivate::adoptArguments(Arguments arguments, SharedMessageBuffer *sharedBody)
+{
+    if (m_sharedBuffer) {
+        detachSharedBuffer();
+    }
+    releaseSharedBody();
+    m_sharedBody = sharedBody;
+    m_dirty = true;
+    m_error = arguments.error();
+    const size_t fdCount = arguments.fileDescriptors().size();
+    if (fdCount) {
+        m_varHeaders.setIntHeader(Message::UnixFdsHeader, fdCount);
+    } else {
+        m_varHeaders.clearIntHeader(Message::UnixFdsHeader);
+    }
+
+    cstring signature = arguments.signature();
+    if (signature.length) {
+        m_varHeaders.setStringHeader(Message::SignatureHeader, toStdString(signature));
+    } else {
+        m_varHeaders.clearStringHeader(Message::SignatureHeader);
+    }
+    m_mainArguments = std::move(arguments);
+}
+
+void MessagePrivate::releaseSharedBody()
+{
+    if (!m_sharedBody) {
+        return;
+    }
+    argUnixFds()->clear(); // they belong to m_sharedBody
+    dereferenceSharedBuffer(m_sharedBody);
+    m_sharedBody = nullptr;
+}
+
+void MessagePrivate::detachSharedBuffer()
+{
+    const chunk sharedBuffer = m_buffer;
+    const uint32 bufferPos = m_bufferPos;
+    byte *const copy = static_cast<byte *>(malloc(sharedBuffer.length));
+    memcpy(copy, sharedBuffer.ptr, sharedBuffer.length);
+    releaseSharedBuffer(/* keepFileDescriptors = */ true);
+
+    m_buffer = chunk(copy, sharedBuffer.length);
+    m_bufferPos = bufferPos;
+    setBodyArguments(m_bodyLength, std::move(*argUnixFds()));
 }
 
 void MessagePrivate::reserveBuffer(uint32 newLen)
@@ -1363,12 +1791,25 @@ void MessagePrivate::reserveBuffer(uint32 newLen)
     if (newLen <= oldLen) {
         return;
     }
+    if (m_pool && m_state == Receiving) {
+        assert(!oldLen || m_bufferIsPooled);
+        uint32 capacity = 0;
+        byte *const newAlloc = m_pool->allocateBuffer(newLen, &capacity);
+        if (oldLen) {
+            memcpy(newAlloc, m_buffer.ptr, m_bufferPos);
+            m_pool->freeBuffer(m_buffer.ptr, oldLen);
+        }
+        m_buffer = chunk(newAlloc, capacity);
+        m_bufferIsPooled = true;
+        return;
+    }
+    assert(!m_bufferIsPooled);
     if (newLen <= 256) {
         assert(oldLen == 0);
         newLen = 256;
         m_buffer.ptr = reinterpret_cast<byte *>(msgAllocCaches.msgBuffer.allocate());
     } else {
-        newLen = nextPowerOf2(newLen);
+        newLen = MessagePool::bufferCapacity(newLen);
         if (oldLen == 256) {
             byte *newAlloc = reinterpret_cast<byte *>(malloc(newLen));
             memcpy(newAlloc, m_buffer.ptr, oldLen);
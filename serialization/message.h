@@ -27,11 +27,13 @@
 #include "arguments.h"
 #include "types.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
 class Arguments;
 class Error;
+class MessagePool;
 class MessagePrivate;
 
 class DFERRY_EXPORT Message
@@ -99,6 +101,9 @@ public:
     // completely valid state before that anyway. Yes, we could validate some things, but let's just
     // do it all at once.
     std::string stringHeader(VariableHeader header, bool *isPresent = nullptr) const;
+    // Like stringHeader(), but without copying. The returned view is only valid until the next call
+    // of a non-const method.
+    cstring stringHeaderView(VariableHeader header, bool *isPresent = nullptr) const;
     void setStringHeader(VariableHeader header, const std::string &value);
     uint32 intHeader(VariableHeader header, bool *isPresent = nullptr) const;
     void setIntHeader(VariableHeader header, uint32 value);
@@ -134,6 +139,12 @@ public:
 
     // setArguments also sets the signature header of the message
     void setArguments(Arguments arguments);
+    // Like setArguments(message.arguments()), but for forwarding the body of a received (or loaded)
+    // message: the body data, signature and file descriptors are shared with message instead of being
+    // copied and validated again, and sending this message does not copy large bodies either. If
+    // message is not received or loaded, its arguments are copied.
+    // Like copying a Message, this is not thread-safe regarding message.
+    void setArgumentsFrom(const Message &message);
     const Arguments &arguments() const;
 
     std::vector<byte> save();
@@ -162,6 +173,8 @@ public:
 
 private:
     friend class MessagePrivate;
+    // for received messages, which take their memory from the pool and return it there
+    explicit Message(const std::shared_ptr<MessagePool> &pool);
     MessagePrivate *d;
 };
 
@@ -28,24 +28,47 @@
 
 #include "arguments.h"
 #include "error.h"
+#ifndef DFERRY_SERDES_ONLY
 #include "itransportlistener.h"
+#endif
+#include "messagepool.h"
 
+#include <atomic>
+#include <memory>
 #include <type_traits>
+#include <vector>
 
 class ICompletionListener;
 
+// The buffer of a received message, shared between copies of the message so that delivering it to
+// several receivers doesn't copy it. It is immutable, a message that is modified gets its own copy first.
+// It also owns the file descriptors of the message.
+struct SharedMessageBuffer
+{
+    std::atomic<uint32> refCount;
+    chunk buffer;
+    bool isPooled; // like MessagePrivate::m_bufferIsPooled
+    std::shared_ptr<MessagePool> pool;
+    std::shared_ptr<const void> owner; // if not null, buffer belongs to it instead, e.g. a file mapping
+    std::vector<int> fileDescriptors;
+};
+
 class VarHeaderStorage {
 public:
     VarHeaderStorage();
+    // Copies "raw" string headers as offsets, so the buffer they refer to must be copied along
     VarHeaderStorage(const VarHeaderStorage &other);
     ~VarHeaderStorage();
     VarHeaderStorage &operator=(const VarHeaderStorage &other);
 
     bool hasHeader(Message::VariableHeader header) const;
 
+    // String headers of received messages are stored "raw", as offset and length in the message buffer,
+    // and only copied into a std::string when they are modified or when the buffer goes away. Getters
+    // of string headers need the buffer because of that.
     bool hasStringHeader(Message::VariableHeader header) const;
-    std::string stringHeader(Message::VariableHeader header) const;
-    cstring stringHeaderRaw(Message::VariableHeader header);
+    std::string stringHeader(Message::VariableHeader header, const byte *buffer) const;
+    cstring stringHeaderRaw(Message::VariableHeader header, const byte *buffer);
     void setStringHeader(Message::VariableHeader header, const std::string &value);
     void clearStringHeader(Message::VariableHeader header);
 
@@ -57,7 +80,13 @@ public:
     // for use during header deserialization: returns false if a header occurs twice,
     // but does not check if the given header is of the right type (int / string).
     bool setIntHeader_deser(Message::VariableHeader header, uint32 value);
-    bool setStringHeader_deser(Message::VariableHeader header, cstring value);
+    // value must point into buffer
+    bool setStringHeader_deser(Message::VariableHeader header, cstring value, const byte *buffer);
+
+    // copy raw string headers out of buffer before it is freed or overwritten
+    void materializeRawStringHeaders(const byte *buffer);
+    // drop the raw string headers without looking at the buffer, e.g. when it's going away with us
+    void forgetRawStringHeaders();
 
     const std::string *stringHeaders() const
     {
@@ -68,6 +97,25 @@ public:
         return reinterpret_cast<std::string *>(m_stringStorage);
     }
 
+    struct RawStringHeader
+    {
+        uint32 offset;
+        uint32 length;
+    };
+    // raw string headers live in the same storage as the std::strings they might become
+    const RawStringHeader &rawStringHeader(int index) const
+    {
+        return *reinterpret_cast<const RawStringHeader *>(m_stringStorage + index);
+    }
+    RawStringHeader &rawStringHeader(int index)
+    {
+        return *reinterpret_cast<RawStringHeader *>(m_stringStorage + index);
+    }
+    bool isRawStringHeader(Message::VariableHeader header) const
+    {
+        return m_rawStringHeaderBitmap & (1u << header);
+    }
+
     static const int s_stringHeaderCount = 7;
     static const int s_intHeaderCount = 2;
 
@@ -75,39 +123,78 @@ public:
     std::aligned_storage<sizeof(std::string)>::type m_stringStorage[VarHeaderStorage::s_stringHeaderCount];
     uint32 m_intHeaders[s_intHeaderCount];
     uint32 m_headerPresenceBitmap = 0;
+    uint32 m_rawStringHeaderBitmap = 0; // subset of m_headerPresenceBitmap
 };
 
-class MessagePrivate : public ITransportListener
+class MessagePrivate
+#ifndef DFERRY_SERDES_ONLY
+    : public ITransportListener
+#endif
 {
 public:
     static MessagePrivate *get(Message *m) { return m->d; }
 
     MessagePrivate(Message *parent);
     MessagePrivate(const MessagePrivate &other, Message *parent);
+#ifndef DFERRY_SERDES_ONLY
     ~MessagePrivate() override;
 
     IO::Status handleTransportCanRead() override;
-    IO::Status handleTransportCanWrite() override;
 
     // ITransport is non-public API, so these make no sense in the public interface
     void receive(ITransport *transport); // fills in this message from transport
-    void send(ITransport *transport); // sends this message over transport
+#else
+    ~MessagePrivate();
+#endif
     // for receive or send completion (it should be clear which because receiving and sending can't
     // happen simultaneously)
     void setCompletionListener(ICompletionListener *listener);
+    // For streaming reception: while the body of a message with a body of at least minBodyLength bytes is
+    // arriving, m_mainArguments contains the part received so far, and listener is notified of new data.
+    void setReceiveProgressListener(ICompletionListener *listener, uint32 minBodyLength);
 
     bool requiredHeadersPresent();
     Error checkRequiredHeaders() const;
     bool deserializeFixedHeaders();
     bool deserializeVariableHeaders();
+    void deserializeBuffer(); // the common part of deserializeAndTake() and deserializeShared()
+    // Like Message::deserializeAndTake(), but data belongs to owner, which the message (and its copies,
+    // which share data) keep alive. data is converted to native byte order in place if necessary.
+    void deserializeShared(chunk data, std::shared_ptr<const void> owner);
+    // sets m_mainArguments to the first bodyDataLength bytes of the body in m_buffer
+    void setBodyArguments(uint32 bodyDataLength, std::vector<int> fileDescriptors);
+    bool normalizeByteOrder();
     bool serialize();
     void serializeFixedHeaders();
-    Arguments serializeVariableHeaders();
+    // Checks the headers and returns the length of the serialized header field array, or 0 on error
+    uint32 variableHeadersLength();
+    void serializeVariableHeaders(byte *fields); // writes variableHeadersLength() bytes
+    // For MessageTemplate: puts this empty message into serialized state with the header of headerTemplate,
+    // plus destination, and arguments as body - without going through the regular serialization. Returns
+    // false (and changes nothing) if that is not possible, e.g. because the signatures don't match.
+    bool initFromHeaderTemplate(const MessagePrivate &headerTemplate, Arguments *arguments, cstring destination);
+    // After serialize(), the message is in m_buffer - except for a large body, which stays in m_mainArguments
+    // to avoid copying it. These help dealing with that.
+    uint32 serializedLength() const;
+    uint32 unsentData(chunk *data) const; // fills in up to two chunks (header and body), returns count
+    bool joinSeparateBody(); // copy everything into m_buffer, for API that needs one contiguous buffer
 
     void clearBuffer();
     void clear(bool onlyReleaseResources = false);
+    // For sharing the buffer with copies, the message must be received or deserialized, and idle
+    bool argumentsPointIntoBuffer() const;
+    bool canShareBuffer() const;
+    void shareBuffer(); // creates m_sharedBuffer if necessary
+    void releaseSharedBuffer(bool keepFileDescriptors);
+    // sets m_mainArguments and the headers that depend on them; sharedBody is the new m_sharedBody
+    void adoptArguments(Arguments arguments, SharedMessageBuffer *sharedBody);
+    void releaseSharedBody();
+    void detachSharedBuffer(); // replaces a shared buffer with an unshared copy
     void reserveBuffer(uint32 newSize);
 
+    // returns a new Message that takes memory for itself and its receive buffer from pool
+    static Message *createPooled(const std::shared_ptr<MessagePool> &pool);
+
     void notifyCompletionListener();
 
     std::vector<int> *argUnixFds();
@@ -134,6 +221,8 @@ public:
     byte m_flags;
     byte m_protocolVersion;
     bool m_dirty : 1;
+    bool m_bodyIsSeparate : 1; // see serialize()
+    bool m_bufferIsPooled : 1; // m_buffer is from m_pool, with capacity m_buffer.length
     uint32 m_headerLength;
     uint32 m_headerPadding;
     uint32 m_bodyLength;
@@ -144,8 +233,18 @@ public:
     Arguments m_mainArguments;
 
     VarHeaderStorage m_varHeaders;
+    Arguments::ValidationLevel m_validationLevel; // for received messages, see Connection
 
     ICompletionListener *m_completionListener;
+    ICompletionListener *m_receiveProgressListener;
+    uint32 m_streamingBodyThreshold;
+
+    std::shared_ptr<MessagePool> m_pool; // only for received messages, see createPooled()
+    // If not null, m_buffer and the file descriptors in m_mainArguments belong to this
+    SharedMessageBuffer *m_sharedBuffer;
+    // If not null, the data and file descriptors of m_mainArguments belong to this buffer of another
+    // message, see Message::setArgumentsFrom()
+    SharedMessageBuffer *m_sharedBody;
 };
 
 #endif // MESSAGE_P_H
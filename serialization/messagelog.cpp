@@ -0,0 +1,349 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "messagelog.h"
+
+#include "basictypeio.h"
+#include "message.h"
+#include "message_p.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout, all numbers in the byte order given in the file header:
+// - file header: 8 bytes magic, 1 byte endianness ('l' or 'B' like in D-Bus messages), 1 byte
+//   version, 6 bytes zero
+// - records: uint64 timestamp, uint32 message length, uint32 zero, the serialized message, zero padding
+//   to a multiple of 8 bytes. Messages thus start 8-byte aligned, which the Reader requires.
+// - index: uint64 file offset of each record
+// - trailer: uint64 file offset of the index, uint32 record count, 4 bytes trailer magic
+
+static const char s_fileMagic[8] = { 'd', 'f', 'e', 'r', 'l', 'o', 'g', '\0' };
+static const char s_trailerMagic[4] = { 'i', 'n', 'd', 'x' };
+static const byte s_version = 1;
+#ifdef BIGENDIAN
+static const byte s_thisMachineEndianness = 'B';
+#else
+static const byte s_thisMachineEndianness = 'l';
+#endif
+
+enum {
+    FileHeaderSize = 16,
+    RecordHeaderSize = 16,
+    TrailerSize = 16,
+    RecordAlignment = 8
+};
+
+namespace {
+struct Mapping
+{
+    Mapping(byte *p, size_t l) : ptr(p), length(l) {}
+    ~Mapping() { ::munmap(ptr, length); }
+    byte *ptr;
+    size_t length;
+};
+}
+
+class MessageLog::Private
+{
+public:
+    void open(const std::string &fileName);
+    bool readIndex();
+    void reconstructIndex();
+    uint64 recordOffset(uint32 index) const;
+
+    Error m_error;
+    // Messages keep the mapping alive through their SharedMessageBuffer
+    std::shared_ptr<Mapping> m_mapping;
+    bool m_isByteSwapped = false;
+    uint64 m_recordsEnd = 0;
+    uint32 m_count = 0;
+    const byte *m_index = nullptr; // in the mapping, or null if reconstructed into m_reconstructedIndex
+    std::vector<uint64> m_reconstructedIndex;
+};
+
+void MessageLog::Private::open(const std::string &fileName)
+{
+    const int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        m_error = Error::MessageLogFileError;
+        return;
+    }
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0) {
+        ::close(fd);
+        m_error = Error::MessageLogFileError;
+        return;
+    }
+    const size_t fileLength = size_t(fileStat.st_size);
+    if (fileLength < FileHeaderSize) {
+        ::close(fd);
+        m_error = Error::MalformedMessageLog;
+        return;
+    }
+    // Writable but private, for converting messages in the other byte order in place. Only the pages
+    // that are written to get copied.
+    void *const ptr = ::mmap(nullptr, fileLength, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays valid
+    if (ptr == MAP_FAILED) {
+        m_error = Error::MessageLogFileError;
+        return;
+    }
+    m_mapping = std::make_shared<Mapping>(static_cast<byte *>(ptr), fileLength);
+
+    const byte *const header = m_mapping->ptr;
+    if (memcmp(header, s_fileMagic, sizeof(s_fileMagic)) != 0 || (header[8] != 'l' && header[8] != 'B') ||
+        header[9] != s_version) {
+        m_mapping.reset();
+        m_error = Error::MalformedMessageLog;
+        return;
+    }
+    m_isByteSwapped = header[8] != s_thisMachineEndianness;
+
+    if (!readIndex()) {
+        reconstructIndex();
+    }
+}
+
+bool MessageLog::Private::readIndex()
+{
+    const size_t fileLength = m_mapping->length;
+    if (fileLength < FileHeaderSize + TrailerSize) {
+        return false;
+    }
+    const byte *const trailer = m_mapping->ptr + fileLength - TrailerSize;
+    if (memcmp(trailer + 12, s_trailerMagic, sizeof(s_trailerMagic)) != 0) {
+        return false;
+    }
+    const uint64 indexOffset = basic::readUint64(trailer, m_isByteSwapped);
+    const uint32 count = basic::readUint32(trailer + 8, m_isByteSwapped);
+    // Careful not to overflow, indexOffset comes straight from the file
+    const uint64 trailerOffset = fileLength - TrailerSize;
+    if (indexOffset < FileHeaderSize || indexOffset % RecordAlignment || indexOffset > trailerOffset ||
+        count != (trailerOffset - indexOffset) / sizeof(uint64) || (trailerOffset - indexOffset) % sizeof(uint64)) {
+        return false;
+    }
+    m_recordsEnd = indexOffset;
+    assert(m_recordsEnd <= m_mapping->length);
+    m_count = count;
+    m_index = m_mapping->ptr + indexOffset;
+    return true;
+}
+
+void MessageLog::Private::reconstructIndex()
+{
+    // Take all complete records. This reads through the whole file, but the index was lost anyway...
+    const size_t fileLength = m_mapping->length;
+    uint64 offset = FileHeaderSize;
+    while (offset + RecordHeaderSize <= fileLength) {
+        const uint32 messageLength = basic::readUint32(m_mapping->ptr + offset + 8, m_isByteSwapped);
+        const uint64 recordEnd = offset + RecordHeaderSize + align(messageLength, RecordAlignment);
+        if (recordEnd > fileLength || !messageLength) {
+            break;
+        }
+        m_reconstructedIndex.push_back(offset);
+        offset = recordEnd;
+    }
+    m_recordsEnd = offset;
+    m_count = m_reconstructedIndex.size();
+}
+
+uint64 MessageLog::Private::recordOffset(uint32 index) const
+{
+    if (m_index) {
+        return basic::readUint64(m_index + index * sizeof(uint64), m_isByteSwapped);
+    }
+    return m_reconstructedIndex[index];
+}
+
+MessageLog::MessageLog(const std::string &fileName)
+   : d(new Private)
+{
+    d->open(fileName);
+}
+
+MessageLog::MessageLog(MessageLog &&other)
+   : d(other.d)
+{
+    other.d = nullptr;
+}
+
+MessageLog &MessageLog::operator=(MessageLog &&other)
+{
+    if (this != &other) {
+        delete d;
+        d = other.d;
+        other.d = nullptr;
+    }
+    return *this;
+}
+
+MessageLog::~MessageLog()
+{
+    delete d;
+    d = nullptr;
+}
+
+Error MessageLog::error() const
+{
+    return d->m_error;
+}
+
+uint32 MessageLog::count() const
+{
+    return d->m_count;
+}
+
+uint64 MessageLog::timestamp(uint32 index) const
+{
+    if (index >= d->m_count) {
+        return 0;
+    }
+    const uint64 offset = d->recordOffset(index);
+    if (offset % RecordAlignment || offset < FileHeaderSize || offset > d->m_recordsEnd - RecordHeaderSize) {
+        return 0;
+    }
+    return basic::readUint64(d->m_mapping->ptr + offset, d->m_isByteSwapped);
+}
+
+Message MessageLog::message(uint32 index) const
+{
+    Message ret;
+    if (index >= d->m_count) {
+        return ret;
+    }
+    // The index is not validated when opening the log, so validate the offsets now
+    const uint64 offset = d->recordOffset(index);
+    if (offset % RecordAlignment || offset < FileHeaderSize || offset > d->m_recordsEnd - RecordHeaderSize) {
+        return ret;
+    }
+    byte *const record = d->m_mapping->ptr + offset;
+    const uint32 messageLength = basic::readUint32(record + 8, d->m_isByteSwapped);
+    if (messageLength > d->m_recordsEnd - RecordHeaderSize - offset) {
+        return ret;
+    }
+    MessagePrivate::get(&ret)->deserializeShared(chunk(record + RecordHeaderSize, messageLength),
+                                                 d->m_mapping);
+    return ret;
+}
+
+class MessageLog::Writer::Private
+{
+public:
+    bool write(const void *data, size_t length);
+
+    Error m_error;
+    FILE *m_file = nullptr;
+    uint64 m_position = 0;
+    std::vector<uint64> m_index;
+};
+
+bool MessageLog::Writer::Private::write(const void *data, size_t length)
+{
+    if (length && fwrite(data, 1, length, m_file) != length) {
+        m_error = Error::MessageLogFileError;
+        return false;
+    }
+    m_position += length;
+    return true;
+}
+
+MessageLog::Writer::Writer(const std::string &fileName)
+   : d(new Private)
+{
+    d->m_file = fopen(fileName.c_str(), "wbe");
+    if (!d->m_file) {
+        d->m_error = Error::MessageLogFileError;
+        return;
+    }
+    byte header[FileHeaderSize] = { 0 };
+    memcpy(header, s_fileMagic, sizeof(s_fileMagic));
+    header[8] = s_thisMachineEndianness;
+    header[9] = s_version;
+    d->write(header, sizeof(header));
+}
+
+MessageLog::Writer::~Writer()
+{
+    finish();
+    delete d;
+    d = nullptr;
+}
+
+Error MessageLog::Writer::error() const
+{
+    return d->m_error;
+}
+
+bool MessageLog::Writer::append(Message *message, uint64 timestamp)
+{
+    if (!d->m_file || d->m_error.isError() || d->m_index.size() == 0xffffffffu) {
+        return false;
+    }
+    const chunk data = message->serializeAndView();
+    if (!data.length) {
+        return false;
+    }
+    alignas(8) byte recordHeader[RecordHeaderSize] = { 0 };
+    basic::writeUint64(recordHeader, timestamp);
+    basic::writeUint32(recordHeader + 8, data.length);
+    static const byte padding[RecordAlignment] = { 0 };
+
+    const uint64 recordOffset = d->m_position;
+    if (!d->write(recordHeader, sizeof(recordHeader)) || !d->write(data.ptr, data.length) ||
+        !d->write(padding, align(data.length, RecordAlignment) - data.length)) {
+        return false;
+    }
+    d->m_index.push_back(recordOffset);
+    return true;
+}
+
+bool MessageLog::Writer::finish()
+{
+    if (!d->m_file) {
+        return !d->m_error.isError();
+    }
+    if (!d->m_error.isError()) {
+        const uint64 indexOffset = d->m_position;
+        alignas(8) byte trailer[TrailerSize];
+        basic::writeUint64(trailer, indexOffset);
+        basic::writeUint32(trailer + 8, d->m_index.size());
+        memcpy(trailer + 12, s_trailerMagic, sizeof(s_trailerMagic));
+        if (d->write(d->m_index.data(), d->m_index.size() * sizeof(uint64))) {
+            d->write(trailer, sizeof(trailer));
+        }
+    }
+    if (fclose(d->m_file) != 0) {
+        d->m_error = Error::MessageLogFileError;
+    }
+    d->m_file = nullptr;
+    return !d->m_error.isError();
+}
@@ -0,0 +1,87 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#ifndef MESSAGELOG_H
+#define MESSAGELOG_H
+
+#include "error.h"
+#include "types.h"
+
+#include <string>
+
+class Message;
+
+// A file format for captured messages, e.g. from eavesdropping on a bus: serialized messages with
+// timestamps, followed by an index of the messages. Use MessageLog::Writer to create a log.
+// MessageLog maps a log into memory and only reads the index when opening it. Messages are deserialized
+// on demand and refer to the mapped file instead of copying it, so logs larger than the available memory
+// can be opened. If the index is missing, e.g. because the writing process crashed, it is reconstructed
+// from the messages that are complete.
+// Messages in the other byte order are converted in place in the (private) mapping, so don't call
+// message() for the same index from several threads at once.
+class DFERRY_EXPORT MessageLog
+{
+public:
+    explicit MessageLog(const std::string &fileName);
+    MessageLog(MessageLog &&other);
+    MessageLog &operator=(MessageLog &&other);
+    ~MessageLog();
+
+    MessageLog(const MessageLog &other) = delete;
+    MessageLog &operator=(const MessageLog &other) = delete;
+
+    Error error() const;
+    uint32 count() const;
+    // The unit of timestamps is up to the application that wrote the log
+    uint64 timestamp(uint32 index) const;
+    // Returns an invalid message if index is out of range. The message shares the mapped data; modifying
+    // it makes a copy. It is independent of the MessageLog and can outlive it.
+    Message message(uint32 index) const;
+
+    class DFERRY_EXPORT Writer
+    {
+    public:
+        explicit Writer(const std::string &fileName); // creates or truncates the file
+        ~Writer(); // calls finish()
+
+        Writer(const Writer &other) = delete;
+        Writer &operator=(const Writer &other) = delete;
+
+        Error error() const;
+        // Serializes message if necessary. Returns false if the message could not be serialized, which
+        // does not affect the log, or if writing failed, which leaves the log in error state.
+        bool append(Message *message, uint64 timestamp);
+        // Writes the index and closes the file
+        bool finish();
+
+    private:
+        class Private;
+        Private *d;
+    };
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // MESSAGELOG_H
@@ -0,0 +1,205 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "messagepool.h"
+
+#include "basictypeio.h"
+#include "message_p.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <utility>
+
+static uint32 sizeClassShift(uint32 size)
+{
+    uint32 shift = MessagePool::MinBufferSizeShift;
+    while ((1u << shift) < size) {
+        shift++;
+    }
+    return shift;
+}
+
+MessagePool::MessagePool(uint32 maxCachedBytes)
+   : m_maxCachedBytes(maxCachedBytes)
+{
+    m_messages.reserve(messageListCapacity(maxCachedBytes));
+    for (int i = 0; i < SizeClassCount; i++) {
+        m_buffers[i].reserve(bufferListCapacity(i, maxCachedBytes));
+    }
+}
+
+MessagePool::~MessagePool()
+{
+    for (void *message : m_messages) {
+        ::free(message);
+    }
+    for (const std::vector<byte *> &sizeClass : m_buffers) {
+        for (byte *buffer : sizeClass) {
+            ::free(buffer);
+        }
+    }
+}
+
+uint32 MessagePool::maxCachedBytes() const
+{
+    SpinLocker locker(&m_lock);
+    return m_maxCachedBytes;
+}
+
+void MessagePool::setMaxCachedBytes(uint32 maxCachedBytes)
+{
+    // Allocate the lists for the new limit before taking the lock, and free the old ones after releasing it
+    std::vector<void *> messages;
+    messages.reserve(messageListCapacity(maxCachedBytes));
+    std::vector<byte *> buffers[SizeClassCount];
+    for (int i = 0; i < SizeClassCount; i++) {
+        buffers[i].reserve(bufferListCapacity(i, maxCachedBytes));
+    }
+
+    SpinLocker locker(&m_lock);
+    m_maxCachedBytes = maxCachedBytes;
+    trim();
+    // Whatever is left after trim() fits into the new lists
+    for (int i = 0; i < SizeClassCount; i++) {
+        assert(m_buffers[i].size() <= buffers[i].capacity());
+        buffers[i].insert(buffers[i].end(), m_buffers[i].begin(), m_buffers[i].end());
+        std::swap(m_buffers[i], buffers[i]);
+    }
+    assert(m_messages.size() <= messages.capacity());
+    messages.insert(messages.end(), m_messages.begin(), m_messages.end());
+    std::swap(m_messages, messages);
+}
+
+MessagePool::Statistics MessagePool::statistics() const
+{
+    SpinLocker locker(&m_lock);
+    return m_statistics;
+}
+
+void *MessagePool::allocateMessage()
+{
+    {
+        SpinLocker locker(&m_lock);
+        if (!m_messages.empty()) {
+            void *const ret = m_messages.back();
+            m_messages.pop_back();
+            m_statistics.cachedBytes -= sizeof(MessagePrivate);
+            m_statistics.messageHits++;
+            return ret;
+        }
+        m_statistics.messageMisses++;
+    }
+    return ::malloc(sizeof(MessagePrivate));
+}
+
+void MessagePool::freeMessage(void *message)
+{
+    {
+        SpinLocker locker(&m_lock);
+        if (m_statistics.cachedBytes + sizeof(MessagePrivate) <= m_maxCachedBytes &&
+            m_messages.size() < m_messages.capacity()) {
+            m_messages.push_back(message);
+            m_statistics.cachedBytes += sizeof(MessagePrivate);
+            return;
+        }
+    }
+    ::free(message);
+}
+
+// static
+uint32 MessagePool::bufferCapacity(uint32 size)
+{
+    if (size > 1u << MaxBufferSizeShift) {
+        return align(size, LargeBufferGranularity);
+    }
+    return 1u << sizeClassShift(size);
+}
+
+byte *MessagePool::allocateBuffer(uint32 size, uint32 *capacity)
+{
+    *capacity = bufferCapacity(size);
+    if (*capacity <= 1u << MaxBufferSizeShift) {
+        const uint32 shift = sizeClassShift(*capacity);
+        SpinLocker locker(&m_lock);
+        std::vector<byte *> &sizeClass = m_buffers[shift - MinBufferSizeShift];
+        if (!sizeClass.empty()) {
+            byte *const ret = sizeClass.back();
+            sizeClass.pop_back();
+            m_statistics.cachedBytes -= *capacity;
+            m_statistics.bufferHits++;
+            return ret;
+        }
+        m_statistics.bufferMisses++;
+    } else {
+        SpinLocker locker(&m_lock);
+        m_statistics.bufferMisses++;
+    }
+    return static_cast<byte *>(::malloc(*capacity));
+}
+
+void MessagePool::freeBuffer(byte *buffer, uint32 capacity)
+{
+    if (capacity <= 1u << MaxBufferSizeShift) {
+        const uint32 shift = sizeClassShift(capacity);
+        assert(capacity == 1u << shift);
+        SpinLocker locker(&m_lock);
+        std::vector<byte *> &sizeClass = m_buffers[shift - MinBufferSizeShift];
+        if (m_statistics.cachedBytes + capacity <= m_maxCachedBytes && sizeClass.size() < sizeClass.capacity()) {
+            sizeClass.push_back(buffer);
+            m_statistics.cachedBytes += capacity;
+            return;
+        }
+    }
+    ::free(buffer);
+}
+
+// static
+uint32 MessagePool::messageListCapacity(uint32 maxCachedBytes)
+{
+    return std::min(uint32(maxCachedBytes / sizeof(MessagePrivate)), uint32(MaxCachedMessages));
+}
+
+// static
+uint32 MessagePool::bufferListCapacity(int sizeClass, uint32 maxCachedBytes)
+{
+    return std::min(maxCachedBytes >> (sizeClass + MinBufferSizeShift), uint32(MaxCachedBuffersPerSizeClass));
+}
+
+void MessagePool::trim()
+{
+    // free the largest buffers first, they are the least likely to be needed again soon
+    for (int i = SizeClassCount - 1; i >= 0 && m_statistics.cachedBytes > m_maxCachedBytes; i--) {
+        std::vector<byte *> &sizeClass = m_buffers[i];
+        while (!sizeClass.empty() && m_statistics.cachedBytes > m_maxCachedBytes) {
+            ::free(sizeClass.back());
+            sizeClass.pop_back();
+            m_statistics.cachedBytes -= 1u << (i + MinBufferSizeShift);
+        }
+    }
+    while (!m_messages.empty() && m_statistics.cachedBytes > m_maxCachedBytes) {
+        ::free(m_messages.back());
+        m_messages.pop_back();
+        m_statistics.cachedBytes -= sizeof(MessagePrivate);
+    }
+}
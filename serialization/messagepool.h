@@ -0,0 +1,94 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#ifndef MESSAGEPOOL_H
+#define MESSAGEPOOL_H
+
+#include "spinlock.h"
+#include "types.h"
+
+#include <vector>
+
+// Recycles the memory of received messages: MessagePrivate blocks and receive buffers in power-of-two
+// size classes. A Connection shares its pool with the messages it received, which may be destroyed
+// in any thread, so the pool is thread-safe and owned through std::shared_ptr.
+// Unused memory is kept up to a "high-water mark" of maxCachedBytes, anything beyond is freed right away.
+class MessagePool
+{
+public:
+    enum {
+        MinBufferSizeShift = 8, // 256 bytes, the smallest receive buffer
+        MaxBufferSizeShift = 20, // 1 MiB, larger buffers are rare and not worth keeping around
+        // Larger buffers are only rounded up to a multiple of this - rounding them up to a power of two
+        // could waste almost half of a large allocation
+        LargeBufferGranularity = 64 * 1024,
+        SizeClassCount = MaxBufferSizeShift - MinBufferSizeShift + 1,
+        DefaultMaxCachedBytes = 256 * 1024,
+        // Limits for the number of cached entries of each kind, also with a large maxCachedBytes. The lists
+        // of cached entries are allocated up front, so that freeing never allocates under the lock.
+        MaxCachedMessages = 1024,
+        MaxCachedBuffersPerSizeClass = 256
+    };
+
+    struct Statistics
+    {
+        uint64 messageHits = 0;
+        uint64 messageMisses = 0;
+        uint64 bufferHits = 0;
+        uint64 bufferMisses = 0;
+        uint32 cachedBytes = 0;
+    };
+
+    explicit MessagePool(uint32 maxCachedBytes = DefaultMaxCachedBytes);
+    ~MessagePool();
+    MessagePool(const MessagePool &other) = delete;
+    MessagePool &operator=(const MessagePool &other) = delete;
+
+    uint32 maxCachedBytes() const;
+    void setMaxCachedBytes(uint32 maxCachedBytes); // frees memory above the new limit
+    Statistics statistics() const;
+
+    // memory for a MessagePrivate
+    void *allocateMessage();
+    void freeMessage(void *message);
+
+    // The actual size of a buffer for size bytes, also used for buffers that don't come from a pool
+    static uint32 bufferCapacity(uint32 size);
+    // Returns a buffer of at least size bytes, the actual size is returned in *capacity.
+    // Pass the same capacity to freeBuffer().
+    byte *allocateBuffer(uint32 size, uint32 *capacity);
+    void freeBuffer(byte *buffer, uint32 capacity);
+
+private:
+    void trim(); // m_lock must be held
+    static uint32 messageListCapacity(uint32 maxCachedBytes);
+    static uint32 bufferListCapacity(int sizeClass, uint32 maxCachedBytes);
+
+    mutable Spinlock m_lock;
+    uint32 m_maxCachedBytes;
+    Statistics m_statistics;
+    std::vector<void *> m_messages;
+    std::vector<byte *> m_buffers[SizeClassCount];
+};
+
+#endif // MESSAGEPOOL_H
@@ -0,0 +1,123 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "messagetemplate.h"
+
+#include "arguments.h"
+#include "message.h"
+#include "message_p.h"
+
+#include <vector>
+
+class MessageTemplate::Private
+{
+public:
+    Error m_error;
+    // The serialized prototype, deserialized again so that its string headers refer to the header data.
+    // MessagePrivate::initFromHeaderTemplate() copies both, but not the body.
+    Message m_header;
+};
+
+MessageTemplate::MessageTemplate(const Message &prototype)
+   : d(new Private)
+{
+    Message header(prototype);
+    MessagePrivate *const hd = MessagePrivate::get(&header);
+    hd->m_varHeaders.clearStringHeader(Message::DestinationHeader);
+    hd->m_dirty = true;
+    if (!header.serial()) {
+        header.setSerial(1); // a serial is required for serializing, it is replaced in each message anyway
+    }
+    const std::vector<byte> data = header.save();
+    if (data.empty()) {
+        d->m_error = header.error().isError() ? header.error() : Error(Error::MalformedMessageData);
+        return;
+    }
+    d->m_header.load(data);
+    d->m_error = d->m_header.error();
+}
+
+MessageTemplate::MessageTemplate(MessageTemplate &&other)
+   : d(other.d)
+{
+    other.d = nullptr;
+}
+
+MessageTemplate &MessageTemplate::operator=(MessageTemplate &&other)
+{
+    if (this != &other) {
+        delete d;
+        d = other.d;
+        other.d = nullptr;
+    }
+    return *this;
+}
+
+MessageTemplate::~MessageTemplate()
+{
+    delete d;
+    d = nullptr;
+}
+
+Error MessageTemplate::error() const
+{
+    return d->m_error;
+}
+
+Message MessageTemplate::createMessage(Arguments arguments, cstring destination) const
+{
+    Message ret;
+    MessagePrivate *const rd = MessagePrivate::get(&ret);
+    if (d->m_error.isError()) {
+        rd->m_error = d->m_error;
+        return ret;
+    }
+    const MessagePrivate &header = *MessagePrivate::get(&d->m_header);
+    if (rd->initFromHeaderTemplate(header, &arguments, destination)) {
+        return ret;
+    }
+
+    // the regular way, for arguments that don't fit the pre-serialized header
+    ret.setType(header.m_messageType);
+    rd->m_flags = header.m_flags;
+    for (int i = Message::PathHeader; i <= Message::UnixFdsHeader; i++) {
+        const Message::VariableHeader field = static_cast<Message::VariableHeader>(i);
+        if (field == Message::SignatureHeader || field == Message::UnixFdsHeader) {
+            continue; // set by setArguments()
+        }
+        bool isPresent = false;
+        const std::string value = d->m_header.stringHeader(field, &isPresent);
+        if (isPresent) {
+            ret.setStringHeader(field, value);
+        }
+        const uint32 intValue = d->m_header.intHeader(field, &isPresent);
+        if (isPresent) {
+            ret.setIntHeader(field, intValue);
+        }
+    }
+    if (destination.length) {
+        ret.setDestination(std::string(destination.ptr, destination.length));
+    }
+    ret.setArguments(std::move(arguments));
+    return ret;
+}
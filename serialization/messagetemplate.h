@@ -0,0 +1,65 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#ifndef MESSAGETEMPLATE_H
+#define MESSAGETEMPLATE_H
+
+#include "error.h"
+#include "types.h"
+
+class Arguments;
+class Message;
+
+// Pre-serialized headers for sending many messages that only differ in serial, destination and body,
+// e.g. a signal that is emitted very often. The headers are serialized once, when creating the template.
+// Messages created from it start out serialized, with a copy of the header bytes, so sending them only
+// patches in the serial and copies the body.
+class DFERRY_EXPORT MessageTemplate
+{
+public:
+    // Takes the type, flags and headers of prototype, except for the serial and the destination. The
+    // signature of the template is the one of the arguments of prototype. If prototype is not valid for
+    // sending (ignoring the serial), error() is set.
+    explicit MessageTemplate(const Message &prototype);
+    MessageTemplate(MessageTemplate &&other);
+    MessageTemplate &operator=(MessageTemplate &&other);
+    ~MessageTemplate();
+
+    MessageTemplate(const MessageTemplate &other) = delete;
+    MessageTemplate &operator=(const MessageTemplate &other) = delete;
+
+    Error error() const;
+    // Creates a message with the headers of the template, plus destination if not empty, and arguments.
+    // The serial is still 0; Connection sets it when sending. The pre-serialized header is only used if
+    // arguments have the signature of the template and no file descriptors; otherwise the message is
+    // set up and serialized the regular way. Modifying the headers of the message also works, they
+    // are serialized again then.
+    // createMessage() does not modify the template, so it can be called from several threads at once.
+    Message createMessage(Arguments arguments, cstring destination = cstring()) const;
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // MESSAGETEMPLATE_H
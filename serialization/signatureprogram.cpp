@@ -0,0 +1,264 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "signatureprogram.h"
+
+#include "basictypeio.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+struct ProgramCache
+{
+    enum {
+        Capacity = 32
+    };
+    struct Entry
+    {
+        Entry() : hash(0), lastUse(0) {}
+        uint32 hash;
+        uint64 lastUse;
+        std::shared_ptr<const SignatureProgram> program;
+    };
+
+    ProgramCache() : useCounter(0), hits(0), misses(0) {}
+    Entry entries[Capacity];
+    uint64 useCounter;
+    uint64 hits;
+    uint64 misses;
+};
+}
+
+thread_local static ProgramCache programCache;
+
+static uint32 hashSignature(cstring signature, Arguments::SignatureType type)
+{
+    // FNV-1a
+    uint32 hash = 2166136261u ^ uint32(type);
+    for (uint32 i = 0; i < signature.length; i++) {
+        hash = (hash ^ byte(signature.ptr[i])) * 16777619u;
+    }
+    return hash;
+}
+
+// Empty and single-letter signatures, which are very common for variants, are not worth a cache lookup
+static const std::shared_ptr<const SignatureProgram> &shortSignatureProgram(cstring signature,
+                                                                            Arguments::SignatureType type)
+{
+    static const std::shared_ptr<const SignatureProgram> invalid;
+    static const std::shared_ptr<const SignatureProgram> empty =
+        std::make_shared<SignatureProgram>(cstring(""), Arguments::MethodSignature);
+    static const std::vector<std::shared_ptr<const SignatureProgram>> singleLetter = [] {
+        std::vector<std::shared_ptr<const SignatureProgram>> ret(128);
+        for (const char *letter = "ybnqiuxtdsoghv"; *letter; letter++) {
+            ret[byte(*letter)] = std::make_shared<SignatureProgram>(cstring(letter, 1),
+                                                                    Arguments::VariantSignature);
+        }
+        return ret;
+    }();
+
+    if (!signature.length) {
+        // an empty variant signature is invalid
+        return type == Arguments::MethodSignature ? empty : invalid;
+    }
+    const byte letter = byte(signature.ptr[0]);
+    return letter < singleLetter.size() ? singleLetter[letter] : invalid;
+}
+
+// static
+std::shared_ptr<const SignatureProgram> SignatureProgram::get(cstring signature, Arguments::SignatureType type)
+{
+    // same precondition as in Arguments::isSignatureValid(). Longer signatures are not allowed by the spec,
+    // and instructions could not represent them.
+    if (!signature.ptr || signature.ptr[signature.length] != 0 ||
+        signature.length > Arguments::MaxSignatureLength) {
+        return nullptr;
+    }
+    if (signature.length <= 1) {
+        return shortSignatureProgram(signature, type);
+    }
+
+    const uint32 hash = hashSignature(signature, type);
+    ProgramCache &cache = programCache;
+    const uint64 useTime = ++cache.useCounter;
+
+    ProgramCache::Entry *leastRecentlyUsed = &cache.entries[0];
+    for (ProgramCache::Entry &entry : cache.entries) {
+        if (entry.hash == hash && entry.program) {
+            const cstring cachedSignature = entry.program->signature();
+            if (entry.program->type() == type && cachedSignature.length == signature.length &&
+                memcmp(cachedSignature.ptr, signature.ptr, signature.length) == 0) {
+                entry.lastUse = useTime;
+                cache.hits++;
+                return entry.program;
+            }
+        }
+        if (entry.lastUse < leastRecentlyUsed->lastUse) {
+            leastRecentlyUsed = &entry;
+        }
+    }
+
+    cache.misses++;
+    if (!isSignatureValidUncached(signature, type)) {
+        return nullptr;
+    }
+    leastRecentlyUsed->hash = hash;
+    leastRecentlyUsed->lastUse = useTime;
+    leastRecentlyUsed->program = std::make_shared<SignatureProgram>(signature, type);
+    return leastRecentlyUsed->program;
+}
+
+// static
+Arguments::SignatureCacheStatistics SignatureProgram::cacheStatistics()
+{
+    const ProgramCache &cache = programCache;
+    Arguments::SignatureCacheStatistics ret;
+    ret.hits = cache.hits;
+    ret.misses = cache.misses;
+    return ret;
+}
+
+SignatureProgram::SignatureProgram(cstring signature, Arguments::SignatureType type)
+   : m_type(type),
+     m_signature(signature.ptr, signature.length),
+     m_instructions(signature.length)
+{
+    // the signature must have been validated
+    for (uint32 position = 0; position < signature.length; ) {
+        position = compileSingleCompleteType(position) + 1;
+    }
+}
+
+uint32 SignatureProgram::compileSingleCompleteType(uint32 position)
+{
+    const char *const signature = m_signature.c_str();
+    // m_instructions does not reallocate, so references into it stay valid
+    Instruction &instruction = m_instructions[position];
+    instruction.type = typeInfo(signature[position]);
+    instruction.end = position;
+    instruction.arrayDepth = 0;
+    instruction.parenDepth = 0;
+    instruction.totalDepth = 0;
+    instruction.fixedSize = 0;
+
+    switch (signature[position]) {
+    case 'a': {
+        const uint32 contentPosition = position + 1;
+        Instruction &content = m_instructions[contentPosition];
+        if (signature[contentPosition] == '{') {
+            content.type = typeInfo('{');
+            const uint32 keyEnd = compileSingleCompleteType(contentPosition + 1);
+            const uint32 valueEnd = compileSingleCompleteType(keyEnd + 1);
+            const Instruction &value = m_instructions[keyEnd + 1];
+
+            Instruction &dictEnd = m_instructions[valueEnd + 1];
+            dictEnd.type = typeInfo('}');
+            dictEnd.end = valueEnd + 1;
+
+            // the key is a basic type, so it doesn't add nesting
+            content.end = valueEnd + 1;
+            content.arrayDepth = value.arrayDepth;
+            content.parenDepth = value.parenDepth + 1;
+            content.totalDepth = value.totalDepth + 1;
+            content.fixedSize = 0;
+        } else {
+            compileSingleCompleteType(contentPosition);
+        }
+        instruction.end = content.end;
+        instruction.arrayDepth = content.arrayDepth + 1;
+        instruction.parenDepth = content.parenDepth;
+        instruction.totalDepth = content.totalDepth + 1;
+        break; }
+    case '(': {
+        uint32 memberPosition = position + 1;
+        uint32 size = 0;
+        bool isFixedSize = true;
+        while (signature[memberPosition] != ')') {
+            const uint32 memberEnd = compileSingleCompleteType(memberPosition);
+            const Instruction &member = m_instructions[memberPosition];
+            if (isFixedSize && member.fixedSize) {
+                // a struct always starts 8-byte aligned, so the layout inside does not depend on its position
+                size = align(size, member.type.alignment) + member.fixedSize;
+            } else {
+                isFixedSize = false;
+            }
+            instruction.arrayDepth = std::max(instruction.arrayDepth, member.arrayDepth);
+            instruction.parenDepth = std::max(instruction.parenDepth, member.parenDepth);
+            instruction.totalDepth = std::max(instruction.totalDepth, member.totalDepth);
+            memberPosition = memberEnd + 1;
+        }
+        Instruction &structEnd = m_instructions[memberPosition];
+        structEnd.type = typeInfo(')');
+        structEnd.end = memberPosition;
+
+        instruction.end = memberPosition;
+        instruction.parenDepth++;
+        instruction.totalDepth++;
+        instruction.fixedSize = isFixedSize ? size : 0;
+        break; }
+    case 'v':
+        instruction.totalDepth = 1;
+        break;
+    default:
+        if (instruction.type.isPrimitive) {
+            instruction.fixedSize = instruction.type.alignment;
+        }
+        break;
+    }
+    return instruction.end;
+}
+
+bool SignatureProgram::fixedStructLayout(uint32 position, Arguments::FixedStructLayout *layout) const
+{
+    const Instruction &structInstruction = m_instructions[position];
+    if (structInstruction.type.state() != Arguments::BeginStruct || !structInstruction.fixedSize) {
+        return false;
+    }
+    layout->fields.clear();
+    uint32 offset = 0;
+    for (uint32 i = position + 1; i < structInstruction.end; i++) {
+        const TypeInfo type = m_instructions[i].type;
+        switch (type.state()) {
+        case Arguments::BeginStruct:
+            offset = align(offset, StructAlignment);
+            break;
+        case Arguments::EndStruct:
+            break;
+        case Arguments::Boolean:
+        case Arguments::UnixFd:
+            return false;
+        default: {
+            assert(type.isPrimitive);
+            offset = align(offset, type.alignment);
+            const Arguments::FixedStructLayout::Field field = { type.state(), offset, type.alignment };
+            layout->fields.push_back(field);
+            offset += type.alignment;
+            break; }
+        }
+    }
+    assert(offset == structInstruction.fixedSize);
+    layout->size = offset;
+    layout->stride = align(offset, StructAlignment);
+    return true;
+}
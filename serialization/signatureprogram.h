@@ -0,0 +1,84 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#ifndef SIGNATUREPROGRAM_H
+#define SIGNATUREPROGRAM_H
+
+#include "arguments.h"
+#include "arguments_p.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// A signature "compiled" into one instruction per signature character, so that the Reader does not
+// need to validate and parse the same signatures over and over. Programs are immutable once created,
+// so they can be shared between Readers and threads. get() looks them up in a small per-thread LRU cache,
+// which also serves as the cache of validated signatures behind Arguments::isSignatureValid().
+class SignatureProgram
+{
+public:
+    struct Instruction
+    {
+        TypeInfo type; // same as typeInfo() of the signature character
+        byte end; // position of the last character of the single complete type starting here
+        // Maximum nesting of arrays, of structs and dict entries, and of all of these plus variants in
+        // the type starting here, including itself. For checking nesting limits when skipping types.
+        byte arrayDepth;
+        byte parenDepth;
+        byte totalDepth;
+        // size of the serialized data of fixed-size types, 0 for strings, arrays and variants
+        // (and aggregates containing them)
+        uint16 fixedSize;
+
+        // check whether the type starting here can be entered with nesting levels as in @p nesting
+        bool fitsNesting(const Nesting &nesting) const
+        {
+            return nesting.array + arrayDepth <= uint32(Nesting::arrayMax) &&
+                   nesting.paren + parenDepth <= uint32(Nesting::parenMax) &&
+                   nesting.array + nesting.paren + nesting.variant + totalDepth <= uint32(Nesting::totalMax);
+        }
+    };
+
+    // Returns nullptr if @p signature is not valid
+    static std::shared_ptr<const SignatureProgram> get(cstring signature, Arguments::SignatureType type);
+    // of the calling thread's cache
+    static Arguments::SignatureCacheStatistics cacheStatistics();
+
+    SignatureProgram(cstring signature, Arguments::SignatureType type); // only public for make_shared
+
+    cstring signature() const { return cstring(m_signature.c_str(), m_signature.length()); }
+    Arguments::SignatureType type() const { return m_type; }
+    const Instruction *instructions() const { return m_instructions.data(); }
+    // If the type at @p position is a struct suitable for bulk reading and writing, describe its layout
+    bool fixedStructLayout(uint32 position, Arguments::FixedStructLayout *layout) const;
+
+private:
+    uint32 compileSingleCompleteType(uint32 position);
+
+    Arguments::SignatureType m_type;
+    std::string m_signature;
+    std::vector<Instruction> m_instructions;
+};
+
+#endif // SIGNATUREPROGRAM_H
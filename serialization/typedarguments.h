@@ -0,0 +1,596 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#ifndef TYPEDARGUMENTS_H
+#define TYPEDARGUMENTS_H
+
+#include "arguments.h"
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// Typed marshalling: writeTyped() and readTyped() (de)serialize C++ values whose D-Bus type is known
+// at compile time. The signature is generated at compile time, and when writing, the type is checked
+// once per value and the data is then serialized straight into the Writer's buffer - not one
+// element at a time through the Writer's state machine.
+// The D-Bus types of C++ types are:
+// byte: y, bool: b, int16: n, uint16: q, int32: i, uint32: u, int64: x, uint64: t, double: d,
+// std::string: s, std::vector<T>: aT, std::map<K, V>: a{KV}, std::tuple<T...>: (T...)
+// Your own structs can be supported by specializing DBusType, see DBusStructType.
+
+template<char... Cs>
+struct DBusSignature
+{
+    static constexpr uint32 length = sizeof...(Cs);
+    static constexpr char value[sizeof...(Cs) + 1] = { Cs..., '\0' };
+    static cstring toCString() { return cstring(value, length); }
+};
+
+template<char... Cs>
+constexpr uint32 DBusSignature<Cs...>::length;
+template<char... Cs>
+constexpr char DBusSignature<Cs...>::value[sizeof...(Cs) + 1];
+
+template<typename... Signatures>
+struct ConcatSignatures;
+
+template<>
+struct ConcatSignatures<>
+{
+    typedef DBusSignature<> type;
+};
+
+template<char... Cs>
+struct ConcatSignatures<DBusSignature<Cs...>>
+{
+    typedef DBusSignature<Cs...> type;
+};
+
+template<char... As, char... Bs, typename... Rest>
+struct ConcatSignatures<DBusSignature<As...>, DBusSignature<Bs...>, Rest...>
+{
+    typedef typename ConcatSignatures<DBusSignature<As..., Bs...>, Rest...>::type type;
+};
+
+// Specializations of DBusType provide:
+// - Signature: the DBusSignature of the type
+// - isBasic: whether the type is allowed as dict key
+// - isTrivial: whether arrays of the type can be copied from and to memory as they are
+// - alignment: the alignment of the serialized data
+// - measure(): advance a data position to the end of the serialized value; return false if the value
+//   can not be serialized (e.g. invalid string) - writing it with write() will then produce an error
+// - writeRaw(): serialize the value at a data position in a large enough buffer, and advance position
+// - write(): write the value using the regular Writer API, for when writeRaw() can't be used
+// - read(): read the value using the Reader API, where the Reader is known to be at the right type
+template<typename T>
+struct DBusType;
+
+namespace typedio
+{
+
+inline uint32 align(uint32 position, uint32 alignment)
+{
+    const uint32 maxStepUp = alignment - 1;
+    return (position + maxStepUp) & ~maxStepUp;
+}
+
+inline void zeroPad(byte *base, uint32 *position, uint32 alignment)
+{
+    const uint32 padEnd = align(*position, alignment);
+    for (; *position < padEnd; ++*position) {
+        base[*position] = 0;
+    }
+}
+
+inline void writeUint32(byte *base, uint32 position, uint32 value)
+{
+    memcpy(base + position, &value, sizeof(uint32));
+}
+
+template<typename... Members>
+struct StructMembers;
+
+template<>
+struct StructMembers<>
+{
+    template<typename S>
+    static bool measure(const S &, uint32 *) { return true; }
+    template<typename S>
+    static void writeRaw(const S &, byte *, uint32 *) {}
+    template<typename S>
+    static void write(Arguments::Writer *, const S &) {}
+    template<typename S>
+    static void read(Arguments::Reader *, S *) {}
+};
+
+template<typename M, typename... Rest>
+struct StructMembers<M, Rest...>
+{
+    typedef DBusType<typename M::type> MemberType;
+
+    template<typename S>
+    static bool measure(const S &value, uint32 *position)
+    {
+        return MemberType::measure(M::get(value), position) &&
+               StructMembers<Rest...>::measure(value, position);
+    }
+    template<typename S>
+    static void writeRaw(const S &value, byte *base, uint32 *position)
+    {
+        MemberType::writeRaw(M::get(value), base, position);
+        StructMembers<Rest...>::writeRaw(value, base, position);
+    }
+    template<typename S>
+    static void write(Arguments::Writer *writer, const S &value)
+    {
+        MemberType::write(writer, M::get(value));
+        StructMembers<Rest...>::write(writer, value);
+    }
+    template<typename S>
+    static void read(Arguments::Reader *reader, S *value)
+    {
+        MemberType::read(reader, &M::get(*value));
+        StructMembers<Rest...>::read(reader, value);
+    }
+};
+
+template<uint32... Is>
+struct IndexList {};
+
+template<uint32 N, uint32... Is>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, Is...> {};
+
+template<uint32... Is>
+struct MakeIndexList<0, Is...>
+{
+    typedef IndexList<Is...> type;
+};
+
+} // namespace typedio
+
+template<typename T, char Letter, void (Arguments::Writer::*WriteFunction)(T),
+         T (Arguments::Reader::*ReadFunction)()>
+struct DBusPrimitiveType
+{
+    typedef DBusSignature<Letter> Signature;
+    static constexpr bool isBasic = true;
+    static constexpr bool isTrivial = true;
+    static constexpr uint32 alignment = sizeof(T);
+
+    static bool measure(const T &, uint32 *position)
+    {
+        *position = typedio::align(*position, alignment) + sizeof(T);
+        return true;
+    }
+    static void writeRaw(const T &value, byte *base, uint32 *position)
+    {
+        typedio::zeroPad(base, position, alignment);
+        memcpy(base + *position, &value, sizeof(T));
+        *position += sizeof(T);
+    }
+    static void write(Arguments::Writer *writer, const T &value) { (writer->*WriteFunction)(value); }
+    static void read(Arguments::Reader *reader, T *value) { *value = (reader->*ReadFunction)(); }
+};
+
+template<>
+struct DBusType<byte>
+    : DBusPrimitiveType<byte, 'y', &Arguments::Writer::writeByte, &Arguments::Reader::readByte> {};
+template<>
+struct DBusType<int16>
+    : DBusPrimitiveType<int16, 'n', &Arguments::Writer::writeInt16, &Arguments::Reader::readInt16> {};
+template<>
+struct DBusType<uint16>
+    : DBusPrimitiveType<uint16, 'q', &Arguments::Writer::writeUint16, &Arguments::Reader::readUint16> {};
+template<>
+struct DBusType<int32>
+    : DBusPrimitiveType<int32, 'i', &Arguments::Writer::writeInt32, &Arguments::Reader::readInt32> {};
+template<>
+struct DBusType<uint32>
+    : DBusPrimitiveType<uint32, 'u', &Arguments::Writer::writeUint32, &Arguments::Reader::readUint32> {};
+template<>
+struct DBusType<int64>
+    : DBusPrimitiveType<int64, 'x', &Arguments::Writer::writeInt64, &Arguments::Reader::readInt64> {};
+template<>
+struct DBusType<uint64>
+    : DBusPrimitiveType<uint64, 't', &Arguments::Writer::writeUint64, &Arguments::Reader::readUint64> {};
+template<>
+struct DBusType<double>
+    : DBusPrimitiveType<double, 'd', &Arguments::Writer::writeDouble, &Arguments::Reader::readDouble> {};
+
+template<>
+struct DBusType<bool>
+{
+    typedef DBusSignature<'b'> Signature;
+    static constexpr bool isBasic = true;
+    static constexpr bool isTrivial = false; // one byte in memory, four on the wire
+    static constexpr uint32 alignment = 4;
+
+    static bool measure(const bool &, uint32 *position)
+    {
+        *position = typedio::align(*position, alignment) + sizeof(uint32);
+        return true;
+    }
+    static void writeRaw(const bool &value, byte *base, uint32 *position)
+    {
+        typedio::zeroPad(base, position, alignment);
+        typedio::writeUint32(base, *position, value ? 1 : 0);
+        *position += sizeof(uint32);
+    }
+    static void write(Arguments::Writer *writer, const bool &value) { writer->writeBoolean(value); }
+    static void read(Arguments::Reader *reader, bool *value) { *value = reader->readBoolean(); }
+};
+
+template<>
+struct DBusType<std::string>
+{
+    typedef DBusSignature<'s'> Signature;
+    static constexpr bool isBasic = true;
+    static constexpr bool isTrivial = false;
+    static constexpr uint32 alignment = 4;
+
+    static bool measure(const std::string &value, uint32 *position)
+    {
+        if (!Arguments::isStringValid(cstring(value.c_str(), value.length()))) {
+            return false;
+        }
+        *position = typedio::align(*position, alignment) + sizeof(uint32) + value.length() + 1;
+        return true;
+    }
+    static void writeRaw(const std::string &value, byte *base, uint32 *position)
+    {
+        typedio::zeroPad(base, position, alignment);
+        const uint32 length = value.length();
+        typedio::writeUint32(base, *position, length);
+        *position += sizeof(uint32);
+        memcpy(base + *position, value.c_str(), length + 1);
+        *position += length + 1;
+    }
+    static void write(Arguments::Writer *writer, const std::string &value)
+    {
+        writer->writeString(cstring(value.c_str(), value.length()));
+    }
+    static void read(Arguments::Reader *reader, std::string *value)
+    {
+        // with malformed data, the Reader can stop anywhere, and then a string would be garbage
+        if (reader->state() == Arguments::String) {
+            const cstring str = reader->readString();
+            value->assign(str.ptr, str.length);
+        }
+    }
+};
+
+template<typename T>
+struct DBusType<std::vector<T>>
+{
+    typedef DBusType<T> ElementType;
+    typedef typename ConcatSignatures<DBusSignature<'a'>, typename ElementType::Signature>::type Signature;
+    static constexpr bool isBasic = false;
+    static constexpr bool isTrivial = false;
+    static constexpr uint32 alignment = 4;
+
+    static bool measure(const std::vector<T> &value, uint32 *position)
+    {
+        uint32 pos = typedio::align(*position, alignment) + sizeof(uint32);
+        pos = typedio::align(pos, ElementType::alignment);
+        const uint32 dataStart = pos;
+        if (!measureElements(value, &pos, std::integral_constant<bool, ElementType::isTrivial>())) {
+            return false;
+        }
+        if (pos - dataStart > Arguments::MaxArrayLength) {
+            return false;
+        }
+        *position = pos;
+        return true;
+    }
+    static void writeRaw(const std::vector<T> &value, byte *base, uint32 *position)
+    {
+        typedio::zeroPad(base, position, alignment);
+        const uint32 lengthPosition = *position;
+        *position += sizeof(uint32);
+        typedio::zeroPad(base, position, ElementType::alignment);
+        const uint32 dataStart = *position;
+        writeRawElements(value, base, position, std::integral_constant<bool, ElementType::isTrivial>());
+        typedio::writeUint32(base, lengthPosition, *position - dataStart);
+    }
+    static void write(Arguments::Writer *writer, const std::vector<T> &value)
+    {
+        if (value.empty()) {
+            // an empty array still needs its types
+            writer->beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+            ElementType::write(writer, T());
+        } else {
+            writer->beginArray();
+            for (const T &element : value) {
+                ElementType::write(writer, element);
+            }
+        }
+        writer->endArray();
+    }
+    static void read(Arguments::Reader *reader, std::vector<T> *value)
+    {
+        value->clear();
+        if (ElementType::isTrivial) {
+            // does not work with byte-swapped data, in that case proceed the slow way
+            const std::pair<Arguments::IoState, chunk> array = reader->readPrimitiveArray();
+            if (array.first != Arguments::InvalidData) {
+                const T *begin = reinterpret_cast<const T *>(array.second.ptr);
+                value->assign(begin, begin + array.second.length / sizeof(T));
+                return; // readPrimitiveArray() has also left the array
+            }
+        }
+        reader->beginArray();
+        while (!reader->isError() && reader->state() != Arguments::EndArray) {
+            T element; // not reading into value->back() because std::vector<bool> is special
+            ElementType::read(reader, &element);
+            value->push_back(std::move(element));
+        }
+        if (!reader->isError()) {
+            reader->endArray();
+        }
+    }
+
+private:
+    static bool measureElements(const std::vector<T> &value, uint32 *position, std::true_type)
+    {
+        if (value.size() > Arguments::MaxArrayLength / sizeof(T)) {
+            return false;
+        }
+        *position += value.size() * sizeof(T);
+        return true;
+    }
+    static bool measureElements(const std::vector<T> &value, uint32 *position, std::false_type)
+    {
+        const uint32 dataStart = *position;
+        for (const T &element : value) {
+            if (!ElementType::measure(element, position) ||
+                *position - dataStart > Arguments::MaxArrayLength) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static void writeRawElements(const std::vector<T> &value, byte *base, uint32 *position, std::true_type)
+    {
+        // alignment padding between elements is never needed with these types
+        const uint32 length = value.size() * sizeof(T);
+        if (length) {
+            memcpy(base + *position, value.data(), length);
+        }
+        *position += length;
+    }
+    static void writeRawElements(const std::vector<T> &value, byte *base, uint32 *position, std::false_type)
+    {
+        for (const T &element : value) {
+            ElementType::writeRaw(element, base, position);
+        }
+    }
+};
+
+template<typename K, typename V>
+struct DBusType<std::map<K, V>>
+{
+    typedef DBusType<K> KeyType;
+    typedef DBusType<V> ValueType;
+    static_assert(KeyType::isBasic, "The key type of a dict must be a basic type");
+    typedef typename ConcatSignatures<DBusSignature<'a', '{'>, typename KeyType::Signature,
+                                      typename ValueType::Signature, DBusSignature<'}'>>::type Signature;
+    static constexpr bool isBasic = false;
+    static constexpr bool isTrivial = false;
+    static constexpr uint32 alignment = 4;
+
+    static bool measure(const std::map<K, V> &value, uint32 *position)
+    {
+        uint32 pos = typedio::align(*position, alignment) + sizeof(uint32);
+        pos = typedio::align(pos, 8);
+        const uint32 dataStart = pos;
+        for (const auto &entry : value) {
+            pos = typedio::align(pos, 8);
+            if (!KeyType::measure(entry.first, &pos) || !ValueType::measure(entry.second, &pos) ||
+                pos - dataStart > Arguments::MaxArrayLength) {
+                return false;
+            }
+        }
+        *position = pos;
+        return true;
+    }
+    static void writeRaw(const std::map<K, V> &value, byte *base, uint32 *position)
+    {
+        typedio::zeroPad(base, position, alignment);
+        const uint32 lengthPosition = *position;
+        *position += sizeof(uint32);
+        typedio::zeroPad(base, position, 8);
+        const uint32 dataStart = *position;
+        for (const auto &entry : value) {
+            typedio::zeroPad(base, position, 8);
+            KeyType::writeRaw(entry.first, base, position);
+            ValueType::writeRaw(entry.second, base, position);
+        }
+        typedio::writeUint32(base, lengthPosition, *position - dataStart);
+    }
+    static void write(Arguments::Writer *writer, const std::map<K, V> &value)
+    {
+        if (value.empty()) {
+            writer->beginDict(Arguments::Writer::WriteTypesOfEmptyArray);
+            KeyType::write(writer, K());
+            ValueType::write(writer, V());
+        } else {
+            writer->beginDict();
+            for (const auto &entry : value) {
+                KeyType::write(writer, entry.first);
+                ValueType::write(writer, entry.second);
+            }
+        }
+        writer->endDict();
+    }
+    static void read(Arguments::Reader *reader, std::map<K, V> *value)
+    {
+        value->clear();
+        reader->beginDict();
+        while (!reader->isError() && reader->state() != Arguments::EndDict) {
+            K key;
+            KeyType::read(reader, &key);
+            ValueType::read(reader, &(*value)[key]);
+        }
+        if (!reader->isError()) {
+            reader->endDict();
+        }
+    }
+};
+
+// Describes a data member of a struct for DBusStructType
+template<typename S, typename M, M S::*Member>
+struct DBusStructMember
+{
+    typedef M type;
+    static const M &get(const S &s) { return s.*Member; }
+    static M &get(S &s) { return s.*Member; }
+};
+
+// Base for DBusType specializations of structs, e.g.:
+// struct Point { int32 x; int32 y; };
+// template<> struct DBusType<Point> : DBusStructType<Point, DBusStructMember<Point, int32, &Point::x>,
+//                                                           DBusStructMember<Point, int32, &Point::y>> {};
+template<typename S, typename... Members>
+struct DBusStructType
+{
+    static_assert(sizeof...(Members) > 0, "Empty structs are not allowed");
+    typedef typename ConcatSignatures<DBusSignature<'('>,
+                                      typename DBusType<typename Members::type>::Signature...,
+                                      DBusSignature<')'>>::type Signature;
+    static constexpr bool isBasic = false;
+    static constexpr bool isTrivial = false;
+    static constexpr uint32 alignment = 8;
+
+    static bool measure(const S &value, uint32 *position)
+    {
+        *position = typedio::align(*position, alignment);
+        return typedio::StructMembers<Members...>::measure(value, position);
+    }
+    static void writeRaw(const S &value, byte *base, uint32 *position)
+    {
+        typedio::zeroPad(base, position, alignment);
+        typedio::StructMembers<Members...>::writeRaw(value, base, position);
+    }
+    static void write(Arguments::Writer *writer, const S &value)
+    {
+        writer->beginStruct();
+        typedio::StructMembers<Members...>::write(writer, value);
+        writer->endStruct();
+    }
+    static void read(Arguments::Reader *reader, S *value)
+    {
+        reader->beginStruct();
+        typedio::StructMembers<Members...>::read(reader, value);
+        if (!reader->isError()) {
+            reader->endStruct();
+        }
+    }
+};
+
+template<typename Tuple, uint32 I>
+struct DBusTupleElement
+{
+    typedef typename std::tuple_element<I, Tuple>::type type;
+    static const type &get(const Tuple &t) { return std::get<I>(t); }
+    static type &get(Tuple &t) { return std::get<I>(t); }
+};
+
+namespace typedio
+{
+template<typename Tuple, typename Indices>
+struct TupleType;
+
+template<typename... Ts, uint32... Is>
+struct TupleType<std::tuple<Ts...>, IndexList<Is...>>
+    : DBusStructType<std::tuple<Ts...>, DBusTupleElement<std::tuple<Ts...>, Is>...> {};
+} // namespace typedio
+
+template<typename... Ts>
+struct DBusType<std::tuple<Ts...>>
+    : typedio::TupleType<std::tuple<Ts...>, typename typedio::MakeIndexList<sizeof...(Ts)>::type> {};
+
+// Returns the signature of T; DBusType<T>::Signature::value is the same as a compile-time constant.
+template<typename T>
+cstring dbusSignature()
+{
+    return DBusType<T>::Signature::toCString();
+}
+
+// Writes value as one single complete type, which is checked against the current state of writer as a
+// whole. Errors are reported the same way as with the regular Writer API.
+template<typename T>
+void writeTyped(Arguments::Writer *writer, const T &value)
+{
+    typedef typename DBusType<T>::Signature Signature;
+    static_assert(Signature::length <= Arguments::MaxSignatureLength, "Signature is too long");
+
+    uint32 position;
+    if (writer->rawDataPosition(&position)) {
+        uint32 end = position;
+        if (DBusType<T>::measure(value, &end)) {
+            byte *const base = writer->writeRawValue(Signature::toCString(), end);
+            if (base) {
+                DBusType<T>::writeRaw(value, base, &position);
+                assert(position == end);
+            }
+            return;
+        }
+        // else let the regular API produce the appropriate error
+    }
+    DBusType<T>::write(writer, value);
+}
+
+template<typename T1, typename T2, typename... Ts>
+void writeTyped(Arguments::Writer *writer, const T1 &value1, const T2 &value2, const Ts &... values)
+{
+    writeTyped(writer, value1);
+    writeTyped(writer, value2, values...);
+}
+
+// Reads the current single complete type into value if its signature matches the signature of T.
+// Returns false if the signature does not match (in which case reader and value are unchanged)
+// or if the data turns out to be invalid.
+template<typename T>
+bool readTyped(Arguments::Reader *reader, T *value)
+{
+    typedef typename DBusType<T>::Signature Signature;
+    const cstring signature = reader->currentSingleCompleteTypeSignature();
+    if (signature.length != Signature::length ||
+        memcmp(signature.ptr, Signature::value, Signature::length) != 0) {
+        return false;
+    }
+    DBusType<T>::read(reader, value);
+    return !reader->isError();
+}
+
+template<typename T1, typename T2, typename... Ts>
+bool readTyped(Arguments::Reader *reader, T1 *value1, T2 *value2, Ts *... values)
+{
+    return readTyped(reader, value1) && readTyped(reader, value2, values...);
+}
+
+#endif // TYPEDARGUMENTS_H
@@ -0,0 +1,286 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "validationkernels.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__GNUC__) && defined(__SSE2__)
+#define DFERRY_HAVE_SSE2_KERNELS
+#define DFERRY_HAVE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+#endif
+
+// Scalar versions, also used for the parts of the input that the SIMD versions don't handle
+
+static inline uint32 utf8SequenceLength(const byte *data, uint32 i, uint32 length)
+{
+    // returns the length of the multi-byte sequence starting at data[i], or 0 if it is invalid. This
+    // rejects overlong encodings, surrogates and values above U+10FFFF, as required by RFC 3629.
+    const byte first = data[i];
+    uint32 count;
+    byte secondMin = 0x80;
+    byte secondMax = 0xbf;
+    if (first >= 0xc2 && first <= 0xdf) {
+        count = 2;
+    } else if (first >= 0xe0 && first <= 0xef) {
+        count = 3;
+        if (first == 0xe0) {
+            secondMin = 0xa0;
+        } else if (first == 0xed) {
+            secondMax = 0x9f;
+        }
+    } else if (first >= 0xf0 && first <= 0xf4) {
+        count = 4;
+        if (first == 0xf0) {
+            secondMin = 0x90;
+        } else if (first == 0xf4) {
+            secondMax = 0x8f;
+        }
+    } else {
+        return 0;
+    }
+    if (length - i < count || data[i + 1] < secondMin || data[i + 1] > secondMax) {
+        return 0;
+    }
+    for (uint32 j = 2; j < count; j++) {
+        if ((data[i + j] & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return count;
+}
+
+// validates from *position up to at least @p until, which may be passed to finish a multi-byte sequence
+static inline bool validateUtf8(const byte *data, uint32 *position, uint32 until, uint32 length)
+{
+    uint32 i = *position;
+    while (i < until) {
+        if (data[i] < 0x80) {
+            if (!data[i]) {
+                return false;
+            }
+            i++;
+        } else {
+            const uint32 sequenceLength = utf8SequenceLength(data, i, length);
+            if (!sequenceLength) {
+                return false;
+            }
+            i += sequenceLength;
+        }
+    }
+    *position = i;
+    return true;
+}
+
+static bool isUtf8WithoutNulScalar(const byte *data, uint32 length)
+{
+    uint32 i = 0;
+    return validateUtf8(data, &i, length, length);
+}
+
+static inline bool isObjectPathLetter(byte c)
+{
+    return (c >= 'a' && c <= 'z') || c == '_' || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+static inline bool isObjectPathCharactersTail(const byte *data, uint32 i, uint32 length, bool prevIsSlash)
+{
+    for (; i < length; i++) {
+        const bool isSlash = data[i] == '/';
+        if (isSlash ? prevIsSlash : !isObjectPathLetter(data[i])) {
+            return false;
+        }
+        prevIsSlash = isSlash;
+    }
+    return true;
+}
+
+static bool isObjectPathCharactersScalar(const byte *data, uint32 length)
+{
+    return isObjectPathCharactersTail(data, 0, length, false);
+}
+
+
+#ifdef DFERRY_HAVE_SSE2_KERNELS
+
+static bool isUtf8WithoutNulSse2(const byte *data, uint32 length)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32 i = 0;
+    while (length - i >= 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))) {
+            return false;
+        }
+        // the most significant bit is set exactly in the bytes of multi-byte sequences
+        if (likely(!_mm_movemask_epi8(v))) {
+            i += 16;
+        } else if (!validateUtf8(data, &i, i + 16, length)) {
+            return false;
+        }
+    }
+    return validateUtf8(data, &i, length, length);
+}
+
+// The comparisons are signed, which conveniently puts non-ASCII characters out of every range
+static inline __m128i isInRangeSse2(__m128i v, char low, char high)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(low - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(high + 1)));
+}
+
+static bool isObjectPathCharactersSse2(const byte *data, uint32 length)
+{
+    uint32 i = 0;
+    uint32 prevIsSlash = 0;
+    for (; length - i >= 16; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i isSlash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+        __m128i isValid = _mm_or_si128(isSlash, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        isValid = _mm_or_si128(isValid, isInRangeSse2(v, 'a', 'z'));
+        isValid = _mm_or_si128(isValid, isInRangeSse2(v, 'A', 'Z'));
+        isValid = _mm_or_si128(isValid, isInRangeSse2(v, '0', '9'));
+        if (_mm_movemask_epi8(isValid) != 0xffff) {
+            return false;
+        }
+        const uint32 slashes = uint32(_mm_movemask_epi8(isSlash));
+        if (slashes & ((slashes << 1) | prevIsSlash)) {
+            return false;
+        }
+        prevIsSlash = slashes >> 15;
+    }
+    return isObjectPathCharactersTail(data, i, length, prevIsSlash);
+}
+
+#endif // DFERRY_HAVE_SSE2_KERNELS
+
+#ifdef DFERRY_HAVE_AVX2_KERNELS
+
+__attribute__((target("avx2")))
+static bool isUtf8WithoutNulAvx2(const byte *data, uint32 length)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint32 i = 0;
+    while (length - i >= 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero))) {
+            return false;
+        }
+        if (likely(!_mm256_movemask_epi8(v))) {
+            i += 32;
+        } else if (!validateUtf8(data, &i, i + 32, length)) {
+            return false;
+        }
+    }
+    return validateUtf8(data, &i, length, length);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i isInRangeAvx2(__m256i v, char low, char high)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(low - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), v));
+}
+
+__attribute__((target("avx2")))
+static bool isObjectPathCharactersAvx2(const byte *data, uint32 length)
+{
+    uint32 i = 0;
+    uint32 prevIsSlash = 0;
+    for (; length - i >= 32; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const __m256i isSlash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+        __m256i isValid = _mm256_or_si256(isSlash, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        isValid = _mm256_or_si256(isValid, isInRangeAvx2(v, 'a', 'z'));
+        isValid = _mm256_or_si256(isValid, isInRangeAvx2(v, 'A', 'Z'));
+        isValid = _mm256_or_si256(isValid, isInRangeAvx2(v, '0', '9'));
+        if (uint32(_mm256_movemask_epi8(isValid)) != 0xffffffffu) {
+            return false;
+        }
+        const uint32 slashes = uint32(_mm256_movemask_epi8(isSlash));
+        if (slashes & ((slashes << 1) | prevIsSlash)) {
+            return false;
+        }
+        prevIsSlash = slashes >> 31;
+    }
+    return isObjectPathCharactersTail(data, i, length, prevIsSlash);
+}
+
+#endif // DFERRY_HAVE_AVX2_KERNELS
+
+namespace {
+struct Kernels
+{
+    bool (*isUtf8WithoutNul)(const byte *data, uint32 length);
+    bool (*isObjectPathCharacters)(const byte *data, uint32 length);
+};
+}
+
+static Kernels selectKernels()
+{
+    static const Kernels scalar = { isUtf8WithoutNulScalar, isObjectPathCharactersScalar };
+    const char *forced = getenv("DFERRY_VALIDATION_KERNEL");
+    if (forced && !strcmp(forced, "scalar")) {
+        return scalar;
+    }
+#ifdef DFERRY_HAVE_AVX2_KERNELS
+    static const Kernels avx2 = { isUtf8WithoutNulAvx2, isObjectPathCharactersAvx2 };
+    __builtin_cpu_init();
+    if ((!forced || !strcmp(forced, "avx2")) && __builtin_cpu_supports("avx2")) {
+        return avx2;
+    }
+#endif
+#ifdef DFERRY_HAVE_SSE2_KERNELS
+    // SSE2 is part of the x86-64 baseline and in practice also always available in 32 bit builds
+    // compiled with -msse2
+    static const Kernels sse2 = { isUtf8WithoutNulSse2, isObjectPathCharactersSse2 };
+    return sse2;
+#else
+    return scalar;
+#endif
+}
+
+static const Kernels &kernels()
+{
+    static const Kernels selected = selectKernels();
+    return selected;
+}
+
+namespace validation
+{
+
+bool isUtf8WithoutNul(const byte *data, uint32 length)
+{
+    return kernels().isUtf8WithoutNul(data, length);
+}
+
+bool isObjectPathCharacters(const byte *data, uint32 length)
+{
+    return kernels().isObjectPathCharacters(data, length);
+}
+
+}
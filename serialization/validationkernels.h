@@ -0,0 +1,43 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#ifndef VALIDATIONKERNELS_H
+#define VALIDATIONKERNELS_H
+
+#include "types.h"
+
+// Checks of string data that run on every string and object path read or written.
+// There are scalar, SSE2 and AVX2 implementations of each, the best one is selected at runtime by
+// CPU feature detection. The environment variable DFERRY_VALIDATION_KERNEL=scalar|sse2|avx2
+// overrides the selection, for testing and benchmarking.
+namespace validation
+{
+
+// @p data contains no zero bytes and is valid UTF-8
+bool isUtf8WithoutNul(const byte *data, uint32 length);
+// @p data contains only the characters allowed in object paths, [A-Z][a-z][0-9]_/, and no "//"
+bool isObjectPathCharacters(const byte *data, uint32 length);
+
+}
+
+#endif // VALIDATIONKERNELS_H
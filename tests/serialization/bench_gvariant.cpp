@@ -0,0 +1,141 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+
+// Microbenchmark for random access to arguments in GVariant format, compared to finding the same values
+// with a Reader on data in D-Bus format, and for the cost of converting between the two formats.
+
+#include "arguments.h"
+#include "error.h"
+#include "gvariant.h"
+
+#include "../testutil.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static const int s_entryCount = 1000;
+
+template<typename F>
+static void benchmark(const char *name, int iterations, F function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        function();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << ": " << elapsed.count() * 1000000 / iterations << " us per iteration\n";
+}
+
+// a large property dict followed by a large string array
+static Arguments writeArguments()
+{
+    Arguments::Writer writer;
+    writer.beginDict();
+    for (int i = 0; i < s_entryCount; i++) {
+        const std::string key = "Property" + std::to_string(i);
+        writer.writeString(cstring(key.c_str(), key.length()));
+        writer.beginVariant();
+        if (i % 2) {
+            writer.writeUint32(i);
+        } else {
+            writer.writeString(cstring(key.c_str(), key.length()));
+        }
+        writer.endVariant();
+    }
+    writer.endDict();
+    writer.beginArray();
+    for (int i = 0; i < s_entryCount; i++) {
+        const std::string element = "Element" + std::to_string(i);
+        writer.writeString(cstring(element.c_str(), element.length()));
+    }
+    writer.endArray();
+    return writer.finish();
+}
+
+static uint32 readerLookup(const Arguments &arguments, cstring key)
+{
+    uint32 ret = 0;
+    Arguments::Reader reader(arguments);
+    reader.beginDict();
+    while (reader.state() != Arguments::EndDict) {
+        const cstring entryKey = reader.readString();
+        if (entryKey.length == key.length && memcmp(entryKey.ptr, key.ptr, key.length) == 0) {
+            reader.beginVariant();
+            ret = reader.readUint32();
+            break;
+        }
+        reader.skipCurrentElement();
+    }
+    return ret;
+}
+
+static cstring readerArrayElement(const Arguments &arguments, uint32 index)
+{
+    Arguments::Reader reader(arguments);
+    reader.skipCurrentElement();
+    reader.beginArray();
+    for (uint32 i = 0; i < index; i++) {
+        reader.readString();
+    }
+    return reader.readString();
+}
+
+int main(int, char *[])
+{
+    const Arguments arguments = writeArguments();
+    const GVariantArguments gvariant(arguments);
+    TEST(!gvariant.error().isError());
+    std::cout << "a{sv}as with " << s_entryCount << " entries each, " << arguments.data().length
+              << " bytes in D-Bus format, " << gvariant.data().length << " bytes in GVariant format\n";
+
+    const cstring lastKey("Property999");
+    TEST(readerLookup(arguments, lastKey) == 999);
+    TEST(gvariant.argument(0).lookup(lastKey)[0].toUint32() == 999);
+    benchmark("dict lookup of last key, Reader", 20000, [&arguments, lastKey] {
+        TEST(readerLookup(arguments, lastKey));
+    });
+    benchmark("dict lookup of last key, GVariant", 20000, [&gvariant, lastKey] {
+        TEST(gvariant.argument(0).lookup(lastKey)[0].toUint32());
+    });
+
+    const uint32 lastIndex = s_entryCount - 1;
+    TEST(strcmp(readerArrayElement(arguments, lastIndex).ptr, "Element999") == 0);
+    TEST(strcmp(gvariant.argument(1)[lastIndex].toString().ptr, "Element999") == 0);
+    benchmark("last array element, Reader", 20000, [&arguments, lastIndex] {
+        TEST(readerArrayElement(arguments, lastIndex).length);
+    });
+    benchmark("last array element, GVariant", 20000, [&gvariant, lastIndex] {
+        TEST(gvariant.argument(1)[lastIndex].toString().length);
+    });
+
+    benchmark("convert to GVariant", 2000, [&arguments] {
+        TEST(GVariantArguments(arguments).data().length);
+    });
+    benchmark("convert from GVariant", 2000, [&gvariant] {
+        TEST(gvariant.toArguments().data().length);
+    });
+    return 0;
+}
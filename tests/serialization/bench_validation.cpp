@@ -0,0 +1,179 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+// Microbenchmark for the string validation that happens when reading and writing strings.
+// Run with DFERRY_VALIDATION_KERNEL=scalar|sse2|avx2 to compare the implementations.
+// Reading is measured at every Arguments::ValidationLevel.
+
+#include "arguments.h"
+
+#include "../testutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static const int s_entryCount = 2000;
+
+static std::string makeString(int i, bool isAscii)
+{
+    std::string ret = isAscii ? "org.example.SomeInterface.Property" : "Gr\xc3\xbc\xc3\x9f" "e aus K\xc3\xb6ln, ";
+    ret += std::to_string(i);
+    return ret;
+}
+
+static Arguments createStringDict()
+{
+    Arguments::Writer writer;
+    writer.beginDict();
+    for (int i = 0; i < s_entryCount; i++) {
+        const std::string key = makeString(i, true);
+        const std::string value = makeString(i, i % 4 != 0);
+        writer.writeString(cstring(key.c_str(), key.length()));
+        writer.writeString(cstring(value.c_str(), value.length()));
+    }
+    writer.endDict();
+    return writer.finish();
+}
+
+static Arguments createStringArray()
+{
+    Arguments::Writer writer;
+    writer.beginArray();
+    for (int i = 0; i < s_entryCount; i++) {
+        const std::string str = makeString(i, true) + makeString(i, true);
+        writer.writeString(cstring(str.c_str(), str.length()));
+    }
+    writer.endArray();
+    return writer.finish();
+}
+
+static Arguments createObjectPathArray()
+{
+    Arguments::Writer writer;
+    writer.beginArray();
+    for (int i = 0; i < s_entryCount; i++) {
+        const std::string path = "/org/example/SomeObject/Child" + std::to_string(i);
+        writer.writeObjectPath(cstring(path.c_str(), path.length()));
+    }
+    writer.endArray();
+    return writer.finish();
+}
+
+static uint32 readAllStrings(const Arguments &args)
+{
+    uint32 totalLength = 0;
+    Arguments::Reader reader(args);
+    while (reader.state() != Arguments::Finished) {
+        switch (reader.state()) {
+        case Arguments::BeginArray:
+            reader.beginArray();
+            break;
+        case Arguments::EndArray:
+            reader.endArray();
+            break;
+        case Arguments::BeginDict:
+            reader.beginDict();
+            break;
+        case Arguments::EndDict:
+            reader.endDict();
+            break;
+        case Arguments::String:
+            totalLength += reader.readString().length;
+            break;
+        case Arguments::ObjectPath:
+            totalLength += reader.readObjectPath().length;
+            break;
+        default:
+            TEST(false);
+            return totalLength;
+        }
+    }
+    return totalLength;
+}
+
+template<typename F>
+static void benchmark(const char *name, uint32 bytesPerIteration, F function)
+{
+    const int iterations = 200;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        function();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const double megabytes = double(bytesPerIteration) * iterations / (1024 * 1024);
+    std::cout << name << ": " << elapsed.count() * 1000 / iterations << " ms per iteration, "
+              << megabytes / elapsed.count() << " MiB/s\n";
+}
+
+int main(int, char *[])
+{
+    const char *kernel = getenv("DFERRY_VALIDATION_KERNEL");
+    std::cout << "Validation kernel: " << (kernel ? kernel : "(automatic)") << '\n';
+
+    static const struct {
+        Arguments::ValidationLevel level;
+        const char *name;
+    } levels[] = {
+        { Arguments::FullValidation, "full" },
+        { Arguments::StructuralValidation, "structural" },
+        { Arguments::TrustedData, "trusted" }
+    };
+    const struct {
+        const char *name;
+        Arguments args;
+    } inputs[] = {
+        { "read a{ss}", createStringDict() },
+        { "read as", createStringArray() },
+        { "read ao", createObjectPathArray() }
+    };
+    for (const auto &input : inputs) {
+        for (const auto &level : levels) {
+            Arguments args(input.args);
+            args.setValidationLevel(level.level);
+            const std::string name = std::string(input.name) + ", " + level.name;
+            benchmark(name.c_str(), args.data().length, [&args] { TEST(readAllStrings(args) > 0); });
+        }
+    }
+
+    std::string longString;
+    std::string longPath;
+    for (int i = 0; i < 100; i++) {
+        longString += makeString(i, true);
+        longPath += "/org/example/Object" + std::to_string(i);
+    }
+    const cstring longStringView(longString.c_str(), longString.length());
+    benchmark("isStringValid, 100 x 1000 bytes", 100 * longString.length(), [&longStringView] {
+        for (int i = 0; i < 100; i++) {
+            TEST(Arguments::isStringValid(longStringView));
+        }
+    });
+    const cstring longPathView(longPath.c_str(), longPath.length());
+    benchmark("isObjectPathValid, 100 x 2000 bytes", 100 * longPath.length(), [&longPathView] {
+        for (int i = 0; i < 100; i++) {
+            TEST(Arguments::isObjectPathValid(longPathView));
+        }
+    });
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+
+// Microbenchmark for writing variants, with the contained type declared upfront with
+// Writer::beginVariant(cstring) and without (which needs a fixup pass in Writer::flushQueuedData()).
+
+#include "arguments.h"
+#include "error.h"
+
+#include "../testutil.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const int s_entryCount = 50;
+
+static std::vector<std::string> makeKeys()
+{
+    std::vector<std::string> ret;
+    for (int i = 0; i < s_entryCount; i++) {
+        ret.push_back("Property" + std::to_string(i));
+    }
+    return ret;
+}
+
+// a typical property dict, as in PropertiesChanged signals and GetAll replies
+static void writePropertyDict(Arguments::Writer *writer, const std::vector<std::string> &keys, bool declare)
+{
+    writer->beginDict();
+    for (int i = 0; i < s_entryCount; i++) {
+        writer->writeString(cstring(keys[i].c_str(), keys[i].length()));
+        switch (i % 4) {
+        case 0:
+            declare ? writer->beginVariant(cstring("u")) : writer->beginVariant();
+            writer->writeUint32(i);
+            break;
+        case 1:
+            declare ? writer->beginVariant(cstring("s")) : writer->beginVariant();
+            writer->writeString(cstring(keys[i].c_str(), keys[i].length()));
+            break;
+        case 2:
+            declare ? writer->beginVariant(cstring("b")) : writer->beginVariant();
+            writer->writeBoolean(i & 1);
+            break;
+        case 3:
+            declare ? writer->beginVariant(cstring("(dd)")) : writer->beginVariant();
+            writer->beginStruct();
+            writer->writeDouble(i);
+            writer->writeDouble(i * 2);
+            writer->endStruct();
+            break;
+        }
+        writer->endVariant();
+    }
+    writer->endDict();
+}
+
+static Arguments writePropertyDict(const std::vector<std::string> &keys, bool declare)
+{
+    Arguments::Writer writer;
+    writePropertyDict(&writer, keys, declare);
+    return writer.finish();
+}
+
+// a property dict inside a variant, e.g. a property of type a{sv}. All the data inside an undeclared
+// variant goes through the fixup pass.
+static Arguments writeNestedPropertyDict(const std::vector<std::string> &keys, bool declare)
+{
+    Arguments::Writer writer;
+    declare ? writer.beginVariant(cstring("a{sv}")) : writer.beginVariant();
+    writePropertyDict(&writer, keys, declare);
+    writer.endVariant();
+    return writer.finish();
+}
+
+template<typename F>
+static void benchmark(const char *name, F function)
+{
+    const int iterations = 20000;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        function();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << ": " << elapsed.count() * 1000000 / iterations << " us per iteration\n";
+}
+
+int main(int, char *[])
+{
+    const std::vector<std::string> keys = makeKeys();
+    const Arguments undeclared = writePropertyDict(keys, false);
+    const Arguments declared = writePropertyDict(keys, true);
+    TEST(!declared.error().isError());
+    TEST(declared.data().length == undeclared.data().length);
+
+    std::cout << "a{sv} with " << s_entryCount << " entries, " << declared.data().length << " bytes\n";
+    benchmark("write, beginVariant()", [&keys] { TEST(writePropertyDict(keys, false).data().length); });
+    benchmark("write, beginVariant(signature)", [&keys] { TEST(writePropertyDict(keys, true).data().length); });
+    benchmark("write nested, beginVariant()", [&keys] {
+        TEST(writeNestedPropertyDict(keys, false).data().length);
+    });
+    benchmark("write nested, beginVariant(signature)", [&keys] {
+        TEST(writeNestedPropertyDict(keys, true).data().length);
+    });
+    // Arguments::copyOneElement() declares the contained types
+    benchmark("copy with Reader and Writer", [&declared] {
+        Arguments::Reader reader(declared);
+        Arguments::Writer writer;
+        while (reader.state() != Arguments::Finished) {
+            Arguments::copyOneElement(&reader, &writer);
+        }
+        TEST(writer.finish().data().length);
+    });
+    return 0;
+}
@@ -22,6 +22,8 @@
 */
 
 #include "arguments.h"
+#include "error.h"
+#include "typedarguments.h"
 
 #include "../testutil.h"
 
@@ -29,6 +31,7 @@
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <thread>
 
 // Handy helpers
 
@@ -421,13 +424,16 @@ static void verifyAfterRoundtrip(const Arguments &original, const Arguments::Rea
     TEST(chunksEqual(originalData, copyData));
 }
 
-static void doRoundtripWithShortReads(const Arguments &original, uint32 dataIncrement, bool debugPrint)
+static void doRoundtripWithShortReads(const Arguments &original, uint32 dataIncrement, bool isStreaming,
+                                      bool debugPrint)
 {
     const chunk data = original.data();
     chunk shortData;
 
     Arguments arg(nullptr, original.signature(), shortData, original.fileDescriptors());
     Arguments::Reader reader(arg);
+    reader.setStreaming(isStreaming);
+    TEST(reader.isStreaming() == isStreaming);
     Arguments::Writer writer;
 
     bool isDone = false;
@@ -542,7 +548,8 @@ static void doRoundtripWithWriterCopy(const Arguments &original, uint32 dataIncr
 
 static void doRoundtripForReal(const Arguments &original, uint32 dataIncrement, bool debugPrint)
 {
-    doRoundtripWithShortReads(original, dataIncrement, debugPrint);
+    doRoundtripWithShortReads(original, dataIncrement, false, debugPrint);
+    doRoundtripWithShortReads(original, dataIncrement, true, debugPrint);
     doRoundtripWithReaderCopy(original, dataIncrement, debugPrint);
     doRoundtripWithWriterCopy(original, dataIncrement, debugPrint);
 }
@@ -696,6 +703,21 @@ static void test_stringValidation()
         cstring badStruct2("(i))");
         TEST(!Arguments::isSignatureValid(badStruct2));
         TEST(!Arguments::isSignatureValid(badStruct2, Arguments::VariantSignature));
+        // the struct ends where the dict entry should have ended
+        cstring badStruct3("(ia{sv)");
+        TEST(!Arguments::isSignatureValid(badStruct3));
+        TEST(!Arguments::isSignatureValid(badStruct3, Arguments::VariantSignature));
+        cstring badStruct4("a(a(i)");
+        TEST(!Arguments::isSignatureValid(badStruct4));
+    }
+    {
+        const std::string maxLength(Arguments::MaxSignatureLength, 'i');
+        TEST(Arguments::isSignatureValid(cstring(maxLength.c_str(), maxLength.length())));
+        const std::string tooLong(Arguments::MaxSignatureLength + 1, 'i');
+        TEST(!Arguments::isSignatureValid(cstring(tooLong.c_str(), tooLong.length())));
+        Arguments::Writer writer;
+        writer.writeSignature(cstring(tooLong.c_str(), tooLong.length()));
+        TEST(writer.state() == Arguments::InvalidData);
     }
     {
         cstring nullStr;
@@ -727,6 +749,60 @@ static void test_stringValidation()
         TEST(!Arguments::isSignatureValid(array33));
         TEST(!Arguments::isSignatureValid(array33, Arguments::VariantSignature));
     }
+    {
+        TEST(Arguments::isStringValid(cstring("h\xc3\xa9llo \xe2\x82\xac \xf0\x9f\x98\x80")));
+        TEST(!Arguments::isStringValid(cstring("\xc0\xaf"))); // overlong
+        TEST(!Arguments::isStringValid(cstring("\xe0\x80\xaf"))); // overlong
+        TEST(!Arguments::isStringValid(cstring("\xed\xa0\x80"))); // surrogate
+        TEST(!Arguments::isStringValid(cstring("\xf4\x90\x80\x80"))); // above U+10FFFF
+        TEST(!Arguments::isStringValid(cstring("\xe2\x82"))); // truncated
+        TEST(!Arguments::isStringValid(cstring("\x80")));
+        TEST(!Arguments::isStringValid(cstring("\xff")));
+    }
+    {
+        // strings long enough for the SIMD code paths, with interesting things at all positions
+        // relative to the 16 and 32 byte blocks
+        for (uint32 length = 1; length < 100; length++) {
+            std::string str(length, 'a');
+            TEST(Arguments::isStringValid(cstring(str.c_str(), str.length())));
+            for (uint32 i = 0; i < length; i++) {
+                std::string withNul = str;
+                withNul[i] = '\0';
+                TEST(!Arguments::isStringValid(cstring(withNul.c_str(), withNul.length())));
+
+                if (i + 3 <= length) {
+                    std::string withEuro = str;
+                    withEuro.replace(i, 3, "\xe2\x82\xac");
+                    TEST(Arguments::isStringValid(cstring(withEuro.c_str(), withEuro.length())));
+                    withEuro[i + 2] = 'a';
+                    TEST(!Arguments::isStringValid(cstring(withEuro.c_str(), withEuro.length())));
+                }
+            }
+            std::string truncated = str;
+            truncated[length - 1] = '\xc3';
+            TEST(!Arguments::isStringValid(cstring(truncated.c_str(), truncated.length())));
+
+            std::string path = "/" + str;
+            for (uint32 i = 2; i < path.length(); i += 3) {
+                path[i] = "/_Z9"[i % 4];
+            }
+            if (path.back() == '/') {
+                path.back() = 'z';
+            }
+            TEST(Arguments::isObjectPathValid(cstring(path.c_str(), path.length())));
+            for (uint32 i = 1; i < path.length() - 1; i++) {
+                std::string badPath = path;
+                badPath[i] = '-';
+                TEST(!Arguments::isObjectPathValid(cstring(badPath.c_str(), badPath.length())));
+                badPath[i] = '\xc3';
+                TEST(!Arguments::isObjectPathValid(cstring(badPath.c_str(), badPath.length())));
+                badPath = path;
+                badPath[i] = '/';
+                badPath[i + 1] = '/';
+                TEST(!Arguments::isObjectPathValid(cstring(badPath.c_str(), badPath.length())));
+            }
+        }
+    }
 }
 
 static void test_nesting()
@@ -1932,12 +2008,1159 @@ static void test_closeWrongAggregate()
     }
 }
 
+struct TypedPoint
+{
+    int32 x;
+    double y;
+    std::string label;
+};
+
+template<>
+struct DBusType<TypedPoint>
+    : DBusStructType<TypedPoint, DBusStructMember<TypedPoint, int32, &TypedPoint::x>,
+                                 DBusStructMember<TypedPoint, double, &TypedPoint::y>,
+                                 DBusStructMember<TypedPoint, std::string, &TypedPoint::label>> {};
+
+static bool argumentsEqual(const Arguments &a, const Arguments &b)
+{
+    return stringsEqual(a.signature(), b.signature()) && chunksEqual(a.data(), b.data());
+}
+
+static void test_typedArguments()
+{
+    typedef std::tuple<int32, std::string, std::vector<uint64>> Tuple;
+    static_assert(DBusType<Tuple>::Signature::length == 6 && DBusType<Tuple>::Signature::value[3] == 'a',
+                  "signature must be known at compile time");
+    TEST(stringsEqual(dbusSignature<Tuple>(), cstring("(isat)")));
+    TEST(stringsEqual(dbusSignature<std::map<std::string, std::vector<bool>>>(), cstring("a{sab}")));
+    TEST(stringsEqual(dbusSignature<std::vector<TypedPoint>>(), cstring("a(ids)")));
+    TEST(stringsEqual(dbusSignature<std::vector<std::tuple<byte, int16, uint16, uint32, int64>>>(),
+                      cstring("a(ynqux)")));
+
+    const Tuple tuple(-5, "Hello", { 1, 2, uint64(1) << 40 });
+    const std::vector<TypedPoint> points = { { 1, 0.5, "one" }, { -2, 2.25, "" } };
+    std::map<std::string, std::vector<bool>> flags;
+    flags["empty"];
+    flags["tft"] = { true, false, true };
+    const std::vector<std::string> noStrings;
+
+    // The fast path must produce exactly the same data as the regular API
+    for (int i = 0; i < 2; i++) {
+        const bool inArray = i == 1;
+        Arguments::Writer typedWriter;
+        Arguments::Writer regularWriter;
+        if (inArray) {
+            typedWriter.beginArray();
+            regularWriter.beginArray();
+        }
+        for (int j = 0; j < (inArray ? 3 : 1); j++) {
+            typedWriter.beginStruct();
+            typedWriter.writeByte(1); // misalign
+            writeTyped(&typedWriter, tuple, points, flags, noStrings);
+            typedWriter.endStruct();
+
+            regularWriter.beginStruct();
+            regularWriter.writeByte(1);
+            DBusType<Tuple>::write(&regularWriter, tuple);
+            DBusType<std::vector<TypedPoint>>::write(&regularWriter, points);
+            DBusType<std::map<std::string, std::vector<bool>>>::write(&regularWriter, flags);
+            DBusType<std::vector<std::string>>::write(&regularWriter, noStrings);
+            regularWriter.endStruct();
+        }
+        if (inArray) {
+            typedWriter.endArray();
+            regularWriter.endArray();
+        }
+        TEST(typedWriter.state() != Arguments::InvalidData);
+        TEST(regularWriter.state() != Arguments::InvalidData);
+        Arguments typedArgs = typedWriter.finish();
+        Arguments regularArgs = regularWriter.finish();
+        TEST(argumentsEqual(typedArgs, regularArgs));
+        doRoundtrip(typedArgs, false);
+    }
+
+    // Inside a variant, writeTyped() has to go the slow way; reading back
+    {
+        Arguments::Writer writer;
+        writeTyped(&writer, tuple);
+        writer.beginVariant();
+        writeTyped(&writer, points);
+        writer.endVariant();
+        writeTyped(&writer, flags);
+        TEST(writer.state() != Arguments::InvalidData);
+        Arguments arg = writer.finish();
+        TEST(stringsEqual(arg.signature(), cstring("(isat)va{sab}")));
+        doRoundtrip(arg, false);
+
+        Arguments::Reader reader(arg);
+        Tuple tupleOut;
+        std::vector<TypedPoint> pointsOut;
+        std::map<std::string, std::vector<bool>> flagsOut;
+        TEST(!readTyped(&reader, &pointsOut)); // wrong type, nothing happens
+        TEST(readTyped(&reader, &tupleOut));
+        TEST(tupleOut == tuple);
+        reader.beginVariant();
+        TEST(readTyped(&reader, &pointsOut));
+        reader.endVariant();
+        TEST(readTyped(&reader, &flagsOut));
+        TEST(flagsOut == flags);
+        TEST(reader.state() == Arguments::Finished);
+        TEST(pointsOut.size() == points.size());
+        for (size_t k = 0; k < points.size(); k++) {
+            TEST(pointsOut[k].x == points[k].x && pointsOut[k].y == points[k].y &&
+                 pointsOut[k].label == points[k].label);
+        }
+    }
+
+    // Errors are the same as with the regular API
+    {
+        Arguments::Writer writer;
+        writeTyped(&writer, std::string("em\0bedded", 9));
+        TEST(writer.state() == Arguments::InvalidData);
+    }
+    {
+        Arguments::Writer writer;
+        writer.beginArray();
+        writeTyped(&writer, tuple);
+        writeTyped(&writer, points);
+        TEST(writer.state() == Arguments::InvalidData);
+        TEST(writer.error().code() == Error::TypeMismatchInSubsequentArrayIteration);
+    }
+}
+
+static void test_signatureCache()
+{
+    // Compiled signatures are cached per thread, with a limited number of entries. Use more signatures
+    // than fit into the cache, several times, to test replacement of cache entries.
+    std::vector<Arguments> args;
+    for (int i = 0; i < 50; i++) {
+        Arguments::Writer writer;
+        writer.beginStruct();
+        for (int j = 0; j <= i; j++) {
+            if (j % 3 == 2) {
+                writer.beginArray();
+                writer.writeString(cstring("x"));
+                writer.endArray();
+            } else {
+                writer.writeInt32(j);
+            }
+        }
+        writer.endStruct();
+        writer.beginVariant();
+        writer.beginVariant();
+        writer.writeUint16(i);
+        writer.endVariant();
+        writer.endVariant();
+        TEST(writer.state() != Arguments::InvalidData);
+        args.push_back(writer.finish());
+    }
+    for (int round = 0; round < 3; round++) {
+        for (size_t i = 0; i < args.size(); i++) {
+            const Arguments &arg = args[(i * 7 + round) % args.size()];
+            Arguments::Reader reader(arg);
+            TEST(reader.state() == Arguments::BeginStruct);
+            reader.skipStruct();
+            TEST(reader.state() == Arguments::BeginVariant);
+            reader.skipVariant();
+            TEST(reader.state() != Arguments::InvalidData);
+        }
+    }
+
+    // hit and miss counters, also of validation through isSignatureValid() and the Writer
+    {
+        const cstring signature("a(sa{tv})");
+        const Arguments::SignatureCacheStatistics before = Arguments::signatureCacheStatistics();
+        TEST(Arguments::isSignatureValid(signature));
+        Arguments::SignatureCacheStatistics after = Arguments::signatureCacheStatistics();
+        TEST(after.misses == before.misses + 1 && after.hits == before.hits);
+        TEST(Arguments::isSignatureValid(signature));
+        TEST(Arguments::isSignatureValid(signature, Arguments::VariantSignature));
+        after = Arguments::signatureCacheStatistics();
+        TEST(after.misses == before.misses + 2 && after.hits == before.hits + 1);
+
+        Arguments::Writer writer;
+        writer.writeSignature(signature);
+        writer.beginVariant(signature);
+        writer.beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.beginStruct();
+        writer.writeString(cstring());
+        writer.beginDict(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.writeUint64(0);
+        writer.beginVariant();
+        writer.endVariant();
+        writer.endDict();
+        writer.endStruct();
+        writer.endArray();
+        writer.endVariant();
+        Arguments arg = writer.finish();
+        TEST(writer.state() == Arguments::Finished);
+        after = Arguments::signatureCacheStatistics();
+        TEST(after.misses == before.misses + 2 && after.hits >= before.hits + 3);
+
+        // invalid signatures are not cached
+        TEST(!Arguments::isSignatureValid(cstring("a(sa{tv)")));
+        TEST(!Arguments::isSignatureValid(cstring("a(sa{tv)")));
+        after = Arguments::signatureCacheStatistics();
+        TEST(after.misses == before.misses + 4);
+
+        // too deeply nested for a raw value at the current position, though valid on its own
+        Arguments::Writer nestedWriter;
+        for (int i = 0; i < 31; i++) {
+            nestedWriter.beginArray();
+        }
+        uint32 position = 0;
+        TEST(nestedWriter.rawDataPosition(&position));
+        TEST(!nestedWriter.writeRawValue(cstring("aai"), position + 8));
+        TEST(nestedWriter.state() == Arguments::InvalidData);
+        TEST(nestedWriter.error().code() == Error::InvalidSignature);
+
+        // Unix file descriptors can't be written as raw values
+        for (const char *signature : { "h", "(ih)", "ah" }) {
+            Arguments::Writer fdWriter;
+            TEST(fdWriter.rawDataPosition(&position));
+            TEST(!fdWriter.writeRawValue(cstring(signature), position + 8));
+            TEST(fdWriter.state() == Arguments::InvalidData);
+            TEST(fdWriter.error().code() == Error::InvalidType);
+        }
+
+        // the statistics are per thread
+        std::thread([]() {
+            TEST(Arguments::isSignatureValid(cstring("a(sa{tv})")));
+            const Arguments::SignatureCacheStatistics otherThread = Arguments::signatureCacheStatistics();
+            TEST(otherThread.hits == 0 && otherThread.misses == 1);
+        }).join();
+    }
+
+    // currentSingleCompleteTypeSignature() in various states
+    {
+        Arguments::Writer writer;
+        writer.writeInt32(1);
+        writer.beginArray();
+        writer.beginStruct();
+        writer.writeString(cstring("a"));
+        writer.beginVariant();
+        writer.writeByte(2);
+        writer.endVariant();
+        writer.endStruct();
+        writer.endArray();
+        writer.beginDict();
+        writer.writeString(cstring("key"));
+        writer.beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.writeInt32(3);
+        writer.endArray();
+        writer.endDict();
+        Arguments arg = writer.finish();
+        TEST(stringsEqual(arg.signature(), cstring("ia(sv)a{sai}")));
+
+        Arguments::Reader reader(arg);
+        TEST(stringsEqual(reader.currentSingleCompleteTypeSignature(), cstring("i")));
+        reader.readInt32();
+        TEST(stringsEqual(reader.currentSingleCompleteTypeSignature(), cstring("a(sv)")));
+        reader.beginArray();
+        TEST(stringsEqual(reader.currentSingleCompleteTypeSignature(), cstring("(sv)")));
+        reader.beginStruct();
+        reader.readString();
+        TEST(stringsEqual(reader.currentSingleCompleteTypeSignature(), cstring("v")));
+        reader.beginVariant();
+        TEST(stringsEqual(reader.currentSingleCompleteTypeSignature(), cstring("y")));
+        reader.readByte();
+        TEST(reader.currentSingleCompleteTypeSignature().length == 0); // EndVariant
+        reader.endVariant();
+        TEST(reader.currentSingleCompleteTypeSignature().length == 0); // EndStruct
+        reader.endStruct();
+        reader.endArray();
+        TEST(stringsEqual(reader.currentSingleCompleteTypeSignature(), cstring("a{sai}")));
+        reader.beginDict();
+        TEST(stringsEqual(reader.currentSingleCompleteTypeSignature(), cstring("s")));
+        reader.readString();
+        TEST(stringsEqual(reader.currentSingleCompleteTypeSignature(), cstring("ai")));
+        reader.skipArray();
+        TEST(reader.state() == Arguments::EndDict);
+        reader.endDict();
+        TEST(reader.state() == Arguments::Finished);
+        TEST(reader.currentSingleCompleteTypeSignature().length == 0);
+    }
+}
+
+struct TelemetrySample // the same layout as D-Bus (tdd)
+{
+    uint64 time;
+    double value1;
+    double value2;
+};
+
+struct TimeAndId // the same layout as D-Bus (tu), with 4 bytes of padding at the end
+{
+    uint64 time;
+    uint32 id;
+};
+
+static void test_fixedStructArray()
+{
+    {
+        Arguments::FixedStructLayout layout;
+        TEST(Arguments::fixedStructLayout(cstring("(tdd)"), &layout));
+        TEST(layout.size == 24 && layout.stride == 24 && layout.fields.size() == 3);
+        TEST(Arguments::fixedStructLayout(cstring("(y(yq)u)"), &layout));
+        TEST(layout.size == 16 && layout.stride == 16 && layout.fields.size() == 4);
+        TEST(layout.fields[1].offset == 8 && layout.fields[2].offset == 10 && layout.fields[3].offset == 12);
+        TEST(!Arguments::fixedStructLayout(cstring("(ib)"), &layout));
+        TEST(!Arguments::fixedStructLayout(cstring("(is)"), &layout));
+        TEST(!Arguments::fixedStructLayout(cstring("(iai)"), &layout));
+        TEST(!Arguments::fixedStructLayout(cstring("i"), &layout));
+    }
+
+    for (uint32 count : { 0u, 1u, 2u, 1000u }) {
+        for (int inVariant = 0; inVariant < 2; inVariant++) {
+            std::vector<TelemetrySample> samples(count);
+            std::vector<TimeAndId> ids(count);
+            for (uint32 i = 0; i < count; i++) {
+                samples[i].time = uint64(i) << 33;
+                samples[i].value1 = i * 0.5;
+                samples[i].value2 = -1.0 * i;
+                memset(&ids[i], 0xaa, sizeof(TimeAndId)); // garbage in the padding
+                ids[i].time = i;
+                ids[i].id = i * 3;
+            }
+
+            Arguments::Writer writer;
+            writer.writeByte(1);
+            if (inVariant) {
+                writer.beginVariant();
+            }
+            writer.writeFixedStructArray(cstring("(tdd)"),
+                                         chunk(reinterpret_cast<byte *>(samples.data()),
+                                               count * sizeof(TelemetrySample)));
+            if (inVariant) {
+                writer.endVariant();
+            }
+            writer.writeFixedStructArray(cstring("(tu)"),
+                                         chunk(reinterpret_cast<byte *>(ids.data()), count * sizeof(TimeAndId)));
+            TEST(writer.state() != Arguments::InvalidData);
+            Arguments arg = writer.finish();
+            TEST(stringsEqual(arg.signature(), cstring(inVariant ? "yva(tu)" : "ya(tdd)a(tu)")));
+            if (count < 100) {
+                doRoundtrip(arg, false); // it is slow with large data
+            }
+
+            Arguments::Reader reader(arg);
+            TEST(reader.readByte() == 1);
+            if (inVariant) {
+                reader.beginVariant();
+            }
+            Arguments::FixedStructLayout layout;
+            std::pair<Arguments::IoState, chunk> array = reader.readFixedStructArray(&layout);
+            TEST(array.first == Arguments::BeginStruct);
+            TEST(array.second.length == count * sizeof(TelemetrySample));
+            TEST(!count || memcmp(array.second.ptr, samples.data(), array.second.length) == 0);
+            if (inVariant) {
+                TEST(reader.state() == Arguments::EndVariant);
+                reader.endVariant();
+            }
+
+            // read the second one the slow way, then the fast way, and compare
+            Arguments::Reader slowReader(reader);
+            TEST(slowReader.state() == Arguments::BeginArray);
+            slowReader.beginArray();
+            for (uint32 i = 0; i < count; i++) {
+                slowReader.beginStruct();
+                TEST(slowReader.readUint64() == i);
+                TEST(slowReader.readUint32() == i * 3);
+                slowReader.endStruct();
+            }
+            slowReader.endArray();
+            TEST(slowReader.state() == Arguments::Finished);
+
+            array = reader.readFixedStructArray(&layout);
+            TEST(array.first == Arguments::BeginStruct);
+            TEST(layout.stride == sizeof(TimeAndId));
+            TEST(layout.elementCount(array.second.length) == count);
+            for (uint32 i = 0; i < count; i++) {
+                const byte *element = array.second.ptr + i * layout.stride;
+                uint64 time;
+                uint32 id;
+                memcpy(&time, element + layout.fields[0].offset, sizeof(time));
+                memcpy(&id, element + layout.fields[1].offset, sizeof(id));
+                TEST(time == i && id == i * 3);
+                if (i + 1 < count) {
+                    TEST(memcmp(element + 12, "\0\0\0\0", 4) == 0);
+                }
+            }
+            TEST(reader.state() == Arguments::Finished);
+        }
+    }
+
+    // not suitable: the Reader stays unchanged
+    {
+        Arguments::Writer writer;
+        writer.beginArray();
+        writer.beginStruct();
+        writer.writeInt32(1);
+        writer.writeBoolean(true);
+        writer.endStruct();
+        writer.endArray();
+        Arguments arg = writer.finish();
+        Arguments::Reader reader(arg);
+        Arguments::FixedStructLayout layout;
+        TEST(reader.readFixedStructArray(&layout).first == Arguments::InvalidData);
+        TEST(reader.state() == Arguments::BeginArray);
+    }
+    // wrong input length
+    {
+        Arguments::Writer writer;
+        byte data[20] = { 0 };
+        writer.writeFixedStructArray(cstring("(tu)"), chunk(data, 20));
+        TEST(writer.state() == Arguments::InvalidData);
+    }
+}
+
 // TODO: test where we compare data and signature lengths of all combinations of zero/nonzero array
 //       length and long/short type signature, to make sure that the signature is written but not
 //       any data if the array is zero-length.
 
 // TODO test empty dicts, too
 
+static void beginVariantMaybeDeclared(Arguments::Writer *writer, const char *signature, bool declare)
+{
+    if (declare) {
+        writer->beginVariant(cstring(signature));
+    } else {
+        writer->beginVariant();
+    }
+}
+
+// writes a property dict a{sv} with the contained types of the variants declared upfront or not
+static Arguments createPropertyDict(bool declare)
+{
+    Arguments::Writer writer;
+    writer.writeByte(1); // misalign the dict
+    writer.beginDict();
+        writer.writeString(cstring("uint"));
+        beginVariantMaybeDeclared(&writer, "u", declare);
+            writer.writeUint32(42);
+        writer.endVariant();
+        writer.writeString(cstring("string"));
+        beginVariantMaybeDeclared(&writer, "s", declare);
+            writer.writeString(cstring("forty-two"));
+        writer.endVariant();
+        writer.writeString(cstring("struct"));
+        beginVariantMaybeDeclared(&writer, "(yd)", declare);
+            writer.beginStruct();
+                writer.writeByte(4);
+                writer.writeDouble(2.0);
+            writer.endStruct();
+        writer.endVariant();
+        writer.writeString(cstring("array"));
+        beginVariantMaybeDeclared(&writer, "at", declare);
+            writer.beginArray();
+                writer.writeUint64(1);
+                writer.writeUint64(2);
+            writer.endArray();
+        writer.endVariant();
+        writer.writeString(cstring("emptyArray"));
+        beginVariantMaybeDeclared(&writer, "av", declare);
+            writer.beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+                beginVariantMaybeDeclared(&writer, "s", declare);
+                    writer.writeString(cstring("ignored"));
+                writer.endVariant();
+            writer.endArray();
+        writer.endVariant();
+        writer.writeString(cstring("nested"));
+        beginVariantMaybeDeclared(&writer, "v", declare);
+            beginVariantMaybeDeclared(&writer, "ay", declare);
+                byte bytes[] = { 1, 2, 3 };
+                writer.writePrimitiveArray(Arguments::Byte, chunk(bytes, sizeof(bytes)));
+            writer.endVariant();
+        writer.endVariant();
+        writer.writeString(cstring("mixed"));
+        beginVariantMaybeDeclared(&writer, "(vq)", declare);
+            writer.beginStruct();
+                writer.beginVariant(); // undeclared inside declared
+                    beginVariantMaybeDeclared(&writer, "n", declare); // and declared inside that
+                        writer.writeInt16(-1);
+                    writer.endVariant();
+                writer.endVariant();
+                writer.writeUint16(7);
+            writer.endStruct();
+        writer.endVariant();
+    writer.endDict();
+    writer.writeByte(2);
+    TEST(writer.state() != Arguments::InvalidData);
+    return writer.finish();
+}
+
+static void test_declaredVariant()
+{
+    {
+        const Arguments undeclared = createPropertyDict(false);
+        const Arguments declared = createPropertyDict(true);
+        TEST(!declared.error().isError());
+        TEST(strcmp(declared.signature().ptr, undeclared.signature().ptr) == 0);
+        TEST(chunksEqual(declared.data(), undeclared.data()));
+        doRoundtrip(declared);
+    }
+    // the contents must match the declared type
+    {
+        Arguments::Writer writer;
+        writer.beginVariant(cstring("u"));
+        writer.writeString(cstring("not a uint"));
+        TEST(writer.state() == Arguments::InvalidData);
+    }
+    {
+        Arguments::Writer writer;
+        writer.beginVariant(cstring("(ii)"));
+        writer.beginStruct();
+        writer.writeInt32(1);
+        writer.endStruct();
+        TEST(writer.state() == Arguments::InvalidData);
+    }
+    {
+        Arguments::Writer writer;
+        writer.beginVariant(cstring("ai"));
+        writer.endVariant();
+        TEST(writer.state() == Arguments::InvalidData);
+        TEST(writer.error().code() == Error::EmptyVariant);
+    }
+    {
+        Arguments::Writer writer;
+        writer.beginVariant(cstring("ii"));
+        TEST(writer.state() == Arguments::InvalidData);
+        TEST(writer.error().code() == Error::InvalidSignature);
+        writer.endVariant();
+        TEST(writer.state() == Arguments::InvalidData);
+        writer.finish();
+        TEST(writer.error().code() == Error::InvalidSignature);
+    }
+    {
+        Arguments::Writer writer;
+        writer.beginVariant(cstring("ii"));
+        writer.writeInt32(1);
+        TEST(writer.state() == Arguments::InvalidData);
+        TEST(writer.error().code() == Error::InvalidSignature);
+    }
+    {
+        Arguments::Writer writer;
+        writer.beginVariant(cstring("(i"));
+        writer.writeInt32(1);
+        writer.endVariant();
+        TEST(writer.state() == Arguments::InvalidData);
+        TEST(writer.error().code() == Error::InvalidSignature);
+    }
+}
+
+static void writeSomeArguments(Arguments::Writer *writer, uint32 stringCount)
+{
+    writer->writeByte(1);
+    writer->beginArray(stringCount ? Arguments::Writer::NonEmptyArray
+                                   : Arguments::Writer::WriteTypesOfEmptyArray);
+    for (uint32 i = 0; i < std::max(stringCount, 1u); i++) {
+        writer->writeString(cstring("Some string to fill the buffer"));
+    }
+    writer->endArray();
+    writer->beginVariant();
+    writer->writeUint64(12345678);
+    writer->endVariant();
+}
+
+static Arguments createSomeArguments(uint32 stringCount)
+{
+    Arguments::Writer writer;
+    writeSomeArguments(&writer, stringCount);
+    return writer.finish();
+}
+
+static void test_writerReuse()
+{
+    // reusing a heap buffer
+    {
+        Arguments::Writer writer;
+        writeSomeArguments(&writer, 0);
+        writer.reset(); // before finish()
+        TEST(writer.state() == Arguments::AnyData);
+        TEST(writer.currentSignature().length == 0);
+        writeSomeArguments(&writer, 2);
+        TEST(argumentsEqual(writer.finish(), createSomeArguments(2)));
+        writer.reset(); // after finish()
+        writeSomeArguments(&writer, 1);
+        TEST(argumentsEqual(writer.finish(), createSomeArguments(1)));
+    }
+    // an error does not stick after reset()
+    {
+        Arguments::Writer writer;
+        writer.endStruct();
+        TEST(writer.state() == Arguments::InvalidData);
+        writer.reset();
+        TEST(writer.isValid());
+        writeSomeArguments(&writer, 3);
+        TEST(argumentsEqual(writer.finish(), createSomeArguments(3)));
+    }
+    // caller-provided buffer
+    {
+        alignas(8) byte buffer[1024];
+        Arguments::Writer writer(chunk(buffer, sizeof(buffer)));
+        writeSomeArguments(&writer, 2);
+        const chunk data = writer.peekSerializedData();
+        TEST(data.ptr > buffer && data.ptr < buffer + sizeof(buffer));
+        const Arguments arg = writer.finish();
+        TEST(arg.data().ptr != data.ptr); // copied
+        TEST(argumentsEqual(arg, createSomeArguments(2)));
+        doRoundtrip(arg);
+
+        // spill to the heap...
+        writer.reset();
+        writeSomeArguments(&writer, 100);
+        TEST(writer.peekSerializedData().ptr != data.ptr);
+        const Arguments largeArg = writer.finish();
+        TEST(argumentsEqual(largeArg, createSomeArguments(100)));
+
+        // ...and back
+        writer.reset();
+        writeSomeArguments(&writer, 0);
+        TEST(writer.peekSerializedData().ptr == data.ptr);
+        TEST(argumentsEqual(writer.finish(), createSomeArguments(0)));
+    }
+    // unusable buffers are ignored
+    {
+        alignas(8) byte buffer[1024];
+        for (chunk unusable : { chunk(buffer + 1, sizeof(buffer) - 1), chunk(buffer, 16), chunk() }) {
+            Arguments::Writer writer(unusable);
+            writeSomeArguments(&writer, 2);
+            const chunk data = writer.peekSerializedData();
+            TEST(data.ptr < buffer || data.ptr >= buffer + sizeof(buffer));
+            TEST(argumentsEqual(writer.finish(), createSomeArguments(2)));
+        }
+    }
+}
+
+static void test_streamingReader()
+{
+    Arguments arg;
+    {
+        Arguments::Writer writer;
+        writer.writeUint32(1);
+        writer.beginArray();
+        for (uint32 i = 0; i < 100; i++) {
+            writer.writeUint32(i);
+        }
+        writer.endArray();
+        writer.beginDict();
+        for (uint32 i = 0; i < 20; i++) {
+            maybeBeginDictEntry(&writer);
+            writer.writeUint32(i);
+            writer.writeString(cstring("value"));
+            maybeEndDictEntry(&writer);
+        }
+        writer.endDict();
+        writer.writeByte(2);
+        arg = writer.finish();
+        TEST(writer.state() == Arguments::Finished);
+    }
+    const chunk data = arg.data();
+
+    // enter arrays before they have fully arrived, and skip them when they have
+    {
+        chunk shortData(data.ptr, 0);
+        Arguments partial(nullptr, arg.signature(), shortData);
+        Arguments::Reader reader(partial);
+        reader.setStreaming(true);
+        uint32 needMoreDataCount = 0;
+        auto feed = [&]() {
+            while (reader.state() == Arguments::NeedMoreData) {
+                TEST(shortData.length < data.length);
+                shortData.length++;
+                reader.replaceData(shortData);
+                needMoreDataCount++;
+            }
+        };
+
+        feed();
+        TEST(reader.readUint32() == 1);
+        feed();
+        TEST(reader.state() == Arguments::BeginArray);
+        TEST(reader.peekPrimitiveArray() == Arguments::BeginArray);
+        TEST(reader.readPrimitiveArray().first == Arguments::InvalidData);
+        TEST(reader.state() == Arguments::BeginArray);
+        TEST(reader.beginArray());
+        const uint32 countBeforeArray = needMoreDataCount;
+        for (uint32 i = 0; i < 100; i++) {
+            feed();
+            TEST(reader.readUint32() == i);
+        }
+        TEST(needMoreDataCount > countBeforeArray); // we did read from an incomplete array
+        feed();
+        reader.endArray();
+        feed();
+        TEST(reader.state() == Arguments::BeginDict);
+        while (reader.state() == Arguments::BeginDict) {
+            reader.skipDict();
+            TEST(reader.state() == Arguments::NeedMoreData || reader.state() == Arguments::Byte);
+            feed();
+        }
+        TEST(reader.readByte() == 2);
+        TEST(reader.state() == Arguments::Finished);
+        TEST(shortData.length == data.length);
+    }
+
+    // without streaming mode, an array is only entered when it has fully arrived
+    {
+        const uint32 arrayEnd = 4 + 4 + 100 * 4;
+        Arguments partial(nullptr, arg.signature(), chunk(data.ptr, arrayEnd - 1));
+        Arguments::Reader reader(partial);
+        TEST(!reader.isStreaming());
+        TEST(reader.readUint32() == 1);
+        TEST(reader.state() == Arguments::NeedMoreData);
+        reader.replaceData(chunk(data.ptr, arrayEnd));
+        TEST(reader.state() == Arguments::BeginArray);
+        TEST(reader.peekPrimitiveArray() == Arguments::Uint32);
+    }
+
+    // running out of data in an array is still an error if the array should have fully arrived
+    {
+        // signature "as", an array with a length of 4 containing a string of length 5
+        alignas(8) byte malformed[16] = { 0 };
+        const uint32 arrayLength = 4;
+        const uint32 stringLength = 5;
+        memcpy(malformed, &arrayLength, sizeof(uint32));
+        memcpy(malformed + 4, &stringLength, sizeof(uint32));
+        memcpy(malformed + 8, "hello", 6);
+
+        Arguments partial(nullptr, cstring("as"), chunk(malformed, 7));
+        Arguments::Reader reader(partial);
+        reader.setStreaming(true);
+        TEST(reader.state() == Arguments::BeginArray);
+        TEST(reader.beginArray());
+        TEST(reader.state() == Arguments::NeedMoreData);
+        reader.replaceData(chunk(malformed, 10));
+        TEST(reader.state() == Arguments::InvalidData);
+        TEST(reader.error().code() == Error::MalformedMessageData);
+    }
+}
+
+// Reads everything and returns whether that succeeded
+static bool readAll(Arguments::Reader *reader)
+{
+    while (true) {
+        switch (reader->state()) {
+        case Arguments::Finished:
+            return true;
+        case Arguments::InvalidData:
+        case Arguments::NeedMoreData:
+            return false;
+        case Arguments::Boolean:
+            reader->readBoolean();
+            break;
+        case Arguments::Byte:
+            reader->readByte();
+            break;
+        case Arguments::Uint32:
+            reader->readUint32();
+            break;
+        case Arguments::String:
+            reader->readString();
+            break;
+        case Arguments::ObjectPath:
+            reader->readObjectPath();
+            break;
+        default:
+            TEST(false);
+            return false;
+        }
+    }
+}
+
+static bool readsWithLevel(const char *signature, chunk data, Arguments::ValidationLevel level)
+{
+    Arguments arg(nullptr, cstring(signature), data);
+    arg.setValidationLevel(level);
+    TEST(arg.validationLevel() == level);
+    Arguments::Reader reader(arg);
+    // a copy of a Reader checks at the level of the original
+    Arguments::Reader readerCopy(reader);
+    const bool ret = readAll(&reader);
+    TEST(readAll(&readerCopy) == ret);
+    return ret;
+}
+
+static void test_validationLevels()
+{
+    const Arguments::ValidationLevel full = Arguments::FullValidation;
+    const Arguments::ValidationLevel structural = Arguments::StructuralValidation;
+    const Arguments::ValidationLevel trusted = Arguments::TrustedData;
+
+    alignas(8) byte data[16];
+    auto setData = [&data](uint32 first, const char *rest, uint32 restLength) {
+        memset(data, 0, sizeof(data));
+        memcpy(data, &first, sizeof(uint32));
+        memcpy(data + 4, rest, restLength);
+    };
+
+    // well-formed data
+    setData(3, "abc", 4);
+    TEST(readsWithLevel("s", chunk(data, 8), full));
+    TEST(readsWithLevel("s", chunk(data, 8), structural));
+    TEST(readsWithLevel("s", chunk(data, 8), trusted));
+
+    // string contents are only checked with FullValidation
+    setData(3, "a\xff" "c", 4);
+    TEST(!readsWithLevel("s", chunk(data, 8), full));
+    TEST(readsWithLevel("s", chunk(data, 8), structural));
+    TEST(readsWithLevel("s", chunk(data, 8), trusted));
+
+    setData(4, "/a//", 5);
+    TEST(!readsWithLevel("o", chunk(data, 9), full));
+    TEST(readsWithLevel("o", chunk(data, 9), structural));
+
+    // the null terminator is always checked, that is what makes reading strings safe
+    setData(3, "abcd", 4);
+    TEST(!readsWithLevel("s", chunk(data, 8), full));
+    TEST(!readsWithLevel("s", chunk(data, 8), structural));
+    TEST(!readsWithLevel("s", chunk(data, 8), trusted));
+
+    // non-zero padding and out of range booleans are only accepted with TrustedData
+    setData(1, "\x01\x00\x00\x00", 4);
+    data[1] = 0xff;
+    TEST(!readsWithLevel("yu", chunk(data, 8), full));
+    TEST(!readsWithLevel("yu", chunk(data, 8), structural));
+    TEST(readsWithLevel("yu", chunk(data, 8), trusted));
+
+    setData(2, "", 0);
+    TEST(!readsWithLevel("b", chunk(data, 4), full));
+    TEST(!readsWithLevel("b", chunk(data, 4), structural));
+    TEST(readsWithLevel("b", chunk(data, 4), trusted));
+
+    // lengths are always checked
+    setData(100, "abc", 4);
+    TEST(!readsWithLevel("s", chunk(data, 8), trusted));
+
+    // the level survives copying of Arguments
+    Arguments arg(nullptr, cstring("s"), chunk(data, 8));
+    arg.setValidationLevel(structural);
+    Arguments copy(arg);
+    TEST(copy.validationLevel() == structural);
+}
+
+static void test_structArrayColumns()
+{
+    std::vector<Arguments::Column> columns; // reused to test that
+    for (uint32 count : { 0u, 1u, 3u, 1000u }) {
+        std::vector<std::string> names;
+        for (uint32 i = 0; i < count; i++) {
+            names.push_back("name" + std::to_string(i));
+        }
+        // an empty array needs one element to write the types
+        const uint32 writeCount = std::max(count, 1u);
+        Arguments::Writer writer;
+        writer.beginArray(count ? Arguments::Writer::NonEmptyArray : Arguments::Writer::WriteTypesOfEmptyArray);
+        for (uint32 i = 0; i < writeCount; i++) {
+            const std::string name = count ? names[i] : std::string();
+            writer.beginStruct();
+            writer.writeString(cstring(name.c_str(), name.length()));
+            writer.writeUint32(i * 3);
+            writer.writeUint64(uint64(i) << 40);
+            writer.writeBoolean(i % 2);
+            writer.writeByte(i);
+            writer.writeDouble(i * 0.25);
+            writer.writeInt16(-int16(i));
+            writer.endStruct();
+        }
+        writer.endArray();
+        writer.beginArray(count ? Arguments::Writer::NonEmptyArray : Arguments::Writer::WriteTypesOfEmptyArray);
+        for (uint32 i = 0; i < writeCount; i++) {
+            writer.beginStruct();
+            writer.writeObjectPath(cstring("/a/b"));
+            writer.writeSignature(cstring(i % 2 ? "a{sv}" : ""));
+            writer.endStruct();
+        }
+        writer.endArray();
+        writer.writeByte(42);
+        const Arguments arg = writer.finish();
+        TEST(!arg.error().isError());
+
+        Arguments::Reader reader(arg);
+        TEST(reader.readStructArrayColumns(&columns));
+        TEST(columns.size() == 7);
+        TEST(columns[0].type == Arguments::String && columns[6].type == Arguments::Int16);
+        for (const Arguments::Column &column : columns) {
+            TEST(column.count == count);
+        }
+        for (uint32 i = 0; i < count; i++) {
+            TEST(stringsEqual(columns[0].strings[i], cstring(names[i].c_str(), names[i].length())));
+            TEST(columns[1].values<uint32>()[i] == i * 3);
+            TEST(columns[2].values<uint64>()[i] == uint64(i) << 40);
+            TEST(columns[3].values<bool>()[i] == bool(i % 2));
+            TEST(columns[4].values<byte>()[i] == byte(i));
+            TEST(columns[5].values<double>()[i] == i * 0.25);
+            TEST(columns[6].values<int16>()[i] == -int16(i));
+        }
+        TEST(reader.state() == Arguments::BeginArray);
+
+        TEST(reader.readStructArrayColumns(&columns));
+        TEST(columns.size() == 2);
+        TEST(columns[0].type == Arguments::ObjectPath && columns[1].type == Arguments::Signature);
+        TEST(columns[0].count == count && columns[0].data.empty());
+        for (uint32 i = 0; i < count; i++) {
+            TEST(stringsEqual(columns[0].strings[i], cstring("/a/b")));
+            TEST(stringsEqual(columns[1].strings[i], cstring(i % 2 ? "a{sv}" : "")));
+        }
+        TEST(reader.readByte() == 42);
+        TEST(reader.state() == Arguments::Finished);
+    }
+
+    // not suitable: the Reader stays unchanged
+    {
+        Arguments::Writer writer;
+        writer.beginArray();
+        writer.beginStruct();
+        writer.writeInt32(1);
+        writer.beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.writeString(cstring());
+        writer.endArray();
+        writer.endStruct();
+        writer.endArray();
+        writer.beginArray();
+        writer.beginStruct();
+        writer.writeInt32(1);
+        writer.beginStruct();
+        writer.writeInt32(2);
+        writer.endStruct();
+        writer.endStruct();
+        writer.endArray();
+        writer.beginArray();
+        writer.writeInt32(1);
+        writer.endArray();
+        writer.beginDict();
+        writer.writeString(cstring("key"));
+        writer.writeUint32(1);
+        writer.endDict();
+        const Arguments arg = writer.finish();
+        TEST(stringsEqual(arg.signature(), cstring("a(ias)a(i(i))aia{su}")));
+        Arguments::Reader reader(arg);
+        while (reader.state() != Arguments::Finished) {
+            const Arguments::IoState state = reader.state();
+            TEST(!reader.readStructArrayColumns(&columns));
+            TEST(reader.state() == state);
+            reader.skipCurrentElement();
+        }
+        TEST(!reader.readStructArrayColumns(&columns));
+    }
+
+    // invalid data: regular reading finds the error
+    {
+        alignas(8) byte data[16] = { 0 };
+        const uint32 header[4] = { 8, 0, 1, 2 }; // a boolean with value 2
+        memcpy(data, header, sizeof(header));
+        const Arguments arg(nullptr, cstring("a(ub)"), chunk(data, sizeof(data)));
+        Arguments::Reader reader(arg);
+        TEST(!reader.readStructArrayColumns(&columns));
+        TEST(reader.state() == Arguments::BeginArray);
+        reader.beginArray();
+        reader.beginStruct();
+        reader.readUint32();
+        TEST(reader.state() == Arguments::InvalidData);
+    }
+    {
+        alignas(8) byte data[16] = { 0 };
+        const uint32 header[4] = { 7, 0, 3, 0 }; // array length doesn't end with an element
+        memcpy(data, header, sizeof(header));
+        const Arguments arg(nullptr, cstring("a(uu)"), chunk(data, sizeof(data)));
+        Arguments::Reader reader(arg);
+        TEST(!reader.readStructArrayColumns(&columns));
+        TEST(reader.state() == Arguments::BeginArray);
+    }
+
+    // byte-swapped data
+    {
+        alignas(8) byte data[] = { 0, 0, 0, 11, 0, 0, 0, 0,
+                                   0x12, 0x34, 0, 0, 0, 0, 0, 2, 'a', 'b', 0 };
+        const Arguments arg(nullptr, cstring("a(qs)"), chunk(data, sizeof(data)), true);
+        Arguments::Reader reader(arg);
+        TEST(reader.readStructArrayColumns(&columns));
+        TEST(columns[0].count == 1);
+        TEST(columns[0].values<uint16>()[0] == 0x1234);
+        TEST(stringsEqual(columns[1].strings[0], cstring("ab")));
+        TEST(reader.state() == Arguments::Finished);
+    }
+}
+
+static void test_readerIndex()
+{
+    Arguments::Writer writer;
+    writer.writeByte(7);
+    writer.beginDict();
+    for (int i = 0; i < 50; i++) {
+        const std::string key = "key" + std::to_string(i);
+        writer.writeString(cstring(key.c_str(), key.length()));
+        writer.beginVariant();
+        if (i % 2) {
+            const std::string value = "value" + std::to_string(i);
+            writer.writeString(cstring(value.c_str(), value.length()));
+        } else {
+            writer.writeUint32(i);
+        }
+        writer.endVariant();
+    }
+    // a duplicate key
+    writer.writeString(cstring("key3"));
+    writer.beginVariant();
+    writer.writeBoolean(true);
+    writer.endVariant();
+    writer.endDict();
+    writer.beginStruct();
+    writer.writeInt32(-1);
+    writer.writeString(cstring("struct"));
+    writer.endStruct();
+    // a nested dict, which is not indexed
+    writer.beginVariant();
+    writer.beginDict();
+    writer.writeString(cstring("nested"));
+    writer.beginVariant();
+    writer.writeByte(1);
+    writer.endVariant();
+    writer.endDict();
+    writer.endVariant();
+    writer.beginDict();
+    for (int64 i = -5; i <= 5; i++) {
+        writer.writeInt64(i);
+        writer.writeString(cstring(i < 0 ? "negative" : "non-negative"));
+    }
+    writer.endDict();
+    writer.writeString(cstring("end"));
+    writer.beginDict(Arguments::Writer::WriteTypesOfEmptyArray);
+    writer.writeString(cstring());
+    writer.beginVariant();
+    writer.endVariant();
+    writer.endDict();
+    writer.beginDict();
+    writer.writeUint64(~uint64(0));
+    writer.writeString(cstring("max"));
+    writer.endDict();
+    writer.beginDict();
+    writer.writeDouble(1.0);
+    writer.writeString(cstring("double"));
+    writer.endDict();
+    const Arguments arguments = writer.finish();
+    TEST(!arguments.error().isError());
+
+    const Arguments::Index index(arguments);
+    TEST(!index.error().isError());
+    TEST(index.argumentCount() == 9);
+
+    Arguments::Reader reader(arguments);
+    TEST(reader.seekToArgument(index, 5));
+    TEST(reader.state() == Arguments::String);
+    TEST(std::string(reader.readString().ptr) == "end");
+    TEST(reader.state() == Arguments::BeginDict);
+
+    // backwards, from inside aggregates
+    TEST(reader.seekToArgument(index, 3));
+    reader.beginVariant();
+    reader.beginDict();
+    TEST(reader.seekToArgument(index, 2));
+    TEST(reader.state() == Arguments::BeginStruct);
+    reader.beginStruct();
+    TEST(reader.readInt32() == -1);
+    TEST(reader.seekToArgument(index, 0));
+    TEST(reader.readByte() == 7);
+    TEST(reader.state() == Arguments::BeginDict);
+    TEST(reader.aggregateDepth() == 0);
+
+    TEST(reader.seekToArgument(index, 8));
+    reader.skipCurrentElement();
+    TEST(reader.state() == Arguments::Finished);
+    TEST(!reader.seekToArgument(index, 9));
+    TEST(reader.state() == Arguments::Finished);
+
+    // values in the dict, and reading on from there
+    TEST(reader.seekToDictValue(index, 1, cstring("key20")));
+    TEST(reader.state() == Arguments::BeginVariant);
+    TEST(reader.aggregateStack() == std::vector<Arguments::IoState>{ Arguments::BeginDict });
+    reader.beginVariant();
+    TEST(reader.readUint32() == 20);
+    reader.endVariant();
+    TEST(std::string(reader.readString().ptr) == "key21");
+    reader.beginVariant();
+    TEST(std::string(reader.readString().ptr) == "value21");
+    reader.endVariant();
+    while (reader.state() != Arguments::EndDict) {
+        reader.skipCurrentElement();
+    }
+    reader.endDict();
+    TEST(reader.state() == Arguments::BeginStruct);
+
+    TEST(reader.seekToDictValue(index, 1, cstring("key3")));
+    reader.beginVariant();
+    TEST(reader.state() == Arguments::String); // the first of the duplicates
+    TEST(reader.seekToDictValue(index, 1, cstring("key49")));
+    reader.beginVariant();
+    TEST(std::string(reader.readString().ptr) == "value49");
+
+    TEST(reader.seekToDictValue(index, 4, int64(-3)));
+    TEST(std::string(reader.readString().ptr) == "negative");
+    TEST(reader.readInt64() == -2);
+    TEST(reader.seekToDictValue(index, 7, int64(-1)));
+    TEST(std::string(reader.readString().ptr) == "max");
+    reader.endDict();
+    TEST(reader.state() == Arguments::BeginDict);
+
+    // not found, the Reader is unchanged
+    TEST(!reader.seekToDictValue(index, 1, cstring("key50")));
+    TEST(!reader.seekToDictValue(index, 1, cstring("key")));
+    TEST(!reader.seekToDictValue(index, 1, int64(0))); // wrong key type
+    TEST(!reader.seekToDictValue(index, 4, cstring("-3")));
+    TEST(!reader.seekToDictValue(index, 4, int64(6)));
+    TEST(!reader.seekToDictValue(index, 0, int64(7))); // not a dict
+    TEST(!reader.seekToDictValue(index, 3, cstring("nested")));
+    TEST(!reader.seekToDictValue(index, 6, cstring("")));
+    TEST(!reader.seekToDictValue(index, 8, int64(1)));
+    TEST(!reader.seekToDictValue(index, 9, cstring("key1")));
+    TEST(reader.state() == Arguments::BeginDict);
+    reader.skipCurrentElement();
+    TEST(reader.state() == Arguments::Finished);
+
+    // an index only works with Readers of the Arguments it was built from
+    const Arguments copy = arguments;
+    Arguments::Reader copyReader(copy);
+    TEST(!copyReader.seekToArgument(index, 1));
+    TEST(!copyReader.seekToDictValue(index, 1, cstring("key1")));
+
+    // the index copies and moves
+    Arguments::Index indexCopy = index;
+    Arguments::Index movedIndex = std::move(indexCopy);
+    TEST(reader.seekToDictValue(movedIndex, 1, cstring("key2")));
+    reader.beginVariant();
+    TEST(reader.readUint32() == 2);
+    // moved-from indexes can still be copied, assigned and queried
+    TEST(indexCopy.argumentCount() == 0);
+    TEST(!indexCopy.error().isError());
+    TEST(!reader.seekToArgument(indexCopy, 0));
+    TEST(!reader.seekToDictValue(indexCopy, 1, cstring("key2")));
+    Arguments::Index copyOfMovedFrom = indexCopy;
+    TEST(copyOfMovedFrom.argumentCount() == 0);
+    copyOfMovedFrom = movedIndex;
+    TEST(copyOfMovedFrom.argumentCount() == index.argumentCount());
+    movedIndex = indexCopy;
+    TEST(movedIndex.argumentCount() == 0);
+    indexCopy = copyOfMovedFrom;
+    TEST(reader.seekToDictValue(indexCopy, 1, cstring("key2")));
+
+    {
+        // invalid data is found while building the index
+        alignas(8) byte data[8] = { 3, 0, 0, 0, 'a', 0xff, 'c', 0 };
+        const Arguments invalid(nullptr, cstring("s"), chunk(data, sizeof(data)));
+        const Arguments::Index invalidIndex(invalid);
+        TEST(invalidIndex.error().isError());
+        TEST(invalidIndex.argumentCount() == 0);
+        Arguments::Reader invalidReader(invalid);
+        TEST(!invalidReader.seekToArgument(invalidIndex, 0));
+    }
+    {
+        const Arguments empty;
+        const Arguments::Index emptyIndex(empty);
+        TEST(!emptyIndex.error().isError());
+        TEST(emptyIndex.argumentCount() == 0);
+    }
+}
+
 int main(int, char *[])
 {
     test_stringValidation();
@@ -1955,6 +3178,15 @@ int main(int, char *[])
     test_signatureLengths();
     test_emptyArrayAndDict();
     test_fileDescriptors();
+    test_typedArguments();
+    test_signatureCache();
+    test_fixedStructArray();
+    test_structArrayColumns();
+    test_declaredVariant();
+    test_writerReuse();
+    test_streamingReader();
+    test_validationLevels();
+    test_readerIndex();
 
     // TODO (maybe): specific tests for begin/endDictEntry() for both Reader and Writer.
 
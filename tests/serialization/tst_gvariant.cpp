@@ -0,0 +1,416 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "arguments.h"
+#include "error.h"
+#include "gvariant.h"
+
+#include "../testutil.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+static bool dataEquals(chunk data, const std::vector<byte> &expected)
+{
+    return data.length == expected.size() && memcmp(data.ptr, expected.data(), data.length) == 0;
+}
+
+static void checkRoundtrip(const Arguments &arguments)
+{
+    TEST(!arguments.error().isError());
+    const GVariantArguments gv(arguments);
+    TEST(!gv.error().isError());
+    TEST(strcmp(gv.signature().ptr, arguments.signature().ptr) == 0);
+
+    // converting back results in the same data...
+    const Arguments back = gv.toArguments();
+    TEST(!back.error().isError());
+    TEST(back.signature().length == arguments.signature().length);
+    TEST(memcmp(back.signature().ptr, arguments.signature().ptr, back.signature().length) == 0);
+    TEST(back.data().length == arguments.data().length);
+    TEST(memcmp(back.data().ptr, arguments.data().ptr, back.data().length) == 0);
+
+    // ...also via the GVariant data only
+    const GVariantArguments fromData(gv.signature(), gv.data());
+    TEST(!fromData.error().isError());
+    TEST(dataEquals(fromData.data(), std::vector<byte>(gv.data().ptr, gv.data().ptr + gv.data().length)));
+}
+
+static void test_specExamples()
+{
+    // examples from the GVariant specification
+    {
+        Arguments::Writer writer;
+        writer.writeString(cstring("foo"));
+        const GVariantArguments gv(writer.finish());
+        TEST(dataEquals(gv.data(), { 'f', 'o', 'o', 0 }));
+    }
+    {
+        Arguments::Writer writer;
+        writer.writeString(cstring("foo"));
+        writer.writeInt32(-1);
+        const GVariantArguments gv(writer.finish());
+        TEST(dataEquals(gv.data(), { 'f', 'o', 'o', 0, 0xff, 0xff, 0xff, 0xff, 0x04 }));
+    }
+    {
+        Arguments::Writer writer;
+        writer.beginArray();
+        for (const char *str : { "i", "can", "has", "strings?" }) {
+            writer.writeString(cstring(str));
+        }
+        writer.endArray();
+        const GVariantArguments gv(writer.finish());
+        TEST(dataEquals(gv.data(), { 'i', 0, 'c', 'a', 'n', 0, 'h', 'a', 's', 0,
+                                     's', 't', 'r', 'i', 'n', 'g', 's', '?', 0,
+                                     0x02, 0x06, 0x0a, 0x13 }));
+    }
+    {
+        Arguments::Writer writer;
+        writer.beginVariant();
+        writer.writeString(cstring("foo"));
+        writer.endVariant();
+        writer.writeBoolean(true);
+        const GVariantArguments gv(writer.finish());
+        // the variant is not the last member, so the tuple has the offset of its end
+        TEST(dataEquals(gv.data(), { 'f', 'o', 'o', 0, 0, 's', 1, 0x06 }));
+    }
+    {
+        // fixed-size struct: padded to its alignment, no offsets
+        Arguments::Writer writer;
+        writer.beginStruct();
+        writer.writeByte(0x70);
+        writer.writeInt32(0x12345678);
+        writer.endStruct();
+        const GVariantArguments gv(writer.finish());
+        TEST(gv.data().length == 8);
+        TEST(gv.argument(0)[0].toByte() == 0x70);
+        TEST(gv.argument(0)[1].toInt32() == 0x12345678);
+    }
+    {
+        // empty arguments are the unit type
+        const GVariantArguments gv(Arguments{});
+        TEST(!gv.error().isError());
+        TEST(dataEquals(gv.data(), { 0 }));
+        TEST(gv.argumentCount() == 0);
+        TEST(!gv.argument(0).isValid());
+    }
+}
+
+static void test_roundtrip()
+{
+    {
+        Arguments::Writer writer;
+        writer.writeByte(1);
+        writer.writeBoolean(false);
+        writer.writeInt16(-2);
+        writer.writeUint16(3);
+        writer.writeInt32(-4);
+        writer.writeUint32(5);
+        writer.writeInt64(-6);
+        writer.writeUint64(7);
+        writer.writeDouble(8.5);
+        writer.writeString(cstring("string"));
+        writer.writeObjectPath(cstring("/object/path"));
+        writer.writeSignature(cstring("a{sv}"));
+        checkRoundtrip(writer.finish());
+    }
+    {
+        // nested containers with fixed- and variable-size contents
+        Arguments::Writer writer;
+        writer.beginDict();
+        for (int i = 0; i < 5; i++) {
+            writer.writeString(cstring(i % 2 ? "odd" : "even"));
+            writer.beginVariant();
+            if (i % 2) {
+                writer.beginStruct();
+                writer.writeString(cstring("member"));
+                writer.writeUint64(i);
+                writer.beginArray();
+                writer.writeBoolean(true);
+                writer.writeBoolean(false);
+                writer.endArray();
+                writer.writeString(cstring("last"));
+                writer.endStruct();
+            } else {
+                writer.beginVariant();
+                writer.writeInt16(i);
+                writer.endVariant();
+            }
+            writer.endVariant();
+        }
+        writer.endDict();
+        writer.beginArray();
+        for (int i = 0; i < 3; i++) {
+            writer.beginStruct();
+            writer.writeByte(i);
+            writer.writeDouble(i * 0.5);
+            writer.endStruct();
+        }
+        writer.endArray();
+        writer.beginDict();
+        writer.writeUint32(1);
+        writer.beginArray();
+        writer.writeObjectPath(cstring("/a"));
+        writer.endArray();
+        writer.endDict();
+        checkRoundtrip(writer.finish());
+    }
+    {
+        // empty arrays and dicts
+        Arguments::Writer writer;
+        writer.beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.writeString(cstring());
+        writer.endArray();
+        writer.beginDict(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.writeString(cstring());
+        writer.beginVariant();
+        writer.endVariant();
+        writer.endDict();
+        writer.beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.beginStruct();
+        writer.writeInt64(0);
+        writer.writeObjectPath(cstring("/"));
+        writer.endStruct();
+        writer.endArray();
+        writer.endArray();
+        writer.beginArray(Arguments::Writer::WriteTypesOfEmptyArray);
+        writer.writeUint32(0);
+        writer.endArray();
+        writer.writeByte(0);
+        checkRoundtrip(writer.finish());
+    }
+    for (uint32 count : { 100, 10000, 100000 }) {
+        // containers large enough for 2 and 4 byte offsets
+        Arguments::Writer writer;
+        writer.beginArray();
+        for (uint32 i = 0; i < count; i++) {
+            writer.writeString(cstring("element"));
+        }
+        writer.endArray();
+        writer.writeString(cstring("after"));
+        checkRoundtrip(writer.finish());
+    }
+}
+
+static void test_randomAccess()
+{
+    Arguments::Writer writer;
+    writer.writeUint32(12345);
+    writer.beginDict();
+    for (int i = 0; i < 1000; i++) {
+        const std::string key = "key" + std::to_string(i);
+        writer.writeString(cstring(key.c_str(), key.length()));
+        writer.beginVariant();
+        if (i % 2) {
+            writer.writeInt64(-i);
+        } else {
+            const std::string value = "value" + std::to_string(i);
+            writer.writeString(cstring(value.c_str(), value.length()));
+        }
+        writer.endVariant();
+    }
+    writer.endDict();
+    writer.beginArray();
+    for (int i = 0; i < 1000; i++) {
+        writer.beginStruct();
+        writer.writeUint16(i);
+        writer.writeString(cstring("name"));
+        writer.writeBoolean(i % 3 == 0);
+        writer.endStruct();
+    }
+    writer.endArray();
+
+    const GVariantArguments gv(writer.finish());
+    TEST(!gv.error().isError());
+    TEST(gv.argumentCount() == 3);
+    TEST(gv.argument(0).type() == Arguments::Uint32);
+    TEST(gv.argument(0).toUint32() == 12345);
+    TEST(gv.argument(0).toInt32() == 0); // wrong type
+    TEST(!gv.argument(3).isValid());
+
+    const GVariantArguments::Value dict = gv.argument(1);
+    TEST(dict.type() == Arguments::BeginDict);
+    TEST(dict.count() == 1000);
+    const GVariantArguments::Value entry = dict[500];
+    TEST(entry.type() == Arguments::BeginStruct);
+    TEST(entry.count() == 2);
+    TEST(strcmp(entry[0].toString().ptr, "key500") == 0);
+    TEST(entry[1].type() == Arguments::BeginVariant);
+    TEST(strcmp(entry[1][0].toString().ptr, "value500") == 0);
+    TEST(dict.lookup(cstring("key777"))[0].toInt64() == -777);
+    TEST(strcmp(dict.lookup(cstring("key0"))[0].toString().ptr, "value0") == 0);
+    TEST(!dict.lookup(cstring("key1000")).isValid());
+    TEST(!dict.lookup(cstring("key")).isValid());
+    TEST(!dict[1000].isValid());
+
+    const GVariantArguments::Value array = gv.argument(2);
+    TEST(array.type() == Arguments::BeginArray);
+    TEST(array.count() == 1000);
+    for (uint32 i : { 0, 1, 998, 999 }) {
+        const GVariantArguments::Value element = array[i];
+        TEST(element.type() == Arguments::BeginStruct);
+        TEST(element[0].toUint16() == i);
+        TEST(strcmp(element[1].toString().ptr, "name") == 0);
+        TEST(element[2].toBoolean() == (i % 3 == 0));
+        TEST(!element[3].isValid());
+    }
+    TEST(!array.lookup(cstring("name")).isValid()); // not a dict
+
+    {
+        // the entries of a{ss} are only 1-aligned
+        const char *const keys[] = { "a", "bb", "ccc", "dddd" };
+        const char *const values[] = { "one", "two", "three", "four" };
+        Arguments::Writer stringDictWriter;
+        stringDictWriter.beginDict();
+        for (int i = 0; i < 4; i++) {
+            stringDictWriter.writeString(cstring(keys[i]));
+            stringDictWriter.writeString(cstring(values[i]));
+        }
+        stringDictWriter.endDict();
+        const GVariantArguments stringDictGv(stringDictWriter.finish());
+        TEST(!stringDictGv.error().isError());
+        const GVariantArguments::Value stringDict = stringDictGv.argument(0);
+        for (int i = 0; i < 4; i++) {
+            const GVariantArguments::Value value = stringDict.lookup(cstring(keys[i]));
+            TEST(value.type() == Arguments::String);
+            TEST(strcmp(value.toString().ptr, values[i]) == 0);
+        }
+        TEST(!stringDict.lookup(cstring("b")).isValid());
+    }
+
+    // copies are independent
+    GVariantArguments copy = gv;
+    TEST(copy.argument(1).lookup(cstring("key3"))[0].toInt64() == -3);
+    GVariantArguments moved = std::move(copy);
+    TEST(moved.argument(0).toUint32() == 12345);
+}
+
+static void test_byteSwapped()
+{
+    // arrays "ai" and "ay" in the byte order that this machine doesn't use
+    const uint16 one = 1;
+    const bool isLittleEndian = *reinterpret_cast<const byte *>(&one) == 1;
+    alignas(8) byte data[19] = { 0, 0, 0, 8, 0, 0, 0, 1, 0xff, 0xff, 0xff, 0xfe, 0, 0, 0, 3, 1, 2, 3 };
+    if (!isLittleEndian) {
+        // swap the 32 bit numbers to little endian
+        for (uint32 i = 0; i < 16; i += 4) {
+            std::swap(data[i], data[i + 3]);
+            std::swap(data[i + 1], data[i + 2]);
+        }
+    }
+    const Arguments swapped(nullptr, cstring("aiay"), chunk(data, sizeof(data)), true);
+    const GVariantArguments gv(swapped);
+    TEST(!gv.error().isError());
+
+    Arguments::Writer writer;
+    writer.beginArray();
+    writer.writeInt32(1);
+    writer.writeInt32(-2);
+    writer.endArray();
+    writer.beginArray();
+    for (byte b = 1; b <= 3; b++) {
+        writer.writeByte(b);
+    }
+    writer.endArray();
+    const GVariantArguments native(writer.finish());
+    TEST(!native.error().isError());
+    TEST(dataEquals(gv.data(), std::vector<byte>(native.data().ptr, native.data().ptr + native.data().length)));
+    TEST(gv.argument(0)[1].toInt32() == -2);
+}
+
+static void test_invalidData()
+{
+    const struct {
+        const char *signature;
+        std::vector<byte> data;
+    } invalid[] = {
+        { "s", { 'f', 'o', 'o' } }, // no null terminator
+        { "s", { 'f', 0, 'o', 0 } }, // embedded null
+        { "o", { 'f', 'o', 'o', 0 } },
+        { "b", { 2 } },
+        { "i", { 1, 2, 3 } }, // wrong size
+        { "ai", { 1, 2, 3, 4, 5 } }, // not a multiple of the element size
+        { "as", { 'a', 0, 0x07 } }, // last offset out of range
+        { "as", { 'a', 0, 'b', 0, 0x04, 0x01 } }, // elements not in order
+        { "si", { 'a', 0, 0, 0, 1, 0, 0, 0, 0x09 } }, // member offset out of range
+        { "v", { 'a', 0, 's' } }, // no separator
+        { "v", { 0, 0, 0, 0, 0, 'i', 'i' } }, // not a single complete type
+        { "v", { 1, 0, 0, 0, 0, 'h' } } // file descriptors are not supported
+    };
+    for (const auto &test : invalid) {
+        const GVariantArguments gv(cstring(test.signature),
+                                   chunk(const_cast<byte *>(test.data.data()), test.data.size()));
+        // the tuple itself may be valid, but the value in it is not
+        TEST(!gv.argument(0).isValid() || !gv.argument(0)[0].isValid() || !gv.argument(0)[1].isValid() ||
+             !gv.argument(1).isValid());
+        TEST(gv.toArguments().error().isError());
+    }
+
+    {
+        // error in the framing of the tuple
+        const std::vector<byte> data = { 'a', 0, 0x05 };
+        const GVariantArguments gv(cstring("ss"), chunk(const_cast<byte *>(data.data()), data.size()));
+        TEST(gv.error().code() == Error::MalformedMessageData);
+        TEST(gv.argumentCount() == 0);
+        TEST(gv.toArguments().error().isError());
+    }
+    {
+        // the offset of the end of a dict key is out of range
+        const std::vector<byte> data = { 'a', 100, 2 };
+        const GVariantArguments gv(cstring("a{sv}"), chunk(const_cast<byte *>(data.data()), data.size()));
+        const std::string key(99, 'a');
+        TEST(!gv.argument(0).lookup(cstring(key.c_str(), key.length())).isValid());
+        TEST(!gv.argument(0).lookup(cstring("a")).isValid());
+    }
+    {
+        // a dict key end offset of 0
+        const std::vector<byte> data = { 'a', 0, 0, 3 };
+        const GVariantArguments gv(cstring("a{sv}"), chunk(const_cast<byte *>(data.data()), data.size()));
+        TEST(!gv.argument(0).lookup(cstring("")).isValid());
+    }
+    {
+        const GVariantArguments gv(cstring("a{"), chunk());
+        TEST(gv.error().code() == Error::InvalidSignature);
+        TEST(gv.signature().length == 0);
+    }
+    {
+        Arguments::Writer writer;
+        writer.writeUnixFd(1);
+        const GVariantArguments gv(writer.finish());
+        TEST(gv.error().code() == Error::InvalidType);
+    }
+}
+
+int main(int, char *[])
+{
+    test_specExamples();
+    test_roundtrip();
+    test_randomAccess();
+    test_byteSwapped();
+    test_invalidData();
+    std::cout << "Passed!\n";
+}
@@ -27,6 +27,7 @@
 #include "eventdispatcher.h"
 #include "imessagereceiver.h"
 #include "message.h"
+#include "messagetemplate.h"
 #include "pendingreply.h"
 #include "testutil.h"
 #include "connection.h"
@@ -34,8 +35,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <random>
 
 static void test_signatureHeader()
 {
@@ -98,6 +102,209 @@ void testBasic(const ConnectAddress &clientAddress)
     }
 }
 
+enum {
+    // for pipe2() file descriptor array
+    ReadSide = 0,
+    WriteSide = 1,
+    // how many file descriptors to send in test
+    FdCountToSend = 10
+};
+
+#ifdef __linux__
+enum {
+    BurstMessageCount = 1000,
+    // every BurstFdInterval-th message carries a file descriptor
+    BurstFdInterval = 7,
+    // every BurstLargeInterval-th message is larger than the transport's receive buffer
+    BurstLargeInterval = 100,
+    BurstLargeSize = 100000
+};
+
+static uint32 burstPaddingSize(uint32 index)
+{
+    return index % BurstLargeInterval ? index % 61 : uint32(BurstLargeSize);
+}
+
+class BurstReceiver : public IMessageReceiver
+{
+public:
+    void handleSpontaneousMessageReceived(Message msg, Connection *connection) override
+    {
+        const uint32 index = m_receivedCount++;
+        const bool hasFd = index % BurstFdInterval == 0;
+        TEST(msg.unixFdCount() == (hasFd ? 1 : 0));
+
+        Arguments::Reader reader(msg.arguments());
+        TEST(reader.readUint32() == index);
+        if (hasFd) {
+            // the file descriptor is owned (and eventually closed) by msg
+            const int fd = reader.readUnixFd();
+            uint32 readBuf = 0;
+            TEST(::read(fd, &readBuf, sizeof(uint32)) == sizeof(uint32));
+            TEST(readBuf == index);
+        }
+        const std::vector<byte> padding(burstPaddingSize(index), byte(index));
+        const chunk data = reader.readPrimitiveArray().second;
+        TEST(data.length == padding.size());
+        TEST(std::vector<byte>(data.ptr, data.ptr + data.length) == padding);
+        TEST(reader.isFinished());
+
+        if (m_receivedCount == BurstMessageCount) {
+            connection->eventDispatcher()->interrupt();
+        }
+    }
+
+    uint32 m_receivedCount = 0;
+};
+
+// Many messages arriving at once are read from the socket in large chunks and split up on the receiving
+// side. Check that they all arrive intact and in order, with the file descriptors in the right messages.
+void testMessageBurst(const ConnectAddress &clientAddress)
+{
+    EventDispatcher dispatcher;
+
+    ConnectAddress serverAddress = clientAddress;
+    serverAddress.setRole(ConnectAddress::Role::PeerServer);
+
+    Connection serverConnection(&dispatcher, serverAddress);
+    Connection clientConnection(&dispatcher, clientAddress);
+
+    BurstReceiver receiver;
+    serverConnection.setSpontaneousMessageReceiver(&receiver);
+
+    for (uint32 i = 0; i < BurstMessageCount; i++) {
+        Message msg = Message::createCall("/foo", "org.foo.interface", "burst");
+        Arguments::Writer writer;
+        writer.writeUint32(i);
+        if (i % BurstFdInterval == 0) {
+            int pipeFds[2];
+            TEST(pipe2(pipeFds, O_NONBLOCK) == 0);
+            TEST(::write(pipeFds[WriteSide], &i, sizeof(uint32)) == sizeof(uint32));
+            ::close(pipeFds[WriteSide]);
+            writer.writeUnixFd(pipeFds[ReadSide]);
+        }
+        std::vector<byte> padding(burstPaddingSize(i), byte(i));
+        writer.writePrimitiveArray(Arguments::Byte, chunk(padding.data(), padding.size()));
+        msg.setArguments(writer.finish());
+        clientConnection.sendNoReply(std::move(msg));
+    }
+
+    while (receiver.m_receivedCount < BurstMessageCount && dispatcher.poll()) {
+    }
+    TEST(receiver.m_receivedCount == BurstMessageCount);
+
+    // The received messages were destroyed after handling, so their memory should have been recycled.
+    // The one currently receiving is not back in the pool.
+    Connection::MessagePoolStatistics stats = serverConnection.messagePoolStatistics();
+    TEST(stats.messageHits + stats.messageMisses == BurstMessageCount + 1);
+    TEST(stats.messageHits > BurstMessageCount - 10);
+    TEST(stats.bufferHits > 10 * stats.bufferMisses);
+    TEST(stats.cachedBytes > 0 && stats.cachedBytes <= serverConnection.messagePoolSize());
+
+    serverConnection.setMessagePoolSize(1);
+    stats = serverConnection.messagePoolStatistics();
+    TEST(stats.cachedBytes == 0);
+    serverConnection.setMessagePoolSize(0);
+    TEST(serverConnection.messagePoolSize() == 0);
+    stats = serverConnection.messagePoolStatistics();
+    TEST(stats.messageHits == 0 && stats.bufferMisses == 0);
+}
+
+class StreamingReceiver : public IMessageReceiver
+{
+public:
+    void handleMessageDataReceived(const Message &msg, Connection *) override
+    {
+        if (!m_reader) {
+            m_reader.reset(new Arguments::Reader(msg));
+            m_reader->setStreaming(true);
+        } else {
+            m_reader->replaceData(msg.arguments().data());
+        }
+        m_progressCount++;
+        readAvailable();
+        m_valuesReadEarly = m_nextValue;
+    }
+
+    void handleSpontaneousMessageReceived(Message msg, Connection *connection) override
+    {
+        TEST(m_reader);
+        // the reader is still attached to msg, only its data has changed to the complete body
+        m_reader->replaceData(msg.arguments().data());
+        readAvailable();
+        TEST(m_reader->isFinished());
+        m_reader.reset();
+        m_isDone = true;
+        connection->eventDispatcher()->interrupt();
+    }
+
+    void readAvailable()
+    {
+        while (true) {
+            switch (m_reader->state()) {
+            case Arguments::BeginArray:
+                TEST(m_reader->beginArray());
+                break;
+            case Arguments::Uint32:
+                TEST(m_reader->readUint32() == m_nextValue);
+                m_nextValue++;
+                break;
+            case Arguments::EndArray:
+                m_reader->endArray();
+                break;
+            case Arguments::NeedMoreData:
+            case Arguments::Finished:
+                return;
+            default:
+                TEST(false);
+                return;
+            }
+        }
+    }
+
+    std::unique_ptr<Arguments::Reader> m_reader;
+    uint32 m_progressCount = 0;
+    uint32 m_nextValue = 0;
+    uint32 m_valuesReadEarly = 0;
+    bool m_isDone = false;
+};
+
+// A large message can be read with a streaming Reader while it is still arriving
+void testStreamingReceive(const ConnectAddress &clientAddress)
+{
+    EventDispatcher dispatcher;
+
+    ConnectAddress serverAddress = clientAddress;
+    serverAddress.setRole(ConnectAddress::Role::PeerServer);
+
+    Connection serverConnection(&dispatcher, serverAddress);
+    Connection clientConnection(&dispatcher, clientAddress);
+
+    StreamingReceiver receiver;
+    serverConnection.setSpontaneousMessageReceiver(&receiver);
+    serverConnection.setStreamingBodyThreshold(100000);
+    TEST(serverConnection.streamingBodyThreshold() == 100000);
+
+    static const uint32 valueCount = 1000000;
+    Message msg = Message::createCall("/foo", "org.foo.interface", "stream");
+    Arguments::Writer writer;
+    writer.beginArray();
+    for (uint32 i = 0; i < valueCount; i++) {
+        writer.writeUint32(i);
+    }
+    writer.endArray();
+    msg.setArguments(writer.finish());
+    clientConnection.sendNoReply(std::move(msg));
+
+    while (!receiver.m_isDone && dispatcher.poll()) {
+    }
+    TEST(receiver.m_isDone);
+    TEST(receiver.m_nextValue == valueCount);
+    TEST(receiver.m_progressCount > 1);
+    TEST(receiver.m_valuesReadEarly > 0 && receiver.m_valuesReadEarly < valueCount);
+}
+#endif
+
 void testMessageLength()
 {
     static const uint32 bufferSize = Arguments::MaxArrayLength + 1024;
@@ -130,6 +337,727 @@ void testMessageLength()
     }
 }
 
+void testSerializeLargeBody()
+{
+    // large bodies are not copied into the message's buffer when serializing; check that the
+    // serialized forms are still complete and equivalent
+    std::vector<byte> payload(100000);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = byte(i * 7);
+    }
+    Message msg = Message::createCall("/a", "x");
+    msg.setSerial(1);
+    Arguments::Writer writer;
+    writer.writePrimitiveArray(Arguments::Byte, chunk(payload.data(), payload.size()));
+    msg.setArguments(writer.finish());
+
+    const std::vector<byte> saved = msg.save();
+    TEST(saved.size() > payload.size());
+    const chunk view = msg.serializeAndView();
+    TEST(view.length == saved.size());
+    TEST(memcmp(view.ptr, saved.data(), saved.size()) == 0);
+
+    Message loaded;
+    loaded.load(saved);
+    TEST(!loaded.error().isError());
+    Arguments::Reader reader(loaded.arguments());
+    const chunk data = reader.readPrimitiveArray().second;
+    TEST(data.length == payload.size());
+    TEST(memcmp(data.ptr, payload.data(), payload.size()) == 0);
+    TEST(reader.isFinished());
+}
+
+static void testReceivedHeaders()
+{
+    // string headers of loaded / received messages are not copied until needed, check that they survive
+    // copying, modification and re-serialization of the message
+    Message msg = Message::createCall("/some/path", "org.example.Interface", "method");
+    msg.setDestination("org.example.service");
+    msg.setSerial(1);
+    Arguments::Writer writer;
+    writer.writeString(cstring("argument"));
+    msg.setArguments(writer.finish());
+
+    Message loaded;
+    loaded.load(msg.save());
+    TEST(!loaded.error().isError());
+
+    bool isPresent = false;
+    cstring view = loaded.stringHeaderView(Message::PathHeader, &isPresent);
+    TEST(isPresent);
+    TEST(std::string(view.ptr, view.length) == "/some/path");
+    TEST(view.ptr[view.length] == '\0');
+    view = loaded.stringHeaderView(Message::SenderHeader, &isPresent);
+    TEST(!isPresent && !view.ptr && !view.length);
+    TEST(loaded.interface() == "org.example.Interface");
+
+    Message copy = loaded;
+    TEST(copy.path() == "/some/path");
+    TEST(copy.destination() == "org.example.service");
+    TEST(copy.signature() == "s");
+
+    for (Message *m : { &loaded, &copy }) {
+        m->setPath("/other/path");
+        m->setSender(":1.23");
+        TEST(m->path() == "/other/path");
+        TEST(m->method() == "method");
+
+        Message reloaded;
+        reloaded.load(m->save());
+        TEST(!reloaded.error().isError());
+        TEST(reloaded.path() == "/other/path");
+        TEST(reloaded.interface() == "org.example.Interface");
+        TEST(reloaded.method() == "method");
+        TEST(reloaded.destination() == "org.example.service");
+        TEST(reloaded.sender() == ":1.23");
+        TEST(reloaded.signature() == "s");
+        Arguments::Reader reader(reloaded.arguments());
+        TEST(strcmp(reader.readString().ptr, "argument") == 0);
+        TEST(reader.isFinished());
+    }
+}
+
+static void testSharedCopies()
+{
+    // copies of a received message share its buffer until they are modified
+    Message msg = Message::createSignal("/some/path", "org.example.Interface", "signal");
+    msg.setSerial(1);
+    Arguments::Writer writer;
+    writer.writeString(cstring("argument"));
+    writer.writeUint32(1234);
+    msg.setArguments(writer.finish());
+
+    std::vector<Message> copies;
+    {
+        Message loaded;
+        loaded.load(msg.save());
+        TEST(!loaded.error().isError());
+        for (int i = 0; i < 4; i++) {
+            copies.push_back(loaded);
+        }
+        Message assigned;
+        assigned = loaded;
+        copies.push_back(std::move(assigned));
+        for (const Message &copy : copies) {
+            TEST(copy.arguments().data().ptr == loaded.arguments().data().ptr);
+        }
+    }
+
+    const auto checkOriginal = [](const Message &m) {
+        TEST(m.path() == "/some/path");
+        TEST(m.signature() == "su");
+        Arguments::Reader reader(m.arguments());
+        TEST(strcmp(reader.readString().ptr, "argument") == 0);
+        TEST(reader.readUint32() == 1234);
+        TEST(reader.isFinished());
+    };
+    for (const Message &copy : copies) {
+        checkOriginal(copy);
+    }
+
+    Arguments::Writer writer2;
+    writer2.writeByte(1);
+    copies[0].setArguments(writer2.finish());
+    TEST(copies[0].signature() == "y");
+    TEST(copies[0].path() == "/some/path");
+    TEST(copies[0].arguments().data().ptr != copies[1].arguments().data().ptr);
+
+    copies[1].setPath("/other/path");
+    Message reloaded;
+    reloaded.load(copies[1].save());
+    TEST(reloaded.path() == "/other/path");
+    TEST(reloaded.signature() == "su");
+
+    copies[2] = copies[0];
+    TEST(copies[2].signature() == "y");
+
+    checkOriginal(copies[3]);
+    checkOriginal(copies[4]);
+    TEST(copies[3].arguments().data().ptr == copies[4].arguments().data().ptr);
+    Message copyOfCopy = copies[4];
+    copies.clear();
+    checkOriginal(copyOfCopy);
+}
+
+// writes D-Bus data in the byte order opposite to the native one
+// Writes D-Bus data "by hand", by default in the byte order that this machine doesn't use
+class RawDataWriter
+{
+public:
+    explicit RawDataWriter(bool foreignByteOrder = true) : isForeignByteOrder(foreignByteOrder) {}
+
+    template<typename T>
+    void write(T value)
+    {
+        pad(sizeof(T));
+        byte raw[sizeof(T)];
+        memcpy(raw, &value, sizeof(T));
+        if (isForeignByteOrder) {
+            std::reverse(raw, raw + sizeof(T));
+        }
+        data.insert(data.end(), raw, raw + sizeof(T));
+    }
+    void writeString(const char *str)
+    {
+        write(uint32(strlen(str)));
+        data.insert(data.end(), str, str + strlen(str) + 1);
+    }
+    void writeSignature(const char *signature)
+    {
+        data.push_back(byte(strlen(signature)));
+        data.insert(data.end(), signature, signature + strlen(signature) + 1);
+    }
+    // returns the start of the array contents, which is also where to patch the length
+    uint32 beginArray(uint32 contentAlignment)
+    {
+        write(uint32(0));
+        pad(contentAlignment);
+        return data.size();
+    }
+    void endArray(uint32 contentStart)
+    {
+        byte *length = &data[contentStart - sizeof(uint32)];
+        while ((length - &data[0]) % sizeof(uint32) != 0) {
+            length--; // skip back over padding for 8 byte aligned contents
+        }
+        const uint32 value = data.size() - contentStart;
+        memcpy(length, &value, sizeof(uint32));
+        if (isForeignByteOrder) {
+            std::reverse(length, length + sizeof(uint32));
+        }
+    }
+    void pad(uint32 alignment)
+    {
+        while (data.size() % alignment) {
+            data.push_back(0);
+        }
+    }
+
+    bool isForeignByteOrder;
+    std::vector<byte> data;
+};
+
+static void testLoadByteSwapped()
+{
+    // a message in the other byte order is converted to native byte order when loading / receiving it,
+    // so that the fast paths for native data work on it and it remains consistent when saved again
+    const uint16 one = 1;
+    const bool isLittleEndian = *reinterpret_cast<const byte *>(&one) == 1;
+    const char *const signature = "qat(ix)sa{sv}aunan";
+
+    RawDataWriter body;
+    body.write(uint16(0x1234));
+    uint32 contentStart = body.beginArray(8);
+    for (uint64 i = 0; i < 100; i++) {
+        body.write(uint64(0x0102030405060708ull * i));
+    }
+    body.endArray(contentStart);
+    body.pad(8);
+    body.write(int32(-5));
+    body.write(int64(1ll << 40));
+    body.writeString("hello");
+    contentStart = body.beginArray(8);
+    body.pad(8);
+    body.writeString("k");
+    body.writeSignature("ad");
+    const uint32 innerContentStart = body.beginArray(8);
+    body.write(double(0.5));
+    body.write(double(-2.25));
+    body.endArray(innerContentStart);
+    body.endArray(contentStart);
+    contentStart = body.beginArray(4);
+    for (uint32 i = 0; i < 10; i++) {
+        body.write(uint32(0x01020304 * i));
+    }
+    body.endArray(contentStart);
+    body.write(int16(-2));
+    contentStart = body.beginArray(2);
+    for (int16 i = 0; i < 20; i++) {
+        body.write(int16(0x0102 * i));
+    }
+    body.endArray(contentStart);
+
+    RawDataWriter msgData;
+    msgData.data.push_back(isLittleEndian ? 'B' : 'l');
+    msgData.data.push_back(byte(Message::MethodCallMessage));
+    msgData.data.push_back(0); // flags
+    msgData.data.push_back(1); // protocol version
+    msgData.write(uint32(body.data.size()));
+    msgData.write(uint32(5)); // serial
+    contentStart = msgData.beginArray(8);
+    msgData.pad(8);
+    msgData.data.push_back(byte(Message::PathHeader));
+    msgData.writeSignature("o");
+    msgData.writeString("/a");
+    msgData.pad(8);
+    msgData.data.push_back(byte(Message::MethodHeader));
+    msgData.writeSignature("s");
+    msgData.writeString("x");
+    msgData.pad(8);
+    msgData.data.push_back(byte(Message::SignatureHeader));
+    msgData.writeSignature("g");
+    msgData.writeSignature(signature);
+    msgData.endArray(contentStart);
+    msgData.pad(8);
+    msgData.data.insert(msgData.data.end(), body.data.begin(), body.data.end());
+
+    Message loaded;
+    loaded.load(msgData.data);
+    TEST(!loaded.error().isError());
+    TEST(loaded.serial() == 5);
+    TEST(loaded.path() == "/a");
+    TEST(loaded.signature() == signature);
+    TEST(!loaded.arguments().isByteSwapped());
+
+    // saving must produce a native byte order message with the same contents
+    const std::vector<byte> saved = loaded.save();
+    TEST(saved.size() == msgData.data.size());
+    TEST(saved[0] == (isLittleEndian ? 'l' : 'B'));
+    Message reloaded;
+    reloaded.load(saved);
+    TEST(!reloaded.error().isError());
+
+    for (Message *msg : { &loaded, &reloaded }) {
+        Arguments::Reader reader(msg->arguments());
+        TEST(reader.readUint16() == 0x1234);
+        const std::pair<Arguments::IoState, chunk> array = reader.readPrimitiveArray();
+        TEST(array.first == Arguments::Uint64);
+        TEST(array.second.length == 100 * sizeof(uint64));
+        for (uint64 i = 0; i < 100; i++) {
+            uint64 value;
+            memcpy(&value, array.second.ptr + i * sizeof(uint64), sizeof(uint64));
+            TEST(value == 0x0102030405060708ull * i);
+        }
+        reader.beginStruct();
+        TEST(reader.readInt32() == -5);
+        TEST(reader.readInt64() == 1ll << 40);
+        reader.endStruct();
+        TEST(strcmp(reader.readString().ptr, "hello") == 0);
+        reader.beginDict();
+        TEST(strcmp(reader.readString().ptr, "k") == 0);
+        reader.beginVariant();
+        const std::pair<Arguments::IoState, chunk> doubles = reader.readPrimitiveArray();
+        TEST(doubles.first == Arguments::Double && doubles.second.length == 2 * sizeof(double));
+        double value;
+        memcpy(&value, doubles.second.ptr + sizeof(double), sizeof(double));
+        TEST(value == -2.25);
+        reader.endVariant();
+        reader.endDict();
+        const std::pair<Arguments::IoState, chunk> uints = reader.readPrimitiveArray();
+        TEST(uints.first == Arguments::Uint32 && uints.second.length == 10 * sizeof(uint32));
+        for (uint32 i = 0; i < 10; i++) {
+            uint32 value;
+            memcpy(&value, uints.second.ptr + i * sizeof(uint32), sizeof(uint32));
+            TEST(value == 0x01020304 * i);
+        }
+        TEST(reader.readInt16() == -2);
+        const std::pair<Arguments::IoState, chunk> shorts = reader.readPrimitiveArray();
+        TEST(shorts.first == Arguments::Int16 && shorts.second.length == 20 * sizeof(int16));
+        for (int16 i = 0; i < 20; i++) {
+            int16 value;
+            memcpy(&value, shorts.second.ptr + i * sizeof(int16), sizeof(int16));
+            TEST(value == int16(0x0102 * i));
+        }
+        TEST(reader.isFinished());
+    }
+
+    // data that does not match the signature is rejected
+    std::vector<byte> truncated = msgData.data;
+    truncated.resize(truncated.size() - 8);
+    RawDataWriter bodyLength;
+    bodyLength.write(uint32(body.data.size() - 8));
+    std::copy(bodyLength.data.begin(), bodyLength.data.end(), truncated.begin() + 4);
+    Message malformed;
+    malformed.load(truncated);
+    TEST(malformed.error().isError());
+}
+
+// The header fields as parsed by the generic Arguments::Reader, which is how Message used to do it
+struct GenericHeaders
+{
+    bool isValid = false;
+    bool isPresent[Message::UnixFdsHeader + 1] = {};
+    std::string strings[Message::UnixFdsHeader + 1];
+    uint32 ints[Message::UnixFdsHeader + 1] = {};
+};
+
+static GenericHeaders parseHeadersGenerically(std::vector<byte> data)
+{
+    GenericHeaders ret;
+    const uint16 one = 1;
+    const byte nativeEndianness = *reinterpret_cast<const byte *>(&one) == 1 ? 'l' : 'B';
+    if (data.size() < 16 || (data[0] != 'l' && data[0] != 'B')) {
+        return ret;
+    }
+    const bool isByteSwapped = data[0] != nativeEndianness;
+    auto readUint32 = [&data, isByteSwapped](uint32 offset) {
+        byte raw[sizeof(uint32)];
+        memcpy(raw, &data[offset], sizeof(uint32));
+        if (isByteSwapped) {
+            std::reverse(raw, raw + sizeof(uint32));
+        }
+        uint32 value;
+        memcpy(&value, raw, sizeof(uint32));
+        return value;
+    };
+    const uint64 bodyLength = readUint32(4);
+    const uint64 fieldsEnd = 16 + uint64(readUint32(12));
+    const uint64 headerLength = (fieldsEnd + 7) & ~uint64(7);
+    if (headerLength + bodyLength > Arguments::MaxMessageLength || data.size() != headerLength + bodyLength) {
+        return ret;
+    }
+    for (uint64 i = fieldsEnd; i < headerLength; i++) {
+        if (data[i] != 0) {
+            return ret;
+        }
+    }
+
+    Arguments header(nullptr, cstring("yyyyuua(yv)"), chunk(data.data(), uint32(fieldsEnd)), isByteSwapped);
+    Arguments::Reader reader(header);
+    for (int i = 0; i < 4; i++) {
+        reader.readByte();
+    }
+    reader.readUint32();
+    reader.readUint32();
+    if (reader.state() != Arguments::BeginArray) {
+        return ret;
+    }
+    reader.beginArray();
+    while (reader.state() == Arguments::BeginStruct) {
+        reader.beginStruct();
+        const byte field = reader.readByte();
+        if (reader.state() != Arguments::BeginVariant || field < Message::PathHeader ||
+            field > Message::UnixFdsHeader || ret.isPresent[field]) {
+            return ret;
+        }
+        ret.isPresent[field] = true;
+        reader.beginVariant();
+        const Arguments::IoState state = reader.state();
+        if (field == Message::ReplySerialHeader || field == Message::UnixFdsHeader) {
+            if (state != Arguments::Uint32) {
+                return ret;
+            }
+            ret.ints[field] = reader.readUint32();
+        } else {
+            cstring value;
+            if (field == Message::PathHeader && state == Arguments::ObjectPath) {
+                value = reader.readObjectPath();
+            } else if (field == Message::SignatureHeader && state == Arguments::Signature) {
+                value = reader.readSignature();
+            } else if (field != Message::PathHeader && field != Message::SignatureHeader &&
+                       state == Arguments::String) {
+                value = reader.readString();
+            } else {
+                return ret;
+            }
+            ret.strings[field] = std::string(value.ptr, value.length);
+        }
+        if (reader.state() != Arguments::EndVariant) {
+            return ret;
+        }
+        reader.endVariant();
+        reader.endStruct();
+    }
+    if (reader.state() != Arguments::EndArray) {
+        return ret;
+    }
+    reader.endArray();
+    ret.isValid = reader.isFinished();
+    return ret;
+}
+
+static void testHeaderCodecDifferential()
+{
+    // Random and randomly corrupted header fields, parsed by Message and by the generic reference.
+    // The only difference allowed is that Message normalizes the byte order of valid messages.
+    std::mt19937 random(12345);
+    auto randomInt = [&random](uint32 max) { return uint32(random() % (max + 1)); };
+    static const char *const strings[] = {
+        "", "/", "/org/example", "/org//example", "org.example.Interface", "x", "ai", "a{sv}", "(ii", "a(yv)",
+        "Gr\xc3\xbc\xc3\x9f" "e", "bad\xff", "a.b.c/d", "/a_b/C9"
+    };
+    static const char letters[] = { 'o', 's', 'g', 'u', 'v', 'y', 'i', 'a' };
+
+    const uint16 one = 1;
+    const bool isLittleEndian = *reinterpret_cast<const byte *>(&one) == 1;
+
+    uint32 validCount = 0;
+    for (int iteration = 0; iteration < 20000; iteration++) {
+        RawDataWriter msgData(randomInt(3) == 0);
+        msgData.data.push_back(msgData.isForeignByteOrder == isLittleEndian ? 'B' : 'l');
+        msgData.data.push_back(byte(Message::SignalMessage));
+        msgData.data.push_back(0); // flags
+        msgData.data.push_back(1); // protocol version
+        msgData.write(uint32(0)); // body length
+        msgData.write(uint32(1)); // serial
+        const uint32 contentStart = msgData.beginArray(8);
+        const uint32 fieldCount = randomInt(5);
+        for (uint32 i = 0; i < fieldCount; i++) {
+            msgData.pad(8);
+            const byte field = byte(randomInt(Message::UnixFdsHeader) + (randomInt(20) == 0 ? 0 : 1));
+            msgData.data.push_back(field);
+            // mostly the right type of value, sometimes not
+            char letter = 's';
+            if (field == Message::PathHeader) {
+                letter = 'o';
+            } else if (field == Message::SignatureHeader) {
+                letter = 'g';
+            } else if (field == Message::ReplySerialHeader || field == Message::UnixFdsHeader) {
+                letter = 'u';
+            }
+            if (randomInt(10) == 0) {
+                letter = letters[randomInt(sizeof(letters) - 1)];
+            }
+            const char signature[2] = { letter, '\0' };
+            msgData.writeSignature(signature);
+            const char *const str = strings[randomInt(sizeof(strings) / sizeof(strings[0]) - 1)];
+            switch (letter) {
+            case 'o':
+            case 's':
+                msgData.writeString(str);
+                break;
+            case 'g':
+                msgData.writeSignature(str);
+                break;
+            case 'y':
+                msgData.data.push_back(byte(randomInt(255)));
+                break;
+            default:
+                msgData.write(uint32(random()));
+                break;
+            }
+        }
+        msgData.endArray(contentStart);
+        msgData.pad(8);
+
+        // corrupt some of the messages
+        std::vector<byte> &data = msgData.data;
+        const uint32 corruptionCount = randomInt(3) == 0 ? randomInt(3) : 0;
+        for (uint32 i = 0; i < corruptionCount && data.size() > 12; i++) {
+            data[12 + randomInt(data.size() - 13)] = byte(randomInt(3) == 0 ? randomInt(255) : randomInt(10));
+        }
+
+        const GenericHeaders reference = parseHeadersGenerically(data);
+        Message msg;
+        msg.load(data);
+        TEST(msg.error().isError() == !reference.isValid);
+        if (!reference.isValid) {
+            continue;
+        }
+        validCount++;
+        for (int field = Message::PathHeader; field <= Message::UnixFdsHeader; field++) {
+            const Message::VariableHeader header = static_cast<Message::VariableHeader>(field);
+            bool isPresent = false;
+            if (field == Message::ReplySerialHeader || field == Message::UnixFdsHeader) {
+                TEST(msg.intHeader(header, &isPresent) == reference.ints[field]);
+            } else {
+                TEST(msg.stringHeader(header, &isPresent) == reference.strings[field]);
+            }
+            TEST(isPresent == reference.isPresent[field]);
+        }
+        // re-serializing valid headers must produce headers that the generic way also parses identically,
+        // unless the message is not valid for sending (e.g. a required header is missing)
+        const std::vector<byte> saved = msg.save();
+        if (!msg.error().isError()) {
+            const GenericHeaders reparsed = parseHeadersGenerically(saved);
+            TEST(reparsed.isValid);
+            for (int field = Message::PathHeader; field <= Message::UnixFdsHeader; field++) {
+                TEST(reparsed.isPresent[field] == reference.isPresent[field]);
+                TEST(reparsed.strings[field] == reference.strings[field]);
+                TEST(reparsed.ints[field] == reference.ints[field]);
+            }
+        }
+    }
+    // make sure that the test exercises both outcomes
+    TEST(validCount > 1000 && validCount < 19000);
+}
+
+static Arguments createTemplateTestArguments(uint32 count)
+{
+    Arguments::Writer writer;
+    writer.writeUint32(count);
+    writer.beginArray(count ? Arguments::Writer::NonEmptyArray : Arguments::Writer::WriteTypesOfEmptyArray);
+    for (uint32 i = 0; i < std::max(count, 1u); i++) {
+        writer.writeString(cstring("element"));
+    }
+    writer.endArray();
+    return writer.finish();
+}
+
+static void testMessageTemplate()
+{
+    Message prototype = Message::createSignal("/some/path", "org.example.Interface", "changed");
+    prototype.setSender(":1.23");
+    prototype.setArguments(createTemplateTestArguments(0));
+    const MessageTemplate messageTemplate(prototype);
+    TEST(!messageTemplate.error().isError());
+
+    for (uint32 count : { 0, 3, 2000 /* large enough to be sent separately from the header */ }) {
+        // without destination, byte-identical to the regular way
+        Message msg = messageTemplate.createMessage(createTemplateTestArguments(count));
+        TEST(!msg.error().isError());
+        TEST(msg.serial() == 0);
+        TEST(msg.save().empty()); // no serial yet
+        msg.setSerial(count + 1);
+
+        Message regular = Message::createSignal("/some/path", "org.example.Interface", "changed");
+        regular.setSender(":1.23");
+        regular.setSerial(count + 1);
+        regular.setArguments(createTemplateTestArguments(count));
+        TEST(msg.save() == regular.save());
+
+        // with destination
+        msg = messageTemplate.createMessage(createTemplateTestArguments(count), cstring("org.example.service"));
+        msg.setSerial(7);
+        Message loaded;
+        loaded.load(msg.save());
+        TEST(!loaded.error().isError());
+        TEST(loaded.type() == Message::SignalMessage);
+        TEST(loaded.serial() == 7);
+        TEST(loaded.path() == "/some/path");
+        TEST(loaded.interface() == "org.example.Interface");
+        TEST(loaded.method() == "changed");
+        TEST(loaded.sender() == ":1.23");
+        TEST(loaded.destination() == "org.example.service");
+        TEST(loaded.signature() == "uas");
+        Arguments::Reader reader(loaded.arguments());
+        TEST(reader.readUint32() == count);
+    }
+
+    // modifying a message created from the template serializes it again
+    {
+        Message msg = messageTemplate.createMessage(createTemplateTestArguments(1), cstring("org.example.a"));
+        msg.setSerial(1);
+        msg.setMethod("otherMethod");
+        msg.setExpectsReply(true);
+        Message loaded;
+        loaded.load(msg.save());
+        TEST(!loaded.error().isError());
+        TEST(loaded.method() == "otherMethod");
+        TEST(loaded.destination() == "org.example.a");
+        TEST(loaded.expectsReply());
+        // the template is unchanged
+        Message other = messageTemplate.createMessage(createTemplateTestArguments(1));
+        other.setSerial(1);
+        Message otherLoaded;
+        otherLoaded.load(other.save());
+        TEST(otherLoaded.method() == "changed");
+        TEST(otherLoaded.destination().empty());
+    }
+
+    // arguments with a different signature go the regular way
+    {
+        Arguments::Writer writer;
+        writer.writeString(cstring("different"));
+        Message msg = messageTemplate.createMessage(writer.finish(), cstring("org.example.b"));
+        msg.setSerial(1);
+        Message loaded;
+        loaded.load(msg.save());
+        TEST(!loaded.error().isError());
+        TEST(loaded.signature() == "s");
+        TEST(loaded.sender() == ":1.23");
+        TEST(loaded.destination() == "org.example.b");
+        TEST(!loaded.expectsReply());
+    }
+    // ...also no arguments at all
+    {
+        Message msg = messageTemplate.createMessage(Arguments());
+        msg.setSerial(1);
+        Message loaded;
+        loaded.load(msg.save());
+        TEST(!loaded.error().isError());
+        TEST(loaded.signature().empty());
+        TEST(loaded.interface() == "org.example.Interface");
+    }
+    // an invalid destination is an error, as usual
+    {
+        Message msg = messageTemplate.createMessage(createTemplateTestArguments(1), cstring("bad\xff"));
+        msg.setSerial(1);
+        TEST(msg.save().empty());
+        TEST(msg.error().code() == Error::MessageDestination);
+    }
+
+    // invalid prototype
+    {
+        Message invalid = Message::createSignal("no/path", "org.example.Interface", "changed");
+        const MessageTemplate invalidTemplate(invalid);
+        TEST(invalidTemplate.error().code() == Error::MessagePath);
+        Message msg = invalidTemplate.createMessage(Arguments());
+        TEST(msg.error().code() == Error::MessagePath);
+    }
+}
+
+static void testRelayArguments()
+{
+    for (uint32 length : { 0, 100, 20000 /* large enough to be sent separately from the header */ }) {
+        Message relay = Message::createSignal("/relay", "org.example.Relay", "forwarded");
+        relay.setSerial(2);
+        std::vector<byte> originalBody;
+        {
+            Message original = Message::createCall("/some/path", "org.example.Interface", "method");
+            original.setSerial(1);
+            Arguments::Writer writer;
+            writer.writeString(cstring("first"));
+            std::vector<byte> bytes(length, 'x');
+            writer.writePrimitiveArray(Arguments::Byte, chunk(bytes.data(), length));
+            original.setArguments(writer.finish());
+
+            Message received;
+            received.load(original.save());
+            TEST(!received.error().isError());
+            const chunk body = received.arguments().data();
+            originalBody.assign(body.ptr, body.ptr + body.length);
+
+            relay.setArgumentsFrom(received);
+            // not copied...
+            TEST(relay.arguments().data().ptr == body.ptr);
+            TEST(relay.signature() == "say");
+            // ...also not when copying the relaying message, or relaying again
+            const Message relayCopy = relay;
+            TEST(relayCopy.arguments().data().ptr == body.ptr);
+            Message relay2 = Message::createSignal("/relay", "org.example.Relay", "forwarded2");
+            relay2.setArgumentsFrom(relayCopy);
+            TEST(relay2.arguments().data().ptr == body.ptr);
+            // the original is still usable
+            TEST(received.signature() == "say");
+            received.setPath("/other/path");
+            TEST(!received.save().empty());
+        } // the relayed body stays alive without the messages it came from
+
+        relay.setDestination("org.example.service");
+        for (int i = 0; i < 2; i++) { // also after headers changed
+            Message reloaded;
+            reloaded.load(relay.save());
+            TEST(!reloaded.error().isError());
+            TEST(reloaded.path() == "/relay");
+            TEST(reloaded.method() == "forwarded");
+            TEST(reloaded.signature() == "say");
+            const chunk body = reloaded.arguments().data();
+            TEST(std::vector<byte>(body.ptr, body.ptr + body.length) == originalBody);
+            relay.setSender(":1.2");
+        }
+
+        // replacing the relayed arguments releases them
+        relay.setArguments(Arguments());
+        TEST(relay.signature().empty());
+        TEST(!relay.save().empty());
+    }
+
+    // arguments of a message that was not received or loaded are copied
+    {
+        Message local = Message::createCall("/some/path", "org.example.Interface", "method");
+        Arguments::Writer writer;
+        writer.writeUint32(123);
+        local.setArguments(writer.finish());
+        Message relay = Message::createSignal("/relay", "org.example.Relay", "forwarded");
+        relay.setArgumentsFrom(local);
+        TEST(relay.arguments().data().ptr != local.arguments().data().ptr);
+        TEST(relay.signature() == "u");
+        Arguments::Reader reader(relay.arguments());
+        TEST(reader.readUint32() == 123);
+    }
+}
+
 enum {
     // a small integer could be confused with an index into the fd array (in the implementation),
     // so make it large
@@ -192,14 +1120,6 @@ void testFileDescriptorsHeader()
     }
 }
 
-enum {
-    // for pipe2() file descriptor array
-    ReadSide = 0,
-    WriteSide = 1,
-    // how many file descriptors to send in test
-    FdCountToSend = 10
-};
-
 class FileDescriptorTestReceiver : public IMessageReceiver
 {
 public:
@@ -297,6 +1217,8 @@ int main(int, char *[])
         clientAddress.setRole(ConnectAddress::Role::PeerClient);
         clientAddress.setPath("dferry.Test.Message");
         testBasic(clientAddress);
+        testMessageBurst(clientAddress);
+        testStreamingReceive(clientAddress);
     }
 #endif
     // TODO: SocketType::Unix works on any Unix-compatible OS, but we'll need to construct a path
@@ -309,6 +1231,13 @@ int main(int, char *[])
     }
 
     testMessageLength();
+    testSerializeLargeBody();
+    testLoadByteSwapped();
+    testHeaderCodecDifferential();
+    testReceivedHeaders();
+    testSharedCopies();
+    testMessageTemplate();
+    testRelayArguments();
 
 #ifdef __unix__
     testFileDescriptorsInArguments();
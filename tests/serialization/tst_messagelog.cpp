@@ -0,0 +1,389 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LGPL.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+
+   Alternatively, this file is available under the Mozilla Public License
+   Version 1.1.  You may obtain a copy of the License at
+   http://www.mozilla.org/MPL/
+*/
+
+#include "arguments.h"
+#include "error.h"
+#include "message.h"
+#include "messagelog.h"
+
+#include "../testutil.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::string temporaryFileName()
+{
+    char name[] = "/tmp/tst_messagelog_XXXXXX";
+    const int fd = mkstemp(name);
+    TEST(fd >= 0);
+    ::close(fd);
+    return name;
+}
+
+static uint64 fileLength(const std::string &fileName)
+{
+    struct stat fileStat;
+    TEST(::stat(fileName.c_str(), &fileStat) == 0);
+    return uint64(fileStat.st_size);
+}
+
+static Message createMessage(uint32 i)
+{
+    Message msg = Message::createSignal("/log/test", "org.example.Log", "Entry");
+    msg.setSerial(i + 1);
+    Arguments::Writer writer;
+    writer.writeUint32(i);
+    // vary the length to test the padding between records
+    writer.writeString(std::string(i % 13, 'x').c_str());
+    msg.setArguments(writer.finish());
+    return msg;
+}
+
+static void checkMessage(const Message &msg, uint32 i)
+{
+    TEST(msg.type() == Message::SignalMessage);
+    TEST(msg.serial() == i + 1);
+    TEST(msg.path() == "/log/test");
+    TEST(msg.method() == "Entry");
+    Arguments::Reader reader(msg.arguments());
+    TEST(reader.readUint32() == i);
+    TEST(reader.readString().length == i % 13);
+    TEST(reader.isFinished());
+}
+
+static const uint32 messageCount = 100;
+
+static std::string writeLog()
+{
+    const std::string fileName = temporaryFileName();
+    MessageLog::Writer writer(fileName);
+    TEST(!writer.error().isError());
+    for (uint32 i = 0; i < messageCount; i++) {
+        Message msg = createMessage(i);
+        TEST(writer.append(&msg, 1000 + i));
+    }
+    Message invalid;
+    TEST(!writer.append(&invalid, 0)); // can't be serialized, but that doesn't break the log
+    TEST(writer.finish());
+    return fileName;
+}
+
+static void testWriteAndRead()
+{
+    const std::string fileName = writeLog();
+    std::vector<Message> messages;
+    {
+        MessageLog log(fileName);
+        TEST(!log.error().isError());
+        TEST(log.count() == messageCount);
+        // read in a different order than written
+        for (uint32 i = messageCount; i > 0; i--) {
+            TEST(log.timestamp(i - 1) == 1000 + i - 1);
+            checkMessage(log.message(i - 1), i - 1);
+        }
+        TEST(log.message(messageCount).type() == Message::InvalidMessage);
+        for (uint32 i = 0; i < messageCount; i++) {
+            messages.push_back(log.message(i));
+        }
+        MessageLog movedLog(std::move(log));
+        TEST(movedLog.count() == messageCount);
+    }
+    // the messages keep the mapping alive
+    for (uint32 i = 0; i < messageCount; i++) {
+        checkMessage(messages[i], i);
+    }
+    // copies share the mapped data, modifications don't affect the other copies
+    Message copy = messages[0];
+    TEST(copy.arguments().data().ptr == messages[0].arguments().data().ptr);
+    copy.setPath("/other/path");
+    TEST(copy.path() == "/other/path");
+    checkMessage(messages[0], 0);
+
+    // a message from a log can be written to another log
+    const std::string secondFileName = temporaryFileName();
+    {
+        MessageLog::Writer writer(secondFileName);
+        TEST(writer.append(&messages[1], 5));
+    }
+    {
+        MessageLog log(secondFileName);
+        TEST(log.count() == 1);
+        TEST(log.timestamp(0) == 5);
+        checkMessage(log.message(0), 1);
+    }
+    ::unlink(secondFileName.c_str());
+    ::unlink(fileName.c_str());
+}
+
+static void testMissingIndex()
+{
+    const std::string fileName = writeLog();
+    // cut off the index and trailer, as if the writer had crashed before finishing
+    const uint64 recordsEnd = fileLength(fileName) - messageCount * sizeof(uint64) - 16;
+    TEST(::truncate(fileName.c_str(), recordsEnd) == 0);
+    {
+        MessageLog log(fileName);
+        TEST(!log.error().isError());
+        TEST(log.count() == messageCount);
+        for (uint32 i = 0; i < messageCount; i++) {
+            TEST(log.timestamp(i) == 1000 + i);
+            checkMessage(log.message(i), i);
+        }
+    }
+    // ...and also while writing the last record
+    TEST(::truncate(fileName.c_str(), recordsEnd - 1) == 0);
+    {
+        MessageLog log(fileName);
+        TEST(!log.error().isError());
+        TEST(log.count() == messageCount - 1);
+        checkMessage(log.message(messageCount - 2), messageCount - 2);
+    }
+    ::unlink(fileName.c_str());
+}
+
+static void testInvalidFiles()
+{
+    {
+        MessageLog log("/nonexistent/file");
+        TEST(log.error().code() == Error::MessageLogFileError);
+        TEST(log.count() == 0);
+        TEST(log.message(0).type() == Message::InvalidMessage);
+    }
+    {
+        MessageLog::Writer writer("/nonexistent/file");
+        TEST(writer.error().code() == Error::MessageLogFileError);
+        Message msg = createMessage(0);
+        TEST(!writer.append(&msg, 0));
+    }
+    const std::string fileName = temporaryFileName();
+    {
+        FILE *file = fopen(fileName.c_str(), "wb");
+        const char garbage[] = "this is not a message log, it's just some text";
+        fwrite(garbage, 1, sizeof(garbage), file);
+        fclose(file);
+        MessageLog log(fileName);
+        TEST(log.error().code() == Error::MalformedMessageLog);
+        TEST(log.count() == 0);
+    }
+    {
+        // a corrupted message is only noticed when it is deserialized
+        const std::string logFileName = writeLog();
+        FILE *file = fopen(logFileName.c_str(), "r+b");
+        TEST(fseek(file, 16 + 16, SEEK_SET) == 0); // the first message
+        fputc('x', file); // the endianness flag
+        fclose(file);
+        MessageLog log(logFileName);
+        TEST(log.count() == messageCount);
+        TEST(log.message(0).error().isError());
+        checkMessage(log.message(1), 1);
+        ::unlink(logFileName.c_str());
+    }
+    {
+        // an index offset that only "fits" the file length due to overflow must be ignored
+        struct {
+            char magic[8];
+            byte endianness;
+            byte version;
+            byte zero[6];
+            uint64 indexOffset;
+            uint32 count;
+            char trailerMagic[4];
+        } crafted = { { 'd', 'f', 'e', 'r', 'l', 'o', 'g', '\0' }, 0, 1, { }, 0xfffffffffffffff8, 3,
+                      { 'i', 'n', 'd', 'x' } };
+        static_assert(sizeof(crafted) == 32, "");
+        const uint16 one = 1;
+        crafted.endianness = *reinterpret_cast<const byte *>(&one) == 1 ? 'l' : 'B';
+        FILE *file = fopen(fileName.c_str(), "wb");
+        TEST(fwrite(&crafted, 1, sizeof(crafted), file) == sizeof(crafted));
+        fclose(file);
+        MessageLog log(fileName);
+        TEST(!log.error().isError());
+        TEST(log.count() == 0);
+        TEST(log.timestamp(0) == 0);
+        TEST(log.message(0).type() == Message::InvalidMessage);
+    }
+    ::unlink(fileName.c_str());
+}
+
+// Writes log file and D-Bus data "by hand" in the byte order that this machine doesn't use
+class ForeignDataWriter
+{
+public:
+    template<typename T>
+    void write(T value)
+    {
+        pad(sizeof(T));
+        byte raw[sizeof(T)];
+        memcpy(raw, &value, sizeof(T));
+        std::reverse(raw, raw + sizeof(T));
+        data.insert(data.end(), raw, raw + sizeof(T));
+    }
+    template<typename T>
+    void patch(uint32 position, T value)
+    {
+        byte *const raw = &data[position];
+        memcpy(raw, &value, sizeof(T));
+        std::reverse(raw, raw + sizeof(T));
+    }
+    void writeBytes(const void *bytes, uint32 length)
+    {
+        const byte *const begin = static_cast<const byte *>(bytes);
+        data.insert(data.end(), begin, begin + length);
+    }
+    void writeString(const char *str)
+    {
+        write(uint32(strlen(str)));
+        writeBytes(str, strlen(str) + 1);
+    }
+    void writeSignature(const char *signature)
+    {
+        data.push_back(byte(strlen(signature)));
+        writeBytes(signature, strlen(signature) + 1);
+    }
+    void writeHeaderField(Message::VariableHeader header, const char *signature, const char *value)
+    {
+        pad(8);
+        data.push_back(byte(header));
+        writeSignature(signature);
+        if (signature[0] == 'g') {
+            writeSignature(value);
+        } else {
+            writeString(value);
+        }
+    }
+    void pad(uint32 alignment)
+    {
+        while (data.size() % alignment) {
+            data.push_back(0);
+        }
+    }
+
+    std::vector<byte> data;
+};
+
+static byte foreignEndianness()
+{
+    const uint16 one = 1;
+    return *reinterpret_cast<const byte *>(&one) == 1 ? 'B' : 'l';
+}
+
+// The same message as createMessage(i), serialized in the other byte order
+static std::vector<byte> createForeignMessage(uint32 i)
+{
+    ForeignDataWriter body;
+    body.write(uint32(i));
+    body.writeString(std::string(i % 13, 'x').c_str());
+
+    ForeignDataWriter msg;
+    msg.data.push_back(foreignEndianness());
+    msg.data.push_back(byte(Message::SignalMessage));
+    msg.data.push_back(0); // flags
+    msg.data.push_back(1); // protocol version
+    msg.write(uint32(body.data.size()));
+    msg.write(uint32(i + 1)); // serial
+    msg.write(uint32(0)); // length of header fields, patched below
+    const uint32 fieldsStart = msg.data.size();
+    msg.writeHeaderField(Message::PathHeader, "o", "/log/test");
+    msg.writeHeaderField(Message::InterfaceHeader, "s", "org.example.Log");
+    msg.writeHeaderField(Message::MethodHeader, "s", "Entry");
+    msg.writeHeaderField(Message::SignatureHeader, "g", "us");
+    msg.patch(fieldsStart - sizeof(uint32), uint32(msg.data.size() - fieldsStart));
+    msg.pad(8);
+    msg.writeBytes(body.data.data(), body.data.size());
+    return msg.data;
+}
+
+static void testForeignByteOrder()
+{
+    const std::string fileName = temporaryFileName();
+    ForeignDataWriter log;
+    const char fileMagic[8] = { 'd', 'f', 'e', 'r', 'l', 'o', 'g', '\0' };
+    log.writeBytes(fileMagic, sizeof(fileMagic));
+    log.data.push_back(foreignEndianness());
+    log.data.push_back(1); // version
+    log.pad(16);
+    std::vector<uint64> index;
+    for (uint32 i = 0; i < messageCount; i++) {
+        const std::vector<byte> msg = createForeignMessage(i);
+        index.push_back(log.data.size());
+        log.write(uint64(1000 + i));
+        log.write(uint32(msg.size()));
+        log.write(uint32(0));
+        log.writeBytes(msg.data(), msg.size());
+        log.pad(8);
+    }
+    const uint64 indexOffset = log.data.size();
+    for (uint64 recordOffset : index) {
+        log.write(recordOffset);
+    }
+    log.write(indexOffset);
+    log.write(uint32(messageCount));
+    log.writeBytes("indx", 4);
+
+    FILE *file = fopen(fileName.c_str(), "wb");
+    TEST(fwrite(log.data.data(), 1, log.data.size(), file) == log.data.size());
+    fclose(file);
+
+    {
+        MessageLog messageLog(fileName);
+        TEST(!messageLog.error().isError());
+        TEST(messageLog.count() == messageCount);
+        std::vector<Message> messages;
+        for (uint32 i = 0; i < messageCount; i++) {
+            TEST(messageLog.timestamp(i) == 1000 + i);
+            messages.push_back(messageLog.message(i));
+            checkMessage(messages.back(), i);
+        }
+        // the second time, the messages have already been converted to native byte order in the mapping
+        for (uint32 i = 0; i < messageCount; i++) {
+            TEST(messageLog.timestamp(i) == 1000 + i);
+            checkMessage(messageLog.message(i), i);
+            checkMessage(messages[i], i);
+        }
+    }
+    // the conversion does not modify the file
+    {
+        FILE *file = fopen(fileName.c_str(), "rb");
+        std::vector<byte> contents(log.data.size());
+        TEST(fread(contents.data(), 1, contents.size(), file) == contents.size());
+        fclose(file);
+        TEST(contents == log.data);
+    }
+    ::unlink(fileName.c_str());
+}
+
+int main(int, char *[])
+{
+    testWriteAndRead();
+    testMissingIndex();
+    testInvalidFiles();
+    testForeignByteOrder();
+    std::cout << "Passed!\n";
+}
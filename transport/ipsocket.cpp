@@ -205,6 +205,24 @@ IO::Result IpSocket::write(chunk a)
     return ret;
 }
 
+#ifndef _WIN32
+IO::Result IpSocket::writeChunks(const chunk *data, uint32 count)
+{
+    if (!isValidFileDescriptor(m_fd)) {
+        std::cerr << "\nIpSocket::writeChunks() failed A.\n\n";
+        IO::Result ret;
+        ret.status = IO::Status::InternalError;
+        return ret;
+    }
+
+    struct msghdr send_msg;
+    memset(&send_msg, 0, sizeof(send_msg));
+    return writeChunksWithSendmsg(data, count, &send_msg, [this](struct msghdr *msg) {
+        return sendmsg(m_fd, msg, sendFlags());
+    }, IO::Status::InternalError);
+}
+#endif
+
 IO::Result IpSocket::read(byte *buffer, uint32 maxSize)
 {
     IO::Result ret;
@@ -235,6 +253,10 @@ IO::Result IpSocket::read(byte *buffer, uint32 maxSize)
         }
         ret.length += uint32(nbytes);
         buffer += nbytes;
+        // A short read means that the socket is drained for now; don't spend a syscall to get EAGAIN.
+        if (uint32(nbytes) < maxSize) {
+            break;
+        }
         maxSize -= uint32(nbytes);
     }
 
@@ -42,6 +42,9 @@ public:
 
     // pure virtuals from ITransport
     IO::Result write(chunk data) override;
+#ifndef _WIN32
+    IO::Result writeChunks(const chunk *data, uint32 count) override;
+#endif
     IO::Result read(byte *buffer, uint32 maxSize) override;
     void platformClose() override;
     bool isOpen() override;
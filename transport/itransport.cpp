@@ -31,10 +31,25 @@
 
 #ifdef __unix__
 #include "localsocket.h"
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #endif
 
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+enum {
+    // Large enough to hold a good number of typical messages, small enough to not be wasteful
+    ReceiveBufferSize = 65536,
+    // more than enough to write many messages per syscall, few enough to keep them on the stack
+    MaxIovecs = 256
+};
 
 ITransport::ITransport()
 {
@@ -42,8 +57,18 @@ ITransport::ITransport()
 
 ITransport::~ITransport()
 {
+    if (m_deletionGuard) {
+        *m_deletionGuard = false;
+    }
     setReadListener(nullptr);
     setWriteListener(nullptr);
+#ifdef __unix__
+    // received, but never handed out to a message
+    for (int fd : m_receivedFds) {
+        ::close(fd);
+    }
+#endif
+    free(m_receiveBuffer);
 }
 
 IO::Result ITransport::readWithFileDescriptors(byte *buffer, uint32 maxSize, std::vector<int> *)
@@ -63,6 +88,147 @@ IO::Result ITransport::writeWithFileDescriptors(chunk, const std::vector<int> &)
     return res;
 }
 
+IO::Result ITransport::writeChunks(const chunk *data, uint32 count)
+{
+    // Fallback for transports that can't do better. Stop after a partial write, the rest would have to
+    // be written later anyway.
+    IO::Result ret;
+    for (uint32 i = 0; i < count && ret.status == IO::Status::OK; i++) {
+        const IO::Result chunkResult = write(data[i]);
+        ret.status = chunkResult.status;
+        ret.length += chunkResult.length;
+        if (chunkResult.length < data[i].length) {
+            break;
+        }
+    }
+    return ret;
+}
+
+IO::Result ITransport::writeChunksWithFileDescriptors(const chunk *data, uint32 count,
+                                                      const std::vector<int> &fileDescriptors)
+{
+    IO::Result ret;
+    if (count == 0) {
+        return ret;
+    }
+    ret = writeWithFileDescriptors(data[0], fileDescriptors);
+    if (ret.status == IO::Status::OK && ret.length == data[0].length) {
+        const IO::Result restResult = writeChunks(data + 1, count - 1);
+        ret.status = restResult.status;
+        ret.length += restResult.length;
+    }
+    return ret;
+}
+
+#ifndef _WIN32
+IO::Result ITransport::writeChunksWithSendmsg(const chunk *data, uint32 count, struct msghdr *msg,
+                                              const std::function<ssize_t(struct msghdr *)> &sendMessage,
+                                              IO::Status errorStatus)
+{
+    IO::Result ret;
+    struct iovec iov[MaxIovecs];
+    msg->msg_iov = iov;
+
+    // current write position: index of chunk and offset into it
+    uint32 chunkIndex = 0;
+    uint32 chunkOffset = 0;
+    while (true) {
+        uint32 iovCount = 0;
+        size_t toWrite = 0;
+        for (uint32 i = chunkIndex; i < count && iovCount < MaxIovecs; i++) {
+            const uint32 offset = i == chunkIndex ? chunkOffset : 0;
+            if (data[i].length > offset) {
+                iov[iovCount].iov_base = data[i].ptr + offset;
+                iov[iovCount].iov_len = data[i].length - offset;
+                toWrite += iov[iovCount].iov_len;
+                iovCount++;
+            }
+        }
+        if (iovCount == 0) {
+            break;
+        }
+        msg->msg_iovlen = iovCount;
+
+        ssize_t nbytes = sendMessage(msg);
+        if (nbytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // see EAGAIN comment in LocalSocket::read()
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            close();
+            ret.status = errorStatus;
+            break;
+        } else if (nbytes == 0) {
+            break;
+        }
+
+        // control message already sent, don't send again
+        msg->msg_control = nullptr;
+        msg->msg_controllen = 0;
+
+        ret.length += uint32(nbytes);
+        for (size_t advance = size_t(nbytes); advance > 0; ) {
+            const uint32 chunkLeft = data[chunkIndex].length - chunkOffset;
+            if (advance >= chunkLeft) {
+                advance -= chunkLeft;
+                chunkIndex++;
+                chunkOffset = 0;
+            } else {
+                chunkOffset += uint32(advance);
+                advance = 0;
+            }
+        }
+        if (size_t(nbytes) < toWrite) {
+            break; // socket buffer full, try again later
+        }
+    }
+
+    msg->msg_iov = nullptr;
+    msg->msg_iovlen = 0;
+    return ret;
+}
+#endif
+
+IO::Result ITransport::readBuffered(byte *buffer, uint32 maxSize, std::vector<int> *fileDescriptors)
+{
+    IO::Result ret;
+    if (m_receiveBufferPos == m_receiveBufferEnd) {
+        if (maxSize >= ReceiveBufferSize) {
+            // Nothing to gain from copying large amounts of data (typically the body of a large message)
+            // through the buffer. Everything read here belongs to the caller, so do file descriptors.
+            return readWithFileDescriptors(buffer, maxSize, fileDescriptors);
+        }
+        if (!m_receiveBuffer) {
+            m_receiveBuffer = static_cast<byte *>(malloc(ReceiveBufferSize));
+        }
+        assert(m_receivedFds.empty());
+        m_receiveBufferPos = 0;
+        const IO::Result fillResult = readWithFileDescriptors(m_receiveBuffer, ReceiveBufferSize,
+                                                              &m_receivedFds);
+        m_receiveBufferEnd = fillResult.length;
+        // The platform read stops right after a read that passed file descriptors. The data that is sent
+        // together with file descriptors is never split across two reads that return file descriptors, so
+        // the last byte read belongs to the message that the file descriptors were sent with.
+        // That works even if the sending side had to send the message in several parts because only the
+        // first part carries the file descriptors.
+        m_receivedFdsPos = fillResult.length ? fillResult.length - 1 : 0;
+        ret.status = fillResult.status;
+    }
+
+    const uint32 length = std::min(maxSize, m_receiveBufferEnd - m_receiveBufferPos);
+    memcpy(buffer, m_receiveBuffer + m_receiveBufferPos, length);
+    m_receiveBufferPos += length;
+    if (!m_receivedFds.empty() && m_receivedFdsPos < m_receiveBufferPos) {
+        fileDescriptors->insert(fileDescriptors->end(), m_receivedFds.begin(), m_receivedFds.end());
+        m_receivedFds.clear();
+    }
+    ret.length = length;
+    return ret;
+}
+
 void ITransport::setReadListener(ITransportListener *listener)
 {
     if (m_readListener != listener) {
@@ -121,7 +287,26 @@ IO::Status ITransport::handleIoReady(IO::RW rw)
     IO::Status ret = IO::Status::OK;
     assert(uint32(rw) & ioInterest()); // only get notified about events we requested
     if (rw == IO::RW::Read && m_readListener) {
-        ret = m_readListener->handleTransportCanRead();
+        // When a read listener (a message) is done, it is replaced by the next one, which must see the
+        // data that is already in the receive buffer. There will be no readiness notification for that data,
+        // so keep going until the buffer is empty, or nobody wants to read, or a listener makes no progress.
+        // Reading might lead to the deletion of this transport, e.g. in a reply handler - hence the guard.
+        bool alive = true;
+        bool *const outerDeletionGuard = m_deletionGuard;
+        m_deletionGuard = &alive;
+        uint32 bufferedLength = 0;
+        ITransportListener *listener = nullptr;
+        do {
+            bufferedLength = bufferedReadLength();
+            listener = m_readListener;
+            ret = m_readListener->handleTransportCanRead();
+        } while (alive && ret == IO::Status::OK && m_readListener && bufferedReadLength() &&
+                 (m_readListener != listener || bufferedReadLength() != bufferedLength));
+        if (alive) {
+            m_deletionGuard = outerDeletionGuard;
+        } else if (outerDeletionGuard) {
+            *outerDeletionGuard = false;
+        }
     } else if (rw == IO::RW::Write && m_writeListener) {
         ret = m_writeListener->handleTransportCanWrite();
     } else {
@@ -28,8 +28,14 @@
 #include "platform.h"
 #include "types.h"
 
+#include <functional>
 #include <vector>
 
+#ifndef _WIN32
+#include <sys/types.h>
+struct msghdr;
+#endif
+
 class ConnectAddress;
 class EventDispatcher;
 class ITransportListener;
@@ -54,6 +60,18 @@ public:
                                                std::vector<int> *fileDescriptors);
     virtual IO::Result write(chunk data) = 0;
     virtual IO::Result writeWithFileDescriptors(chunk data, const std::vector<int> &fileDescriptors);
+    // Write the data in several buffers as if it was one contiguous buffer, ideally in one syscall.
+    // File descriptors are sent with the first byte written.
+    virtual IO::Result writeChunks(const chunk *data, uint32 count);
+    virtual IO::Result writeChunksWithFileDescriptors(const chunk *data, uint32 count,
+                                                      const std::vector<int> &fileDescriptors);
+
+    // Reads through a receive buffer that is filled in large chunks, so that many small messages can be
+    // received with one syscall. Returns at most the data currently buffered if there is any; only reads
+    // from the platform when the buffer is empty. File descriptors are appended to fileDescriptors
+    // together with the data byte they belong to, see the implementation for details.
+    IO::Result readBuffered(byte *buffer, uint32 maxSize, std::vector<int> *fileDescriptors);
+    uint32 bufferedReadLength() const { return m_receiveBufferEnd - m_receiveBufferPos; }
 
     void close();
     virtual bool isOpen() = 0;
@@ -67,6 +85,15 @@ public:
 
 protected:
     virtual void platformClose() = 0;
+#ifndef _WIN32
+    // Implementation of writeChunks() for sockets that support sendmsg(). sendMessage must behave like
+    // sendmsg() on the given msghdr, which is msg with iovecs for the data that is left to write. Control
+    // data in msg is only sent with the first successful call. On errors other than "try again later",
+    // the transport is closed and errorStatus is returned.
+    IO::Result writeChunksWithSendmsg(const chunk *data, uint32 count, struct msghdr *msg,
+                                      const std::function<ssize_t(struct msghdr *)> &sendMessage,
+                                      IO::Status errorStatus);
+#endif
     uint32 m_supportedUnixFdsCount = 0;
 
 private:
@@ -76,6 +103,14 @@ private:
 
     ITransportListener *m_readListener = nullptr;
     ITransportListener *m_writeListener = nullptr;
+
+    // receive buffer, see readBuffered()
+    byte *m_receiveBuffer = nullptr;
+    uint32 m_receiveBufferPos = 0;
+    uint32 m_receiveBufferEnd = 0;
+    uint32 m_receivedFdsPos = 0; // position of the data byte that m_receivedFds arrived with
+    std::vector<int> m_receivedFds;
+    bool *m_deletionGuard = nullptr;
 };
 
 #endif // ITRANSPORT_H
@@ -89,50 +89,28 @@ void LocalSocket::platformClose()
 
 IO::Result LocalSocket::write(chunk data)
 {
-    IO::Result ret;
-    if (data.length == 0) {
-        return ret;
-    }
-    if (m_fd < 0) {
-        ret.status = IO::Status::InternalError;
-        return ret;
-    }
-
-    const uint32 initialLength = data.length;
+    return sendChunks(&data, 1, nullptr);
+}
 
-    while (data.length > 0) {
-        ssize_t nbytes = send(m_fd, data.ptr, data.length, MSG_DONTWAIT | MSG_NOSIGNAL);
-        if (nbytes < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            // see EAGAIN comment in read()
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
-            }
-            close();
-            ret.status = IO::Status::RemoteClosed;
-            return ret;
-        } else if (nbytes == 0) {
-            break;
-        }
+IO::Result LocalSocket::writeWithFileDescriptors(chunk data, const std::vector<int> &fileDescriptors)
+{
+    return sendChunks(&data, 1, &fileDescriptors);
+}
 
-        data.ptr += nbytes;
-        data.length -= size_t(nbytes);
-    }
+IO::Result LocalSocket::writeChunks(const chunk *data, uint32 count)
+{
+    return sendChunks(data, count, nullptr);
+}
 
-    ret.length = initialLength - data.length;
-    return ret;
+IO::Result LocalSocket::writeChunksWithFileDescriptors(const chunk *data, uint32 count,
+                                                       const std::vector<int> &fileDescriptors)
+{
+    return sendChunks(data, count, &fileDescriptors);
 }
 
-// TODO: consider using iovec to avoid "copying together" message parts before sending; iovec tricks
-// are probably not going to help for receiving, though.
-IO::Result LocalSocket::writeWithFileDescriptors(chunk data, const std::vector<int> &fileDescriptors)
+IO::Result LocalSocket::sendChunks(const chunk *data, uint32 count, const std::vector<int> *fileDescriptors)
 {
     IO::Result ret;
-    if (data.length == 0) {
-        return ret;
-    }
     if (m_fd < 0) {
         ret.status = IO::Status::InternalError;
         return ret;
@@ -140,21 +118,15 @@ IO::Result LocalSocket::writeWithFileDescriptors(chunk data, const std::vector<i
 
     // sendmsg  boilerplate
     struct msghdr send_msg;
-    struct iovec iov;
 
     send_msg.msg_name = nullptr;
     send_msg.msg_namelen = 0;
     send_msg.msg_flags = 0;
-    send_msg.msg_iov = &iov;
-    send_msg.msg_iovlen = 1;
-
-    iov.iov_base = data.ptr;
-    iov.iov_len = data.length;
 
     // we can only send a fixed number of fds anyway due to the non-flexible size of the control message
     // receive buffer, so we set an arbitrary limit.
-    const uint32 numFds = fileDescriptors.size();
-    if (fileDescriptors.size() > MaxFds) {
+    const uint32 numFds = fileDescriptors ? fileDescriptors->size() : 0;
+    if (numFds > MaxFds) {
         // TODO allow a proper error return
         close();
         ret.status = IO::Status::InternalError;
@@ -177,7 +149,7 @@ IO::Result LocalSocket::writeWithFileDescriptors(chunk data, const std::vector<i
         // set the control data to pass - this is why we don't use the simpler write()
         int *const fdPayload = reinterpret_cast<int *>(CMSG_DATA(c_msg));
         for (uint32 i = 0; i < numFds; i++) {
-            fdPayload[i] = fileDescriptors[i];
+            fdPayload[i] = (*fileDescriptors)[i];
         }
     } else {
         // no file descriptor to send, no control message
@@ -185,33 +157,9 @@ IO::Result LocalSocket::writeWithFileDescriptors(chunk data, const std::vector<i
         send_msg.msg_controllen = 0;
     }
 
-    while (iov.iov_len > 0) {
-        ssize_t nbytes = sendmsg(m_fd, &send_msg, MSG_DONTWAIT);
-        if (nbytes < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            // see EAGAIN comment in read()
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
-            }
-            close();
-            ret.status = IO::Status::RemoteClosed;
-            break;
-        } else if (nbytes == 0) {
-            break;
-        } else if (nbytes > 0) {
-            // control message already sent, don't send again
-            send_msg.msg_control = nullptr;
-            send_msg.msg_controllen = 0;
-        }
-
-        iov.iov_base = static_cast<char *>(iov.iov_base) + nbytes;
-        iov.iov_len -= size_t(nbytes);
-    }
-
-    ret.length = data.length - iov.iov_len;
-    return ret;
+    return writeChunksWithSendmsg(data, count, &send_msg, [this](struct msghdr *msg) {
+        return sendmsg(m_fd, msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }, IO::Status::RemoteClosed);
 }
 
 IO::Result LocalSocket::read(byte *buffer, uint32 maxSize)
@@ -226,7 +174,8 @@ IO::Result LocalSocket::read(byte *buffer, uint32 maxSize)
     }
 
     while (ret.length < maxSize) {
-        ssize_t nbytes = recv(m_fd, buffer + ret.length, maxSize - ret.length, MSG_DONTWAIT);
+        const uint32 wanted = maxSize - ret.length;
+        ssize_t nbytes = recv(m_fd, buffer + ret.length, wanted, MSG_DONTWAIT);
         if (nbytes < 0) {
             if (errno == EINTR) {
                 continue;
@@ -250,6 +199,10 @@ IO::Result LocalSocket::read(byte *buffer, uint32 maxSize)
             return ret;
         }
         ret.length += size_t(nbytes);
+        // A short read means that the socket is drained for now; don't spend a syscall to get EAGAIN.
+        if (uint32(nbytes) < wanted) {
+            break;
+        }
     }
 
     return ret;
@@ -271,12 +224,6 @@ IO::Result LocalSocket::readWithFileDescriptors(byte *buffer, uint32 maxSize,
     struct msghdr recv_msg;
     char cmsgBuf[CMSG_SPACE(sizeof(int) * MaxFds)];
 
-    recv_msg.msg_control = cmsgBuf;
-    recv_msg.msg_controllen = CMSG_SPACE(MaxFdPayloadSize);
-    memset(cmsgBuf, 0, recv_msg.msg_controllen);
-    // prevent equivalent to CVE-2014-3635 in libdbus-1: We could receive and ignore an extra file
-    // descriptor, thus eventually run out of file descriptors
-    recv_msg.msg_controllen = CMSG_LEN(MaxFdPayloadSize);
     recv_msg.msg_name = nullptr;
     recv_msg.msg_namelen = 0;
     recv_msg.msg_flags = 0;
@@ -290,6 +237,13 @@ IO::Result LocalSocket::readWithFileDescriptors(byte *buffer, uint32 maxSize,
     iov.iov_base = buffer;
     iov.iov_len = maxSize;
     while (iov.iov_len > 0) {
+        recv_msg.msg_control = cmsgBuf;
+        recv_msg.msg_controllen = CMSG_SPACE(MaxFdPayloadSize);
+        memset(cmsgBuf, 0, recv_msg.msg_controllen);
+        // prevent equivalent to CVE-2014-3635 in libdbus-1: We could receive and ignore an extra file
+        // descriptor, thus eventually run out of file descriptors
+        recv_msg.msg_controllen = CMSG_LEN(MaxFdPayloadSize);
+
         ssize_t nbytes = recvmsg(m_fd, &recv_msg, MSG_DONTWAIT);
         if (nbytes < 0) {
             if (errno == EINTR) {
@@ -307,26 +261,31 @@ IO::Result LocalSocket::readWithFileDescriptors(byte *buffer, uint32 maxSize,
             close();
             ret.status = IO::Status::RemoteClosed;
             break;
-        } else {
-            // read any file descriptors passed via control messages
-
-            struct cmsghdr *c_msg = CMSG_FIRSTHDR(&recv_msg);
-            if (c_msg && c_msg->cmsg_level == SOL_SOCKET && c_msg->cmsg_type == SCM_RIGHTS) {
-                const int count = (c_msg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
-                const int *const fdPayload = reinterpret_cast<int *>(CMSG_DATA(c_msg));
-                for (int i = 0; i < count; i++) {
-                    fileDescriptors->push_back(fdPayload[i]);
-                }
-            }
-
-            // control message already received, don't receive another
-            recv_msg.msg_control = nullptr;
-            recv_msg.msg_controllen = 0;
         }
 
         ret.length += size_t(nbytes);
         iov.iov_base = static_cast<char *>(iov.iov_base) + nbytes;
         iov.iov_len -= size_t(nbytes);
+
+        // read any file descriptors passed via control messages
+        bool receivedFds = false;
+        struct cmsghdr *c_msg = CMSG_FIRSTHDR(&recv_msg);
+        if (c_msg && c_msg->cmsg_level == SOL_SOCKET && c_msg->cmsg_type == SCM_RIGHTS) {
+            const int count = (c_msg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *const fdPayload = reinterpret_cast<int *>(CMSG_DATA(c_msg));
+            for (int i = 0; i < count; i++) {
+                fileDescriptors->push_back(fdPayload[i]);
+            }
+            receivedFds = count > 0;
+        }
+
+        // The kernel ends a read after the data that file descriptors were sent with, so the file
+        // descriptors belong to the message containing the last byte read. Stop here so that the caller
+        // can rely on that (see ITransport::readBuffered()). A short read means that the socket is
+        // drained for now.
+        if (receivedFds || iov.iov_len > 0) {
+            break;
+        }
     }
 
     return ret;
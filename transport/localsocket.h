@@ -41,6 +41,9 @@ public:
     // virtuals from ITransport
     IO::Result write(chunk data) override;
     IO::Result writeWithFileDescriptors(chunk data, const std::vector<int> &fileDescriptors) override;
+    IO::Result writeChunks(const chunk *data, uint32 count) override;
+    IO::Result writeChunksWithFileDescriptors(const chunk *data, uint32 count,
+                                              const std::vector<int> &fileDescriptors) override;
     IO::Result read(byte *buffer, uint32 maxSize) override;
     IO::Result readWithFileDescriptors(byte *buffer, uint32 maxSize,
                                        std::vector<int> *fileDescriptors) override;
@@ -54,6 +57,7 @@ public:
     LocalSocket &operator=(const LocalSocket &) = delete;
 
 private:
+    IO::Result sendChunks(const chunk *data, uint32 count, const std::vector<int> *fileDescriptors);
     int m_fd;
 };
 
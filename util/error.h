@@ -128,6 +128,11 @@ public:
                                // around a message with lots of file descriptors locally.
         MaxConnectionError = 3071,
 
+        // MessageLog
+        MessageLogFileError, // opening, creating, writing or mapping the file failed
+        MalformedMessageLog,
+        MaxMessageLogError = 4095,
+
         // errors for other occasions go here
     };
 
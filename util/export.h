@@ -23,7 +23,9 @@
 
 #ifdef _WIN32
 
-#ifdef dfer_EXPORTS
+#if defined(DFERRY_SERDES_ONLY) // the dferserdes static library
+#define DFERRY_EXPORT
+#elif defined(dfer_EXPORTS)
 #define DFERRY_EXPORT __declspec(dllexport)
 #else
 #define DFERRY_EXPORT __declspec(dllimport)